@@ -31,59 +31,246 @@
 
 #include "copy.h"
 #include "pub_tool_mallocfree.h"
+#include "pub_tool_libcassert.h"
+
+/*------------------------------------------------------------*/
+/*--- Per-superblock clone arenas                          ---*/
+/*------------------------------------------------------------*/
+
+/* The clones handed to the dirty helpers must live as long as the
+   translation that references them, and no longer. Rather than
+   VG_(malloc)'ing every node, we bump-allocate them from an arena
+   owned by the translation being instrumented, and release the whole
+   arena when Valgrind discards that translation. Arenas are keyed by
+   the translation's non-redirected address (closure->nraddr, the
+   orig_addr of the discard callback), which is unique among the live
+   translations of the transtab. The no-redirect translations used to
+   call the original of a wrapped function share that address with the
+   redirected one, so the start of the code (vge->base[0]) is kept too
+   and must match as well. Valgrind flushes no-redirect translations
+   without calling the discard callback, but it only translates the
+   same (nraddr, base) again once the previous translation is gone: an
+   arena still around with that key is stale and freed right away. So
+   there is at most one no-redirect arena per wrapped function.
+*/
+
+#define CLONE_CHUNK_SZB   4096
+#define CLONE_ALIGN       sizeof(ULong)
+
+typedef
+   struct _CloneChunk {
+      struct _CloneChunk* next;
+      SizeT               used;
+      SizeT               size;
+      /* data follows */
+   }
+   CloneChunk;
+
+typedef
+   struct _CloneArena {
+      struct _CloneArena* next;
+      UWord               key;     /* closure->nraddr */
+      Addr64              base;    /* vge->base[0] */
+      CloneChunk*         chunks;
+      SizeT               bytes;   /* bytes obtained from VG_(malloc) */
+   }
+   CloneArena;
+
+static VgHashTable  cloneArenas  = NULL;
+static CloneArena*  curArena     = NULL;
+
+/* Stats */
+static SizeT cloneBytesLive   = 0;
+static SizeT cloneBytesPeak   = 0;
+static ULong cloneBytesTotal  = 0;
+static ULong cloneArenasMade  = 0;
+static ULong cloneArenasFreed = 0;
+
+#define CLONE_CHUNK_HDR   VG_ROUNDUP(sizeof(CloneChunk), CLONE_ALIGN)
+
+static void* arenaAlloc(CloneArena* a, SizeT n)
+{
+   CloneChunk* c = a->chunks;
+   void*       p;
+
+   n = VG_ROUNDUP(n, CLONE_ALIGN);
+   if (c == NULL || c->used + n > c->size) {
+      SizeT sz = n > CLONE_CHUNK_SZB ? n : CLONE_CHUNK_SZB;
+      c = VG_(malloc)("copy.arenaAlloc.1", CLONE_CHUNK_HDR + sz);
+      c->used = 0;
+      c->size = sz;
+      /* Keep the chunk with room at the head: an oversized request
+         gets its own chunk, which is full and goes second. */
+      if (n == sz && a->chunks) {
+         c->next = a->chunks->next;
+         a->chunks->next = c;
+      } else {
+         c->next = a->chunks;
+         a->chunks = c;
+      }
+      a->bytes        += CLONE_CHUNK_HDR + sz;
+      cloneBytesLive  += CLONE_CHUNK_HDR + sz;
+      cloneBytesTotal += CLONE_CHUNK_HDR + sz;
+      if (cloneBytesLive > cloneBytesPeak) cloneBytesPeak = cloneBytesLive;
+   }
+   p = (HChar*)c + CLONE_CHUNK_HDR + c->used;
+   c->used += n;
+   return p;
+}
+
+static void freeArena(CloneArena* a)
+{
+   CloneChunk* c = a->chunks;
+   while (c) {
+      CloneChunk* next = c->next;
+      VG_(free)(c);
+      c = next;
+   }
+   tl_assert(cloneBytesLive >= a->bytes);
+   cloneBytesLive -= a->bytes;
+   cloneArenasFreed++;
+   VG_(free)(a);
+}
+
+/* Allocate from the arena of the superblock being instrumented, or
+   from the tool heap when no arena is open. */
+void* mallocClone(const HChar* cc, SizeT n)
+{
+   if (curArena)
+      return arenaAlloc(curArena, n);
+   return VG_(malloc)(cc, n);
+}
+
+void beginCloneArena(Addr64 nraddr, Addr64 base)
+{
+   tl_assert(curArena == NULL);
+   if (cloneArenas == NULL)
+      cloneArenas = VG_(HT_construct)("copy.cloneArenas");
+   else
+      discardCloneArena(nraddr, base);
+   curArena = VG_(malloc)("copy.beginCloneArena.1", sizeof(CloneArena));
+   curArena->key    = (UWord)nraddr;
+   curArena->base   = base;
+   curArena->chunks = NULL;
+   curArena->bytes  = 0;
+   cloneArenasMade++;
+}
+
+void endCloneArena(void)
+{
+   tl_assert(curArena);
+   if (curArena->chunks) {
+      VG_(HT_add_node)(cloneArenas, curArena);
+   } else {
+      /* nothing was cloned: don't keep an empty arena around */
+      VG_(free)(curArena);
+      cloneArenasMade--;
+   }
+   curArena = NULL;
+}
+
+/* Free the arena of exactly one translation. The others with the same
+   nraddr (no-redirect translations) are put back. */
+void discardCloneArena(Addr64 nraddr, Addr64 base)
+{
+   CloneArena* a;
+   CloneArena* others = NULL;
+   if (cloneArenas == NULL)
+      return;
+   while ((a = VG_(HT_remove)(cloneArenas, (UWord)nraddr)) != NULL) {
+      if (a->base == base) {
+         freeArena(a);
+         break;
+      }
+      a->next = others;
+      others  = a;
+   }
+   while (others) {
+      a      = others;
+      others = a->next;
+      VG_(HT_add_node)(cloneArenas, a);
+   }
+}
+
+static void freeArenaNode(void* a)
+{
+   freeArena((CloneArena*)a);
+}
+
+void releaseCloneArenas(void)
+{
+   if (cloneArenas == NULL)
+      return;
+   VG_(HT_destruct)(cloneArenas, freeArenaNode);
+   cloneArenas = NULL;
+}
+
+void getCloneArenaStats(SizeT* live, SizeT* peak, ULong* total,
+                        ULong* made, ULong* freed)
+{
+   *live  = cloneBytesLive;
+   *peak  = cloneBytesPeak;
+   *total = cloneBytesTotal;
+   *made  = cloneArenasMade;
+   *freed = cloneArenasFreed;
+}
+
+/*------------------------------------------------------------*/
+/*--- Constructors                                         ---*/
+/*------------------------------------------------------------*/
 
 IRConst* mallocIRConst_U1(Bool bit)
 {
-   IRConst* c = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c = mallocClone("IRConst", sizeof(IRConst));
    c->tag     = Ico_U1;
    c->Ico.U1  = bit;
    return c;
 }
 IRConst* mallocIRConst_U8(UChar u8)
 {
-   IRConst* c = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c = mallocClone("IRConst", sizeof(IRConst));
    c->tag     = Ico_U8;
    c->Ico.U8  = u8;
    return c;
 }
 IRConst* mallocIRConst_U16(UShort u16)
 {
-   IRConst* c = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c = mallocClone("IRConst", sizeof(IRConst));
    c->tag     = Ico_U16;
    c->Ico.U16 = u16;
    return c;
 }
 IRConst* mallocIRConst_U32(UInt u32)
 {
-   IRConst* c = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c = mallocClone("IRConst", sizeof(IRConst));
    c->tag     = Ico_U32;
    c->Ico.U32 = u32;
    return c;
 }
 IRConst* mallocIRConst_U64(ULong u64)
 {
-   IRConst* c = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c = mallocClone("IRConst", sizeof(IRConst));
    c->tag     = Ico_U64;
    c->Ico.U64 = u64;
    return c;
 }
 IRConst* mallocIRConst_F64(Double f64)
 {
-   IRConst* c = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c = mallocClone("IRConst", sizeof(IRConst));
    c->tag     = Ico_F64;
    c->Ico.F64 = f64;
    return c;
 }
 IRConst* mallocIRConst_F64i(ULong f64i)
 {
-   IRConst* c  = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c  = mallocClone("IRConst", sizeof(IRConst));
    c->tag      = Ico_F64i;
    c->Ico.F64i = f64i;
    return c;
 }
 IRConst* mallocIRConst_V128(UShort con)
 {
-   IRConst* c  = VG_(malloc)("IRConst", sizeof(IRConst));
+   IRConst* c  = mallocClone("IRConst", sizeof(IRConst));
    c->tag      = Ico_V128;
    c->Ico.V128 = con;
    return c;
@@ -93,7 +280,7 @@ IRConst* mallocIRConst_V128(UShort con)
 
 IRCallee* mallocIRCallee(Int regparms, const HChar* name, void* addr)
 {
-   IRCallee* ce = VG_(malloc)("IRCallee", sizeof(IRCallee));
+   IRCallee* ce = mallocClone("IRCallee", sizeof(IRCallee));
    ce->regparms = regparms;
    ce->name     = name;
    ce->addr     = addr;
@@ -103,7 +290,7 @@ IRCallee* mallocIRCallee(Int regparms, const HChar* name, void* addr)
 
 IRRegArray* mallocIRRegArray(Int base, IRType elemTy, Int nElems)
 {
-   IRRegArray* arr = VG_(malloc)("IRRegArray", sizeof(IRRegArray));
+   IRRegArray* arr = mallocClone("IRRegArray", sizeof(IRRegArray));
    arr->base       = base;
    arr->elemTy     = elemTy;
    arr->nElems     = nElems;
@@ -111,20 +298,20 @@ IRRegArray* mallocIRRegArray(Int base, IRType elemTy, Int nElems)
 }
 
 IRExpr* mallocIRExpr_Binder(Int binder) {
-   IRExpr* e            = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e            = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag               = Iex_Binder;
    e->Iex.Binder.binder = binder;
    return e;
 }
 IRExpr* mallocIRExpr_Get(Int off, IRType ty) {
-   IRExpr* e         = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e         = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag            = Iex_Get;
    e->Iex.Get.offset = off;
    e->Iex.Get.ty     = ty;
    return e;
 }
 IRExpr* mallocIRExpr_GetI(IRRegArray* descr, IRExpr* ix, Int bias) {
-   IRExpr* e         = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e         = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag            = Iex_GetI;
    e->Iex.GetI.descr = descr;
    e->Iex.GetI.ix    = ix;
@@ -132,16 +319,16 @@ IRExpr* mallocIRExpr_GetI(IRRegArray* descr, IRExpr* ix, Int bias) {
    return e;
 }
 IRExpr* mallocIRExpr_RdTmp(IRTemp tmp) {
-   IRExpr* e        = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e        = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag           = Iex_RdTmp;
    e->Iex.RdTmp.tmp = tmp;
    return e;
 }
 IRExpr* mallocIRExpr_Qop(IROp op, IRExpr* arg1, IRExpr* arg2, 
                               IRExpr* arg3, IRExpr* arg4) {
-   IRExpr* e       = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e       = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag          = Iex_Qop;
-   IRQop *details  = VG_(malloc)("IRQop", sizeof(IRQop));
+   IRQop *details  = mallocClone("IRQop", sizeof(IRQop));
    e->Iex.Qop.details       = details;
    e->Iex.Qop.details->op   = op;
    e->Iex.Qop.details->arg1 = arg1;
@@ -152,9 +339,9 @@ IRExpr* mallocIRExpr_Qop(IROp op, IRExpr* arg1, IRExpr* arg2,
 }
 IRExpr* mallocIRExpr_Triop (IROp op, IRExpr* arg1, 
                                  IRExpr* arg2, IRExpr* arg3) {
-   IRExpr* e         = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e         = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag            = Iex_Triop;
-   IRTriop *details  = VG_(malloc)("IRTriop", sizeof(IRTriop));
+   IRTriop *details  = mallocClone("IRTriop", sizeof(IRTriop));
    e->Iex.Triop.details       = details;
    e->Iex.Triop.details->op   = op;
    e->Iex.Triop.details->arg1 = arg1;
@@ -163,7 +350,7 @@ IRExpr* mallocIRExpr_Triop (IROp op, IRExpr* arg1,
    return e;
 }
 IRExpr* mallocIRExpr_Binop(IROp op, IRExpr* arg1, IRExpr* arg2) {
-   IRExpr* e         = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e         = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag            = Iex_Binop;
    e->Iex.Binop.op   = op;
    e->Iex.Binop.arg1 = arg1;
@@ -171,14 +358,14 @@ IRExpr* mallocIRExpr_Binop(IROp op, IRExpr* arg1, IRExpr* arg2) {
    return e;
 }
 IRExpr* mallocIRExpr_Unop(IROp op, IRExpr* arg) {
-   IRExpr* e       = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e       = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag          = Iex_Unop;
    e->Iex.Unop.op  = op;
    e->Iex.Unop.arg = arg;
    return e;
 }
 IRExpr* mallocIRExpr_Load(IREndness end, IRType ty, IRExpr* addr) {
-   IRExpr* e        = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e        = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag           = Iex_Load;
    e->Iex.Load.end  = end;
    e->Iex.Load.ty   = ty;
@@ -186,13 +373,13 @@ IRExpr* mallocIRExpr_Load(IREndness end, IRType ty, IRExpr* addr) {
    return e;
 }
 IRExpr* mallocIRExpr_Const(IRConst* con) {
-   IRExpr* e        = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e        = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag           = Iex_Const;
    e->Iex.Const.con = con;
    return e;
 }
 IRExpr* mallocIRExpr_CCall(IRCallee* cee, IRType retty, IRExpr** args) {
-   IRExpr* e          = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e          = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag             = Iex_CCall;
    e->Iex.CCall.cee   = cee;
    e->Iex.CCall.retty = retty;
@@ -200,7 +387,7 @@ IRExpr* mallocIRExpr_CCall(IRCallee* cee, IRType retty, IRExpr** args) {
    return e;
 }
 IRExpr* mallocIRExpr_ITE(IRExpr* cond, IRExpr* iftrue, IRExpr* iffalse) {
-   IRExpr* e          = VG_(malloc)("IRExpr", sizeof(IRExpr));
+   IRExpr* e          = mallocClone("IRExpr", sizeof(IRExpr));
    e->tag             = Iex_ITE;
    e->Iex.ITE.cond  = cond;
    e->Iex.ITE.iftrue = iftrue;
@@ -209,7 +396,7 @@ IRExpr* mallocIRExpr_ITE(IRExpr* cond, IRExpr* iftrue, IRExpr* iffalse) {
 }
 
 IRDirty* mallocEmptyIRDirty(void) {
-   IRDirty* d = VG_(malloc)("IRExpr", sizeof(IRDirty));
+   IRDirty* d = mallocClone("IRExpr", sizeof(IRDirty));
    d->cee      = NULL;
    d->guard    = NULL;
    d->args     = NULL;
@@ -231,14 +418,14 @@ IRStmt* mallocIRStmt_NoOp(void)
    return &static_closure;
 }
 IRStmt* mallocIRStmt_IMark(Addr64 addr, Int len) {
-   IRStmt* s         = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s         = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag            = Ist_IMark;
    s->Ist.IMark.addr = addr;
    s->Ist.IMark.len  = len;
    return s;
 }
 IRStmt* mallocIRStmt_AbiHint(IRExpr* base, Int len, IRExpr* nia) {
-   IRStmt* s           = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s           = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag              = Ist_AbiHint;
    s->Ist.AbiHint.base = base;
    s->Ist.AbiHint.len  = len;
@@ -246,7 +433,7 @@ IRStmt* mallocIRStmt_AbiHint(IRExpr* base, Int len, IRExpr* nia) {
    return s;
 }
 IRStmt* mallocIRStmt_Put(Int off, IRExpr* data) {
-   IRStmt* s         = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s         = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag            = Ist_Put;
    s->Ist.Put.offset = off;
    s->Ist.Put.data   = data;
@@ -254,9 +441,9 @@ IRStmt* mallocIRStmt_Put(Int off, IRExpr* data) {
 }
 IRStmt* mallocIRStmt_PutI(IRRegArray* descr, IRExpr* ix,
                       Int bias, IRExpr* data) {
-   IRStmt* s         = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s         = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag            = Ist_PutI;
-   IRPutI *details   = VG_(malloc)("IRPutI", sizeof(IRPutI));
+   IRPutI *details   = mallocClone("IRPutI", sizeof(IRPutI));
    s->Ist.PutI.details        = details;
    s->Ist.PutI.details->descr = descr;
    s->Ist.PutI.details->ix    = ix;
@@ -265,14 +452,14 @@ IRStmt* mallocIRStmt_PutI(IRRegArray* descr, IRExpr* ix,
    return s;
 }
 IRStmt* mallocIRStmt_WrTmp(IRTemp tmp, IRExpr* data) {
-   IRStmt* s         = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s         = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag            = Ist_WrTmp;
    s->Ist.WrTmp.tmp  = tmp;
    s->Ist.WrTmp.data = data;
    return s;
 }
 IRStmt* mallocIRStmt_Store(IREndness end, IRExpr* addr, IRExpr* data) {
-   IRStmt* s         = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s         = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag            = Ist_Store;
    s->Ist.Store.end  = end;
    s->Ist.Store.addr = addr;
@@ -281,20 +468,20 @@ IRStmt* mallocIRStmt_Store(IREndness end, IRExpr* addr, IRExpr* data) {
 }
 IRStmt* mallocIRStmt_Dirty(IRDirty* d)
 {
-   IRStmt* s            = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s            = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag               = Ist_Dirty;
    s->Ist.Dirty.details = d;
    return s;
 }
 IRStmt* mallocIRStmt_MBE(IRMBusEvent event)
 {
-   IRStmt* s        = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s        = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag           = Ist_MBE;
    s->Ist.MBE.event = event;
    return s;
 }
 IRStmt* mallocIRStmt_Exit(IRExpr* guard, IRJumpKind jk, IRConst* dst) {
-   IRStmt* s         = VG_(malloc)("IRStmt", sizeof(IRStmt));
+   IRStmt* s         = mallocClone("IRStmt", sizeof(IRStmt));
    s->tag            = Ist_Exit;
    s->Ist.Exit.guard = guard;
    s->Ist.Exit.jk    = jk;
@@ -308,7 +495,7 @@ IRExpr** shallowMallocIRExprVec(IRExpr** vec)
    IRExpr** newvec;
    for (i = 0; vec[i]; i++)
       ;
-   newvec = VG_(malloc)("IRExprVec", (i+1)*sizeof(IRExpr*));
+   newvec = mallocClone("IRExprVec", (i+1)*sizeof(IRExpr*));
    for (i = 0; vec[i]; i++)
       newvec[i] = vec[i];
    newvec[i] = NULL;
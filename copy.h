@@ -40,6 +40,17 @@
 #include "pub_tool_libcfile.h"
 #include "pub_tool_vki.h"
 
+/* Clones are allocated from a per-translation arena while one is open
+   (between beginCloneArena and endCloneArena), and freed together
+   when the translation is discarded. */
+void beginCloneArena(Addr64 nraddr, Addr64 base);
+void endCloneArena(void);
+void discardCloneArena(Addr64 nraddr, Addr64 base);
+void releaseCloneArenas(void);
+void* mallocClone(const HChar* cc, SizeT n);
+void getCloneArenaStats(SizeT* live, SizeT* peak, ULong* total,
+                        ULong* made, ULong* freed);
+
 IRConst* mallocIRConst_U1(Bool bit);
 IRConst* mallocIRConst_U8(UChar u8);
 IRConst* mallocIRConst_U16(UShort u16);
@@ -39,6 +39,13 @@ typedef enum {
 #if _SECRETGRIND_
 	, VG_USERREQ__TAINTGRIND_TAINT_SUMMARY
 	, VG_USERREQ__TAINTGRIND_READ_TAINT_STATUS
+	// used by the libc models in tnt_wraps.c only
+	, VG_USERREQ__TAINTGRIND_MODEL_MEMMOVE
+	, VG_USERREQ__TAINTGRIND_MODEL_MEMSET
+	, VG_USERREQ__TAINTGRIND_MODEL_STRCPY
+	, VG_USERREQ__TAINTGRIND_MODEL_STRLEN
+	, VG_USERREQ__TAINTGRIND_MODEL_ENTER
+	, VG_USERREQ__TAINTGRIND_MODEL_EXIT
 #endif
 	
 } Vg_TaintGrindClientRequest;
@@ -133,5 +140,13 @@ typedef enum {
 #	define SG_READ_TAINT_STATE(text,addr,len) \
 		VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__TAINTGRIND_READ_TAINT_STATUS, text, addr, len, 0, 0)
 
+// a memory region passed to the model requests, see tnt_wraps.c and tnt_models.c
+typedef
+	struct {
+		const void		*addr;
+		unsigned long	len;
+	}
+	SG_region;
+
 #endif // _SECRETGRIND_
 #endif /* TAINTGRIND_H_ */
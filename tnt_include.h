@@ -114,12 +114,9 @@ VG_REGPARM(3) void TNT_(h32_next_t)   ( IRExpr *, UInt, UInt );
 VG_REGPARM(3) void TNT_(h32_next_c)   ( IRExpr *, UInt, UInt );
 VG_REGPARM(3) void TNT_(h32_store_tt) ( IRStmt *, UInt, UInt );
 #if _SECRETGRIND_
-VG_REGPARM(3) void TNT_(h32_store_v128or256_tt) ( IRStmt *, ULong, ULong );
-VG_REGPARM(3) void TNT_(h32_store_v128or256_ct) ( IRStmt *, ULong, ULong );
-VG_REGPARM(3) void TNT_(h32_store_v128or256_tc) ( IRStmt *, ULong, ULong );
-VG_REGPARM(2) void TNT_(h32_store_v128or256_prepare_tt) (IRStmt *, UChar); 
-VG_REGPARM(2) void TNT_(h32_store_v128or256_prepare_ct) (IRStmt *, UChar);
-VG_REGPARM(2) void TNT_(h32_store_v128or256_prepare_tc) (IRStmt *, UChar);
+VG_REGPARM(3) void TNT_(h32_store_v128or256_tt) ( IRStmt *, UInt, UInt, UInt, UInt, UInt );
+VG_REGPARM(3) void TNT_(h32_store_v128or256_ct) ( IRStmt *, UInt, UInt, UInt, UInt, UInt );
+VG_REGPARM(3) void TNT_(h32_store_v128or256_tc) ( IRStmt *, UInt, UInt, UInt, UInt, UInt );
 #endif
 VG_REGPARM(3) void TNT_(h32_store_tc) ( IRStmt *, UInt, UInt );
 VG_REGPARM(3) void TNT_(h32_store_ct) ( IRStmt *, UInt, UInt );
@@ -156,13 +153,9 @@ VG_REGPARM(3) void TNT_(h64_next_t)   ( IRExpr *, ULong, ULong );
 VG_REGPARM(3) void TNT_(h64_next_c)   ( IRExpr *, ULong, ULong );
 VG_REGPARM(3) void TNT_(h64_store_tt) ( IRStmt *, ULong, ULong );
 #if _SECRETGRIND_
-VG_REGPARM(3) void TNT_(h64_store_v128or256_tt) ( IRStmt *, ULong, ULong );
-VG_REGPARM(3) void TNT_(h64_store_v128or256_ct) ( IRStmt *, ULong, ULong );
-VG_REGPARM(3) void TNT_(h64_store_v128or256_tc) ( IRStmt *, ULong, ULong );
-VG_REGPARM(2) void TNT_(h64_store_v128or256_prepare_tt) (IRStmt *, UChar); 
-VG_REGPARM(2) void TNT_(h64_store_v128or256_prepare_ct) (IRStmt *, UChar);
-VG_REGPARM(2) void TNT_(h64_store_v128or256_prepare_tc) (IRStmt *, UChar);
-
+VG_REGPARM(3) void TNT_(h64_store_v128or256_tt) ( IRStmt *, ULong, ULong, ULong, ULong, ULong );
+VG_REGPARM(3) void TNT_(h64_store_v128or256_ct) ( IRStmt *, ULong, ULong, ULong, ULong, ULong );
+VG_REGPARM(3) void TNT_(h64_store_v128or256_tc) ( IRStmt *, ULong, ULong, ULong, ULong, ULong );
 #endif
 VG_REGPARM(3) void TNT_(h64_store_tc) ( IRStmt *, ULong, ULong );
 VG_REGPARM(3) void TNT_(h64_store_ct) ( IRStmt *, ULong, ULong );
@@ -170,6 +163,7 @@ VG_REGPARM(3) void TNT_(h64_load_c)   ( IRStmt *, ULong, ULong );
 #if _SECRETGRIND_
 VG_REGPARM(3) void TNT_(h64_load_v128or256_t)	( IRStmt *, ULong, ULong );
 VG_REGPARM(1) void TNT_(hxx_imark_t) 			( IRStmt *);
+VG_REGPARM(0) void TNT_(hxx_main_summary)		( void );
 #endif
 VG_REGPARM(3) void TNT_(h64_load_t)   ( IRStmt *, ULong, ULong );
 VG_REGPARM(3) void TNT_(h64_get)      ( IRStmt *, ULong, ULong );
@@ -208,6 +202,10 @@ extern Int extract_IRConst( IRConst* con );
 extern ULong extract_IRConst64( IRConst* con );
 
 /* V-bits load/store helpers */
+VG_REGPARM(1) void TNT_(helperc_STOREV256be) ( Addr, ULong, ULong, ULong, ULong );
+VG_REGPARM(1) void TNT_(helperc_STOREV256le) ( Addr, ULong, ULong, ULong, ULong );
+VG_REGPARM(1) void TNT_(helperc_STOREV128be) ( Addr, ULong, ULong );
+VG_REGPARM(1) void TNT_(helperc_STOREV128le) ( Addr, ULong, ULong );
 VG_REGPARM(1) void TNT_(helperc_STOREV64be) ( Addr, ULong );
 VG_REGPARM(1) void TNT_(helperc_STOREV64le) ( Addr, ULong );
 VG_REGPARM(2) void TNT_(helperc_STOREV32be) ( Addr, UWord );
@@ -228,13 +226,40 @@ VG_REGPARM(1) UWord TNT_(helperc_LOADV16be)  ( Addr );
 VG_REGPARM(1) UWord TNT_(helperc_LOADV16le)  ( Addr );
 VG_REGPARM(1) UWord TNT_(helperc_LOADV8)     ( Addr );
 #if _SECRETGRIND_
-VG_REGPARM(1) UWord TNT_(helperc_LOADV8_extended) ( Addr a, UWord taint );
-VG_REGPARM(1) UWord TNT_(helperc_LOADV16le_extended) ( Addr a, UWord taint );
-VG_REGPARM(1) UWord TNT_(helperc_LOADV16be_extended) ( Addr a, UWord taint );
-VG_REGPARM(1) UWord TNT_(helperc_LOADV32le_extended) ( Addr a, UWord taint );
-VG_REGPARM(1) UWord TNT_(helperc_LOADV32be_extended) ( Addr a, UWord taint );
+VG_REGPARM(2) UWord TNT_(helperc_LOADV8_extended) ( Addr a, UWord taint );
+VG_REGPARM(2) UWord TNT_(helperc_LOADV16le_extended) ( Addr a, UWord taint );
+VG_REGPARM(2) UWord TNT_(helperc_LOADV16be_extended) ( Addr a, UWord taint );
+VG_REGPARM(2) UWord TNT_(helperc_LOADV32le_extended) ( Addr a, UWord taint );
+VG_REGPARM(2) UWord TNT_(helperc_LOADV32be_extended) ( Addr a, UWord taint );
 VG_REGPARM(1) ULong TNT_(helperc_LOADV64le_extended) ( Addr a, ULong taint );
 VG_REGPARM(1) ULong TNT_(helperc_LOADV64be_extended) ( Addr a, ULong taint );
+
+/* --inline-fast-path=yes: what the inline IR does not handle */
+VG_REGPARM(1) ULong TNT_(helperc_LOADV64be_slow) ( Addr );
+VG_REGPARM(1) ULong TNT_(helperc_LOADV64le_slow) ( Addr );
+VG_REGPARM(1) UWord TNT_(helperc_LOADV32be_slow) ( Addr );
+VG_REGPARM(1) UWord TNT_(helperc_LOADV32le_slow) ( Addr );
+VG_REGPARM(1) UWord TNT_(helperc_LOADV16be_slow) ( Addr );
+VG_REGPARM(1) UWord TNT_(helperc_LOADV16le_slow) ( Addr );
+VG_REGPARM(1) UWord TNT_(helperc_LOADV8_slow)    ( Addr );
+VG_REGPARM(1) void  TNT_(helperc_STOREV64be_slow) ( Addr, ULong );
+VG_REGPARM(1) void  TNT_(helperc_STOREV64le_slow) ( Addr, ULong );
+VG_REGPARM(2) void  TNT_(helperc_STOREV32be_slow) ( Addr, UWord );
+VG_REGPARM(2) void  TNT_(helperc_STOREV32le_slow) ( Addr, UWord );
+VG_REGPARM(2) void  TNT_(helperc_STOREV16be_slow) ( Addr, UWord );
+VG_REGPARM(2) void  TNT_(helperc_STOREV16le_slow) ( Addr, UWord );
+VG_REGPARM(2) void  TNT_(helperc_STOREV8_slow)    ( Addr, UWord );
+
+/* Where the inline fast path finds the shadow memory */
+typedef
+   struct {
+      Addr  primary_map;    /* &primary_map[0] */
+      UWord n_primary_map;  /* covers addresses below n_primary_map << 16 */
+      Addr  dist_sm_lo;     /* &sm_distinguished[0] */
+      Addr  dist_sm_hi;     /* &sm_distinguished[2] */
+   }
+   ShadowLayout;
+void TNT_(get_shadow_layout) ( ShadowLayout* sl );
 #endif
 void TNT_(helperc_MAKE_STACK_UNINIT) ( Addr base, UWord len,
                                                  Addr nia );
@@ -313,6 +338,15 @@ typedef
 #	define MAX_STACK_DESC_LEN	2048
 #	define MAX_FIX_IDS			10
 #	define MAX_FILE_FILTER		16
+#	define MAX_UNTAINTED_GUEST	16
+
+// a slice of the guest state, see --untainted-guest-state
+typedef
+	struct {
+		Int offset;
+		Int size;
+	}
+	GuestRange_t;
 
 typedef long ID_t;
 typedef 
@@ -387,12 +421,48 @@ Bool TNT_(mempool_exists)  ( Addr pool );
 TNT_Chunk* TNT_(get_freed_list_head)( void );
 #endif
 
+// Tmp variable indices (the MSB is the taint bit) and values of the running thread,
+// see H_WRTMP_BOOKKEEPING. Both have ti_max entries
+extern UInt  *ti;
+extern ULong *tv;
+extern UInt  ti_max;
+extern void TNT_(tmp_table_reserve)( UInt n );
+
+#if _SECRETGRIND_
+// --event-buffer=yes: the instrumented code records the per-statement helper
+// calls of a superblock here with plain stores, and TNT_(flush_events) makes
+// them in order at the superblock's exits. See emitBufferedDirty()
+#	define EVENT_BUF_SIZE	1024
+typedef
+	struct {
+		HWord	fn;			// helper to call, 0 if its guard was false
+		HWord	args[3];
+		HWord	pc;			// guest address of the instruction
+	}
+	Event_t;
+extern Event_t TNT_(events)[EVENT_BUF_SIZE];
+VG_REGPARM(1) void TNT_(flush_events) ( HWord n );
+
+// --tier-threshold=N, see TNT_(tier_node) in tnt_main.c
+extern Bool TNT_(tier_node) ( Addr64 addr, const VexGuestExtents *vge );
+VG_REGPARM(2) void TNT_(tier_taint_seen) ( HWord addr, HWord base );
+
+// --instr-stats, see tnt_translate.c
+extern void TNT_(print_instr_stats) ( void );
+extern void TNT_(instr_stats_release) ( void );
+
+// --shadow-opt=yes: counters of the clean-up pass run at the end of TNT_(instrument)
+extern void TNT_(get_shadow_opt_stats) ( ULong* folded, ULong* forwarded,
+                                         ULong* putsRemoved, ULong* tmpsRemoved );
+#endif
+
 extern void TNT_(stop_print)(void);
 extern void TNT_(start_print)(Bool all);
 
 #if _SECRETGRIND_
 #define RAW_ADDR_FMT "0x%lx"
 extern Bool TNT_(is_mem_byte_tainted)(Addr a);
+extern SizeT TNT_(count_tainted_bytes)(Addr a, SizeT len);
 extern ExeContext * TNT_(retrieveExeContext)(void);
 extern Bool TNT_(clo_verbose);
 extern Bool TNT_(clo_mnemonics);
@@ -409,6 +479,22 @@ extern Bool TNT_(mnemoReady);
 extern Bool TNT_(clo_taint_df_only);
 extern Bool TNT_(clo_taint_remove_on_release);
 extern Bool TNT_(clo_batchmode);
+extern Bool TNT_(instr_summary_only);
+extern Bool TNT_(instr_guard_helpers);
+extern Bool TNT_(clo_lazy_instrument);
+extern Bool TNT_(instr_lazy_pending);
+extern Bool TNT_(clo_inline_fast_path);
+extern Bool TNT_(clo_shadow_compact);
+extern Bool TNT_(clo_taint_labels);
+extern Bool TNT_(clo_event_buffer);
+extern Bool TNT_(clo_shadow_opt);
+extern UInt TNT_(clo_tier_threshold);
+extern Bool TNT_(clo_fast_precision);
+extern UInt TNT_(clo_instr_stats);
+extern Bool TNT_(clo_static_untainted);
+extern Bool TNT_(clo_libc_models);
+extern GuestRange_t TNT_(clo_untainted_guest)[MAX_UNTAINTED_GUEST];
+extern UInt TNT_(clo_n_untainted_guest);
 extern Bool TNT_(clo_summary);
 extern Bool TNT_(clo_summary_verbose);
 extern Bool TNT_(clo_summary_exit_only);
@@ -0,0 +1,81 @@
+#include "secretgrind.h"
+#include "tnt_include.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_debuginfo.h"
+#include "tnt_libc.h"
+#include "tnt_instr_filter.h"
+
+#if _SECRETGRIND_
+
+/* --instrument-objs= and --instrument-fns=: superblocks outside these only get
+   shadow propagation, no per-statement helpers. Entries are VG_(string_match)
+   patterns, eg "*libcrypto.so*" or "EVP_*" */
+
+#define MAX_INSTR_FILTER	16
+
+typedef struct {
+	HChar list[MAX_INSTR_FILTER][MAX_PATH];
+	SizeT len;
+} filter_t;
+
+static filter_t TNT_(clo_instr_objs) = {};
+static filter_t TNT_(clo_instr_fns) = {};
+
+static void filter_add( filter_t *f, const HChar *s, const HChar *optname ) {
+	if ( f->len >= LEN(f->list) ) {
+		VG_(printf)("*** Too many entries for %s (max %lu)\n", optname, LEN(f->list));
+		VG_(exit)(1);
+	}
+	libc_strlcpy( f->list[f->len], s, sizeof(f->list[f->len]) );
+	f->len++;
+}
+
+static Bool filter_match( filter_t *f, const HChar *s ) {
+	SizeT i=0;
+	for ( i=0; i<f->len ; ++i) { 
+		if ( VG_(string_match)(f->list[i], s) ) { return True; }
+	}
+	return False;
+}
+
+Bool TNT_(instr_filter_present)() { return TNT_(clo_instr_objs).len>0 || TNT_(clo_instr_fns).len>0; }
+
+void TNT_(instr_filter_add_obj)( const HChar *s ) { filter_add( &TNT_(clo_instr_objs), s, "--instrument-objs" ); }
+
+void TNT_(instr_filter_add_fn)( const HChar *s ) { filter_add( &TNT_(clo_instr_fns), s, "--instrument-fns" ); }
+
+// is this address inside the selected objects/functions?
+static Bool addr_match( Addr a ) {
+	HChar name[MAX_PATH];
+	const HChar *base = 0;
+	
+	if ( TNT_(clo_instr_objs).len && VG_(get_objname)(a, name, sizeof(name)) ) {
+		// full path or basename
+		if ( filter_match( &TNT_(clo_instr_objs), name ) ) { return True; }
+		base = VG_(strrchr)( name, '/' );
+		if ( base && filter_match( &TNT_(clo_instr_objs), base+1 ) ) { return True; }
+	}
+	
+	if ( TNT_(clo_instr_fns).len && VG_(get_fnname)(a, name, sizeof(name)) ) {
+		if ( filter_match( &TNT_(clo_instr_fns), name ) ) { return True; }
+	}
+	
+	return False;
+}
+
+// called once per superblock at translation time. A superblock may chase into several functions:
+// if any of its extents is selected, the whole superblock is
+Bool TNT_(instr_filter_match)( VexGuestExtents* vge ) {
+	UShort i=0;
+	
+	if ( !TNT_(instr_filter_present)() ) { return True; }
+	
+	for ( i=0; i<vge->n_used; ++i ) {
+		if ( addr_match( (Addr)vge->base[i] ) ) { return True; }
+	}
+	return False;
+}
+
+#endif // _SECRETGRIND_
@@ -0,0 +1,11 @@
+#ifndef __TNT_INSTR_FILTER_H
+#define __TNT_INSTR_FILTER_H
+
+#include "pub_tool_tooliface.h"	// VexGuestExtents
+
+extern Bool TNT_(instr_filter_present)(void);
+extern void TNT_(instr_filter_add_obj)( const HChar *s );
+extern void TNT_(instr_filter_add_fn)( const HChar *s );
+extern Bool TNT_(instr_filter_match)( VexGuestExtents* vge );
+
+#endif	//	__TNT_INSTR_FILTER_H
@@ -0,0 +1,260 @@
+#include "tnt_include.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_threadstate.h"
+#include "tnt_libc.h"
+#include "tnt_labels.h"
+
+#if _SECRETGRIND_
+
+/* --taint-labels=yes: remember which source each tainted byte came from.
+   Sources are file names (read(), pread(), mmap()), "stdin" and "API call"
+   (TNT_MAKE_MEM_TAINTED); each gets one bit of a Label_t, the last one is
+   shared by all the sources that do not fit.
+
+   Labels are kept per 8-byte granule, in 64k chunks hashed by address.
+   A missing chunk has no labels, and a chunk whose granules all have the
+   same labels (eg a whole tainted mmap'ed file) has no map either -- the
+   same trick as the distinguished SecMaps.
+
+   Memory-to-memory copies (realloc, the libc and crypto models) carry
+   labels exactly. Values that go through registers are not shadowed: a
+   tainted store gets the labels of the tainted loads since the previous
+   tainted store of the thread, or the labels of that store if there were
+   none. The taint itself stays exact; only the attribution is approximate. */
+
+#define MAX_LABELS			(8*sizeof(Label_t))
+#define LABEL_OTHER			(MAX_LABELS-1)
+
+#define LABEL_CHUNK_BITS	16
+#define LABEL_CHUNK_SIZE	(1UL << LABEL_CHUNK_BITS)
+#define LABEL_GRANULE		8
+#define LABEL_GRANULES		(LABEL_CHUNK_SIZE / LABEL_GRANULE)
+#define LABEL_IDX(a)		(((a) & (LABEL_CHUNK_SIZE-1)) / LABEL_GRANULE)
+
+static HChar label_names[MAX_LABELS][MAX_PATH];
+static UInt n_labels = 0;
+
+typedef
+	struct _LabelChunk_t {
+		struct _LabelChunk_t	*next;		// VgHashNode
+		UWord					key;		// address >> LABEL_CHUNK_BITS
+		Label_t					uniform;	// labels of every granule while map is NULL
+		Label_t					*map;		// LABEL_GRANULES entries
+	}
+	LabelChunk_t;
+
+static VgHashTable TNT_(label_chunks) = NULL;
+static LabelChunk_t *label_cache = NULL;	// last chunk looked up
+
+static struct {
+	Label_t pending;	// tainted loads since the last tainted store
+	Label_t last;		// labels of the last tainted store
+} label_flow[VG_N_THREADS];
+
+static ULong n_label_chunks = 0;
+static ULong n_label_maps = 0;
+
+Label_t TNT_(label_for)( const HChar *source ) {
+	UInt i;
+	for ( i=0; i<n_labels; ++i ) {
+		if ( VG_(strcmp)( label_names[i], source ) == 0 ) { return 1 << i; }
+	}
+	if ( n_labels == LABEL_OTHER ) {
+		libc_strlcpy( label_names[n_labels++], "(other sources)", sizeof(label_names[0]) );
+	}
+	if ( n_labels > LABEL_OTHER ) { return 1 << LABEL_OTHER; }
+	libc_strlcpy( label_names[n_labels], source, sizeof(label_names[0]) );
+	return 1 << n_labels++;
+}
+
+static LabelChunk_t *get_chunk( Addr a, Bool create ) {
+	UWord key = a >> LABEL_CHUNK_BITS;
+	LabelChunk_t *c;
+
+	if ( label_cache && label_cache->key == key ) { return label_cache; }
+	if ( !TNT_(label_chunks) ) {
+		if ( !create ) { return NULL; }
+		TNT_(label_chunks) = VG_(HT_construct)( "tnt.label_chunks" );
+	}
+
+	c = VG_(HT_lookup)( TNT_(label_chunks), key );
+	if ( !c && create ) {
+		c = VG_(malloc)( "tnt.get_chunk.1", sizeof(LabelChunk_t) );
+		c->key = key;
+		c->uniform = 0;
+		c->map = NULL;
+		VG_(HT_add_node)( TNT_(label_chunks), c );
+		++n_label_chunks;
+	}
+	if ( c ) { label_cache = c; }
+	return c;
+}
+
+static Label_t *chunk_map( LabelChunk_t *c ) {
+	if ( !c->map ) {
+		c->map = VG_(malloc)( "tnt.chunk_map.1", LABEL_GRANULES * sizeof(Label_t) );
+		VG_(memset)( c->map, c->uniform, LABEL_GRANULES * sizeof(Label_t) );
+		++n_label_maps;
+	}
+	return c->map;
+}
+
+// granules entirely in [a, a+len) get labels, the ones it only overlaps get them added
+static void labels_set( Addr a, SizeT len, Label_t labels ) {
+	Addr end = a + len;
+
+	while ( a < end ) {
+		Addr base = VG_ROUNDDN( a, LABEL_CHUNK_SIZE );
+		Addr stop = end - base < LABEL_CHUNK_SIZE ? end : base + LABEL_CHUNK_SIZE;
+		LabelChunk_t *c = get_chunk( a, labels != 0 );
+
+		if ( c && a == base && stop - base == LABEL_CHUNK_SIZE ) {
+			if ( c->map ) { VG_(free)( c->map ); c->map = NULL; }
+			c->uniform = labels;
+
+		} else if ( c && ( c->map || c->uniform != labels ) ) {
+			Label_t *map = chunk_map( c );
+			Addr g;
+			for ( g = a; g < stop; g = VG_ROUNDDN( g, LABEL_GRANULE ) + LABEL_GRANULE ) {
+				if ( VG_IS_8_ALIGNED( g ) && stop - g >= LABEL_GRANULE )	{ map[LABEL_IDX(g)] = labels; }
+				else 														{ map[LABEL_IDX(g)] |= labels; }
+			}
+		}
+		a = stop;
+	}
+}
+
+Label_t TNT_(labels_get)( Addr a, SizeT len ) {
+	Label_t labels = 0;
+	Addr g, end = a + len;
+
+	if ( !TNT_(label_chunks) ) { return 0; }
+
+	for ( g = VG_ROUNDDN( a, LABEL_GRANULE ); g < end; g += LABEL_GRANULE ) {
+		LabelChunk_t *c = get_chunk( g, False );
+		if ( !c || !c->map ) {
+			// the rest of the chunk has the same labels
+			if ( c ) { labels |= c->uniform; }
+			g = VG_ROUNDDN( g, LABEL_CHUNK_SIZE ) + LABEL_CHUNK_SIZE - LABEL_GRANULE;
+			continue;
+		}
+		labels |= c->map[LABEL_IDX(g)];
+	}
+	return labels;
+}
+
+void TNT_(labels_taint)( Addr a, SizeT len, Label_t labels ) {
+	labels_set( a, len, labels );
+}
+
+// see TNT_(copy_address_range_state)()
+void TNT_(labels_copy)( Addr src, Addr dst, SizeT len ) {
+	SizeT off, n;
+
+	if ( !TNT_(label_chunks) || !len || src == dst ) { return; }
+
+	if ( dst < src ) {
+		for ( off = 0; off < len; off += n ) {
+			n = len - off < LABEL_GRANULE ? len - off : LABEL_GRANULE;
+			labels_set( dst + off, n, TNT_(labels_get)( src + off, n ) );
+		}
+	} else {
+		for ( off = len; off > 0; off -= n ) {
+			n = off < LABEL_GRANULE ? off : LABEL_GRANULE;
+			labels_set( dst + off - n, n, TNT_(labels_get)( src + off - n, n ) );
+		}
+	}
+}
+
+void TNT_(labels_load)( Addr a, SizeT szB ) {
+	label_flow[VG_(get_running_tid)()].pending |= TNT_(labels_get)( a, szB );
+}
+
+void TNT_(labels_store)( Addr a, SizeT szB ) {
+	ThreadId tid = VG_(get_running_tid)();
+	if ( label_flow[tid].pending ) {
+		label_flow[tid].last = label_flow[tid].pending;
+		label_flow[tid].pending = 0;
+	}
+	labels_set( a, szB, label_flow[tid].last );
+}
+
+static void print_labels( Label_t labels ) {
+	UInt i;
+	const HChar *sep = "";
+	for ( i=0; i<n_labels; ++i ) {
+		if ( labels & (1 << i) ) { VG_(printf)( "%s%s", sep, label_names[i] ); sep = ", "; }
+	}
+}
+
+void TNT_(labels_print_range)( Addr a, SizeT len ) {
+	Label_t labels = TNT_(labels_get)( a, len );
+	VG_(printf)( "\t from: " );
+	if ( labels )	{ print_labels( labels ); }
+	else 			{ VG_(printf)( "unknown source" ); }
+	VG_(printf)( "\n" );
+}
+
+// a byte derived from several sources counts for each of them
+void TNT_(labels_print_summary)( void ) {
+	ULong bytes[MAX_LABELS];
+	LabelChunk_t *c;
+	UInt i;
+
+	if ( !TNT_(label_chunks) ) { return; }
+	VG_(memset)( bytes, 0, sizeof(bytes) );
+
+	VG_(HT_ResetIter)( TNT_(label_chunks) );
+	while ( (c = VG_(HT_Next)( TNT_(label_chunks) )) ) {
+		Addr base = c->key << LABEL_CHUNK_BITS;
+		UWord g;
+
+		if ( !c->map ) {
+			SizeT n = c->uniform ? TNT_(count_tainted_bytes)( base, LABEL_CHUNK_SIZE ) : 0;
+			for ( i=0; i<n_labels; ++i ) {
+				if ( c->uniform & (1 << i) ) { bytes[i] += n; }
+			}
+			continue;
+		}
+
+		for ( g=0; g<LABEL_GRANULES; ++g ) {
+			SizeT n;
+			if ( !c->map[g] ) { continue; }
+			n = TNT_(count_tainted_bytes)( base + g*LABEL_GRANULE, LABEL_GRANULE );
+			for ( i=0; i<n_labels; ++i ) {
+				if ( c->map[g] & (1 << i) ) { bytes[i] += n; }
+			}
+		}
+	}
+
+	VG_(printf)( "\nTainted bytes per source:\n" );
+	for ( i=0; i<n_labels; ++i ) {
+		VG_(printf)( "\t%llu\t%s\n", bytes[i], label_names[i] );
+	}
+}
+
+void TNT_(labels_print_stats)( void ) {
+	if ( !TNT_(clo_taint_labels) ) { return; }
+	VG_(message)(Vg_DebugMsg,
+		" tnt: labels: %u sources, %llu chunks, %llu maps (%lluk)\n",
+		n_labels, n_label_chunks, n_label_maps, n_label_maps * LABEL_GRANULES * sizeof(Label_t) / 1024ULL );
+}
+
+void TNT_(labels_release)( void ) {
+	LabelChunk_t *c;
+
+	if ( !TNT_(label_chunks) ) { return; }
+	VG_(HT_ResetIter)( TNT_(label_chunks) );
+	while ( (c = VG_(HT_Next)( TNT_(label_chunks) )) ) {
+		if ( c->map ) { VG_(free)( c->map ); }
+	}
+	VG_(HT_destruct)( TNT_(label_chunks), VG_(free) );
+	TNT_(label_chunks) = NULL;
+	label_cache = NULL;
+}
+
+#endif // _SECRETGRIND_
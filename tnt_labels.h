@@ -0,0 +1,31 @@
+#ifndef __TNT_LABELS_H
+#define __TNT_LABELS_H
+
+#include "pub_tool_basics.h"
+
+// a set of sources, one bit each. 0 means unknown source
+typedef UChar Label_t;
+
+extern Label_t TNT_(label_for)( const HChar *source );
+extern void TNT_(labels_taint)( Addr a, SizeT len, Label_t labels );
+extern void TNT_(labels_copy)( Addr src, Addr dst, SizeT len );
+extern Label_t TNT_(labels_get)( Addr a, SizeT len );
+extern void TNT_(labels_load)( Addr a, SizeT szB );
+extern void TNT_(labels_store)( Addr a, SizeT szB );
+extern void TNT_(labels_print_range)( Addr a, SizeT len );
+extern void TNT_(labels_print_summary)( void );
+extern void TNT_(labels_print_stats)( void );
+extern void TNT_(labels_release)( void );
+
+#if _SECRETGRIND_
+// hooks for the load/store helpers in tnt_main.c: vbits are those of the szB bytes accessed
+#define LABELS_ON_LOAD(a, szB, vbits) \
+	do { if ( UNLIKELY( TNT_(clo_taint_labels) && (vbits) ) ) { TNT_(labels_load)( (a), (szB) ); } } while (0)
+#define LABELS_ON_STORE(a, szB, vbits) \
+	do { if ( UNLIKELY( TNT_(clo_taint_labels) && (vbits) ) ) { TNT_(labels_store)( (a), (szB) ); } } while (0)
+#else
+#define LABELS_ON_LOAD(a, szB, vbits)	do {} while (0)
+#define LABELS_ON_STORE(a, szB, vbits)	do {} while (0)
+#endif
+
+#endif	//	__TNT_LABELS_H
@@ -45,6 +45,7 @@
 #include "pub_tool_stacktrace.h"    // VG_(get_and_pp_StackTrace)
 #include "pub_tool_libcfile.h"      // VG_(readlink)
 #include "pub_tool_addrinfo.h"      // VG_(describe_addr)
+#include "pub_tool_transtab.h"      // VG_(discard_translations)
 
 #include "tnt_include.h"
 #include "tnt_strings.h"
@@ -55,6 +56,8 @@
 #include "tnt_syswrap.h"
 #include "tnt_asm.h"
 #include "tnt_mmap.h"
+#include "tnt_labels.h"
+#include "copy.h"                   // clone arenas
 
 
 /*------------------------------------------------------------*/
@@ -85,9 +88,8 @@
 
 #else
 
-/* Just handle the first 32G fast and the rest via auxiliary
-   primaries.  If you change this, Memcheck will assert at startup.
-   See the definition of UNALIGNED_OR_HIGH for extensive comments. */
+/* Map the first 32G directly and the rest via the auxiliary
+   primary map, see auxmap_top. */
 #  define N_PRIMARY_BITS  19
 
 #endif
@@ -126,6 +128,23 @@
 #define SM_OFF(aaa)           (((aaa) & 0xffff) >> 2)
 #define SM_OFF_16(aaa)        (((aaa) & 0xffff) >> 3)
 
+// --shadow-format=compact: one taint bit per byte of memory, so a SecMap
+// only uses the first SM_CHUNKS_C bytes of vabits8[] and the non-distinguished
+// ones are allocated that size (see SM_BYTES). There is no NOACCESS, and no
+// PARTUNTAINTED either: a partially tainted byte is stored as tainted, so the
+// sec-V-bit table is not used.
+#define TA_BITS1_TAINTED      0x1
+#define TA_BITS1_UNTAINTED    0x0
+
+// These represent 64 bits of memory.
+#define TA_BITS8_TAINTED      0xff
+#define TA_BITS8_UNTAINTED    0x00
+
+#define SM_CHUNKS_C           8192
+#define SM_OFF_C(aaa)         (((aaa) & 0xffff) >> 3)
+#define SM_SHIFT_C(aaa)       ((aaa) & 7)
+#define SM_BYTES              ( TNT_(clo_shadow_compact) ? SM_CHUNKS_C : sizeof(SecMap) )
+
 // Paranoia:  it's critical for performance that the requested inlining
 // occurs.  So try extra hard.
 #define INLINE    inline __attribute__((always_inline))
@@ -182,65 +201,8 @@ static Bool TNT_(is_stack)(Addr a);
 static Bool TNT_(is_global)(Addr a);
 static SizeT TNT_(size_of_load)(IRType ty, SizeT n);
 static void TNT_(format_mnemonics_and_id)(Inst_t *ins, char *out, SizeT olen);
-
-typedef union {
-	// for store_tc, ie STORE tmp = c
-	struct {
-		ULong c;
-		UInt atmp;
-		UChar offset;
-	} tc;
-	
-	// for store_ct, ie STORE c = tmp
-	struct {
-		ULong c;
-		UInt dtmp;
-		UChar offset;
-	} ct;
-	
-	// for store_tt, ie STORE dtmp = atmp
-	struct {
-		UInt atmp;
-		UInt dtmp;
-		UChar offset;
-	} tt;
-	
-} _H64_prepare_st;
-
-static _H64_prepare_st GH64_prepare_xx = {};
-
-static void TNT_(h64_reset_prepare_struct)(_H64_prepare_st *st) {
-	VG_(memset)(st, 0, sizeof(_H64_prepare_st));
-}
-typedef union {
-	// for store_tc, ie STORE tmp = c
-	struct {
-		UInt c;
-		UInt atmp;
-		UChar offset;
-	} tc;
-	
-	// for store_ct, ie STORE c = tmp
-	struct {
-		UInt c;
-		UInt dtmp;
-		UChar offset;
-	} ct;
-	
-	// for store_tt, ie STORE dtmp = atmp
-	struct {
-		UInt atmp;
-		UInt dtmp;
-		UChar offset;
-	} tt;
-	
-} _H32_prepare_st;
-
-static _H32_prepare_st GH32_prepare_xx = {};
-
-static void TNT_(h32_reset_prepare_struct)(_H32_prepare_st *st) {
-	VG_(memset)(st, 0, sizeof(_H32_prepare_st));
-}
+static void TNT_(end_lazy_instrument)(const HChar *reason);
+static void TNT_(tier_promote_pending)(void);
 
 #endif
 
@@ -254,11 +216,11 @@ static SecMap* copy_for_writing ( SecMap* dist_sm )
           || dist_sm == &sm_distinguished[1]
           || dist_sm == &sm_distinguished[2]);
 
-   new_sm = VG_(am_shadow_alloc)(sizeof(SecMap));
+   new_sm = VG_(am_shadow_alloc)(SM_BYTES);
    if (new_sm == NULL)
       VG_(out_of_memory_NORETURN)( "memcheck:allocate new SecMap",
-                                   sizeof(SecMap) );
-   VG_(memcpy)(new_sm, dist_sm, sizeof(SecMap));
+                                   SM_BYTES );
+   VG_(memcpy)(new_sm, dist_sm, SM_BYTES);
    update_SM_counts(dist_sm, new_sm);
    return new_sm;
 }
@@ -276,19 +238,23 @@ static Int   max_undefined_SMs = 0;
 static Int   max_defined_SMs   = 0;
 static Int   max_non_DSM_SMs   = 0;
 
-/* # searches initiated in auxmap_L1, and # base cmps required */
-static ULong n_auxmap_L1_searches  = 0;
-static ULong n_auxmap_L1_cmps      = 0;
-/* # of searches that missed in auxmap_L1 and therefore had to
-   be handed to auxmap_L2. And the number of nodes inserted. */
-static ULong n_auxmap_L2_searches  = 0;
-static ULong n_auxmap_L2_nodes     = 0;
+/* # of radix leaves allocated in the auxmap, and # of nodes inserted
+   in its overflow OSet. */
+static ULong n_auxmap_leaves         = 0;
+static ULong n_auxmap_overflow_nodes = 0;
+
+/* # of reclamation passes over all the secmaps, and # of private
+   secmaps they and TNT_(make_mem_untainted) gave back. */
+static ULong n_reclaim_passes      = 0;
+static ULong n_reclaimed_SMs       = 0;
 
 //static Int   n_sanity_cheap     = 0;
 //static Int   n_sanity_expensive = 0;
 
-static Int   n_secVBit_nodes   = 0;
-static Int   max_secVBit_nodes = 0;
+static Int   n_secVBit_maps    = 0;
+static Int   max_secVBit_maps  = 0;
+static ULong secVBit_bytes     = 0;
+static ULong max_secVBit_bytes = 0;
 
 static void update_SM_counts(SecMap* oldSM, SecMap* newSM)
 {
@@ -319,11 +285,43 @@ static void update_SM_counts(SecMap* oldSM, SecMap* newSM)
 */
 static SecMap* primary_map[N_PRIMARY_MAP];
 
-/* An entry in the auxiliary primary map.  base must be a 64k-aligned
-   value, and sm points at the relevant secondary map.  As with the
-   main primary map, the secondary may be either a real secondary, or
-   one of the three distinguished secondaries.  DO NOT CHANGE THIS
-   LAYOUT: the first word has to be the key for OSet fast lookups.
+/* The auxiliary primary map, for addresses above MAX_PRIMARY_ADDRESS.
+   On 64-bit hosts this is a 2-level radix table indexed by bits 47..16
+   of the address, so that high mappings (large anonymous arenas,
+   jemalloc extents) take the same fast cases as low memory: a lookup
+   is two dependent loads.  A leaf holds the secmap pointers for 4G of
+   address space and is only allocated once something in that range is
+   written, or read through get_secmap_high_ptr().  Addresses above the
+   radix table (none in a 48-bit user address space) go to an OSet. */
+#define AUXMAP_LEAF_BITS  16
+#define N_AUXMAP_LEAF     ( ((UWord)1) << AUXMAP_LEAF_BITS)
+
+#if VG_WORDSIZE == 4
+#  define AUXMAP_TOP_BITS  0	// unused, the primary map covers it all
+#else
+#  define AUXMAP_TOP_BITS  16
+#endif
+
+#define N_AUXMAP_TOP      ( ((UWord)1) << AUXMAP_TOP_BITS)
+
+#define AUXMAP_TOP_IX(aaa)   ( ((aaa) >> 16) >> AUXMAP_LEAF_BITS )
+#define AUXMAP_LEAF_IX(aaa)  ( ((aaa) >> 16) & (N_AUXMAP_LEAF-1) )
+
+/* What the secmap pointers of new leaves and overflow nodes start as. */
+#if _SECRETGRIND_
+#  define AUXMAP_INIT_SM   (&sm_distinguished[SM_DIST_UNTAINTED])
+#else
+#  define AUXMAP_INIT_SM   (&sm_distinguished[SM_DIST_NOACCESS])
+#endif
+
+static SecMap** auxmap_top[N_AUXMAP_TOP];
+
+/* An entry in the overflow part of the auxiliary primary map.  base
+   must be a 64k-aligned value, and sm points at the relevant secondary
+   map.  As with the main primary map, the secondary may be either a
+   real secondary, or one of the three distinguished secondaries.  DO
+   NOT CHANGE THIS LAYOUT: the first word has to be the key for OSet
+   fast lookups.
 */
 typedef
    struct {
@@ -332,216 +330,59 @@ typedef
    }
    AuxMapEnt;
 
-/* Tunable parameter: How big is the L1 queue? */
-#define N_AUXMAP_L1 24
+static OSet* auxmap_overflow = NULL;
 
-/* Tunable parameter: How far along the L1 queue to insert
-   entries resulting from L2 lookups? */
-#define AUXMAP_L1_INSERT_IX 12
-
-static struct {
-          Addr       base;
-          AuxMapEnt* ent; // pointer to the matching auxmap_L2 node
-       }
-       auxmap_L1[N_AUXMAP_L1];
-
-static OSet* auxmap_L2 = NULL;
-static void init_auxmap_L1_L2 ( void )
+static void init_auxmap ( void )
 {
-   Int i;
-   for (i = 0; i < N_AUXMAP_L1; i++) {
-      auxmap_L1[i].base = 0;
-      auxmap_L1[i].ent  = NULL;
-   }
-
    tl_assert(0 == offsetof(AuxMapEnt,base));
    tl_assert(sizeof(Addr) == sizeof(void*));
-   auxmap_L2 = VG_(OSetGen_Create)( /*keyOff*/  offsetof(AuxMapEnt,base),
-                                    /*fastCmp*/ NULL,
-                                    VG_(malloc), "mc.iaLL.1", VG_(free) );
+   auxmap_overflow = VG_(OSetGen_Create)( /*keyOff*/  offsetof(AuxMapEnt,base),
+                                          /*fastCmp*/ NULL,
+                                          VG_(malloc), "mc.iaLL.1", VG_(free) );
 }
 
-/* Check representation invariants; if OK return NULL; else a
-   descriptive bit of text.  Also return the number of
-   non-distinguished secondary maps referred to from the auxiliary
-   primary maps. */
-
-//static HChar* check_auxmap_L1_L2_sanity ( Word* n_secmaps_found )
-//{
-//   Word i, j;
-   /* On a 32-bit platform, the L2 and L1 tables should
-      both remain empty forever.
-
-      On a 64-bit platform:
-      In the L2 table:
-       all .base & 0xFFFF == 0
-       all .base > MAX_PRIMARY_ADDRESS
-      In the L1 table:
-       all .base & 0xFFFF == 0
-       all (.base > MAX_PRIMARY_ADDRESS
-            .base & 0xFFFF == 0
-            and .ent points to an AuxMapEnt with the same .base)
-           or
-           (.base == 0 and .ent == NULL)
-   */
-//   *n_secmaps_found = 0;
-//   if (sizeof(void*) == 4) {
-      /* 32-bit platform */
-//      if (VG_(OSetGen_Size)(auxmap_L2) != 0)
-//         return "32-bit: auxmap_L2 is non-empty";
-//      for (i = 0; i < N_AUXMAP_L1; i++)
-//        if (auxmap_L1[i].base != 0 || auxmap_L1[i].ent != NULL)
-//      return "32-bit: auxmap_L1 is non-empty";
-//   } else {
-      /* 64-bit platform */
-//      UWord elems_seen = 0;
-//      AuxMapEnt *elem, *res;
-//      AuxMapEnt key;
-      /* L2 table */
-//      VG_(OSetGen_ResetIter)(auxmap_L2);
-//      while ( (elem = VG_(OSetGen_Next)(auxmap_L2)) ) {
-//         elems_seen++;
-//         if (0 != (elem->base & (Addr)0xFFFF))
-//            return "64-bit: nonzero .base & 0xFFFF in auxmap_L2";
-//         if (elem->base <= MAX_PRIMARY_ADDRESS)
-//            return "64-bit: .base <= MAX_PRIMARY_ADDRESS in auxmap_L2";
-//         if (elem->sm == NULL)
-//            return "64-bit: .sm in _L2 is NULL";
-//         if (!is_distinguished_sm(elem->sm))
-//            (*n_secmaps_found)++;
-//      }
-//      if (elems_seen != n_auxmap_L2_nodes)
-//         return "64-bit: disagreement on number of elems in _L2";
-      /* Check L1-L2 correspondence */
-/*      for (i = 0; i < N_AUXMAP_L1; i++) {
-         if (auxmap_L1[i].base == 0 && auxmap_L1[i].ent == NULL)
-            continue;
-         if (0 != (auxmap_L1[i].base & (Addr)0xFFFF))
-            return "64-bit: nonzero .base & 0xFFFF in auxmap_L1";
-         if (auxmap_L1[i].base <= MAX_PRIMARY_ADDRESS)
-            return "64-bit: .base <= MAX_PRIMARY_ADDRESS in auxmap_L1";
-         if (auxmap_L1[i].ent == NULL)
-            return "64-bit: .ent is NULL in auxmap_L1";
-         if (auxmap_L1[i].ent->base != auxmap_L1[i].base)
-            return "64-bit: _L1 and _L2 bases are inconsistent";*/
-         /* Look it up in auxmap_L2. */
-/*         key.base = auxmap_L1[i].base;
-         key.sm   = 0;
-         res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
-         if (res == NULL)
-            return "64-bit: _L1 .base not found in _L2";
-         if (res != auxmap_L1[i].ent)
-            return "64-bit: _L1 .ent disagrees with _L2 entry";
-      }*/
-      /* Check L1 contains no duplicates */
-/*      for (i = 0; i < N_AUXMAP_L1; i++) {
-         if (auxmap_L1[i].base == 0)
-            continue;
-         for (j = i+1; j < N_AUXMAP_L1; j++) {
-            if (auxmap_L1[j].base == 0)
-               continue;
-            if (auxmap_L1[j].base == auxmap_L1[i].base)
-               return "64-bit: duplicate _L1 .base entries";
-         }
-      }
-   }
-   return NULL;*/ /* ok */
-//}
-
-static void insert_into_auxmap_L1_at ( Word rank, AuxMapEnt* ent )
+static SecMap** alloc_auxmap_leaf ( UWord top )
 {
-   Word i;
-   tl_assert(ent);
-   tl_assert(rank >= 0 && rank < N_AUXMAP_L1);
-   for (i = N_AUXMAP_L1-1; i > rank; i--)
-      auxmap_L1[i] = auxmap_L1[i-1];
-   auxmap_L1[rank].base = ent->base;
-   auxmap_L1[rank].ent  = ent;
+   SecMap** leaf;
+   UWord    i;
+
+   leaf = VG_(am_shadow_alloc)( N_AUXMAP_LEAF * sizeof(SecMap*) );
+   if (leaf == NULL)
+      VG_(out_of_memory_NORETURN)( "taintgrind:allocate auxmap leaf",
+                                   N_AUXMAP_LEAF * sizeof(SecMap*) );
+   for (i = 0; i < N_AUXMAP_LEAF; i++)
+      leaf[i] = AUXMAP_INIT_SM;
+   auxmap_top[top] = leaf;
+   n_auxmap_leaves++;
+   return leaf;
 }
 
-static INLINE AuxMapEnt* maybe_find_in_auxmap ( Addr a )
+static INLINE AuxMapEnt* maybe_find_in_auxmap_overflow ( Addr a )
 {
-   AuxMapEnt  key;
-   AuxMapEnt* res;
-   Word       i;
-
-   tl_assert(a > MAX_PRIMARY_ADDRESS);
-   a &= ~(Addr)0xFFFF;
-
-   /* First search the front-cache, which is a self-organising
-      list containing the most popular entries. */
-
-   if (LIKELY(auxmap_L1[0].base == a))
-      return auxmap_L1[0].ent;
-   if (LIKELY(auxmap_L1[1].base == a)) {
-      Addr       t_base = auxmap_L1[0].base;
-      AuxMapEnt* t_ent  = auxmap_L1[0].ent;
-      auxmap_L1[0].base = auxmap_L1[1].base;
-      auxmap_L1[0].ent  = auxmap_L1[1].ent;
-      auxmap_L1[1].base = t_base;
-      auxmap_L1[1].ent  = t_ent;
-      return auxmap_L1[0].ent;
-   }
-
-   n_auxmap_L1_searches++;
-
-   for (i = 0; i < N_AUXMAP_L1; i++) {
-      if (auxmap_L1[i].base == a) {
-         break;
-      }
-   }
-   tl_assert(i >= 0 && i <= N_AUXMAP_L1);
-
-   n_auxmap_L1_cmps += (ULong)(i+1);
-
-   if (i < N_AUXMAP_L1) {
-      if (i > 0) {
-         Addr       t_base = auxmap_L1[i-1].base;
-         AuxMapEnt* t_ent  = auxmap_L1[i-1].ent;
-         auxmap_L1[i-1].base = auxmap_L1[i-0].base;
-         auxmap_L1[i-1].ent  = auxmap_L1[i-0].ent;
-         auxmap_L1[i-0].base = t_base;
-         auxmap_L1[i-0].ent  = t_ent;
-         i--;
-      }
-      return auxmap_L1[i].ent;
-   }
-
-   n_auxmap_L2_searches++;
+   AuxMapEnt key;
 
-   /* First see if we already have it. */
-   key.base = a;
+   key.base = a & ~(Addr)0xFFFF;
    key.sm   = 0;
-
-   res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
-   if (res)
-      insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, res );
-   return res;
+   return VG_(OSetGen_Lookup)(auxmap_overflow, &key);
 }
 
-static AuxMapEnt* find_or_alloc_in_auxmap ( Addr a )
+static AuxMapEnt* find_or_alloc_in_auxmap_overflow ( Addr a )
 {
    AuxMapEnt *nyu, *res;
-	
+
    /* First see if we already have it. */
-   res = maybe_find_in_auxmap( a );
+   res = maybe_find_in_auxmap_overflow( a );
    if (LIKELY(res))
       return res;
 
    /* Ok, there's no entry in the secondary map, so we'll have
       to allocate one. */
-   a &= ~(Addr)0xFFFF;
-   nyu = (AuxMapEnt*) VG_(OSetGen_AllocNode)( auxmap_L2, sizeof(AuxMapEnt) );
+   nyu = (AuxMapEnt*) VG_(OSetGen_AllocNode)( auxmap_overflow, sizeof(AuxMapEnt) );
    tl_assert(nyu);
-   nyu->base = a;
-   #if _SECRETGRIND_
-   nyu->sm   = &sm_distinguished[SM_DIST_UNTAINTED];
-   #else
-   nyu->sm   = &sm_distinguished[SM_DIST_NOACCESS];
-   #endif
-   VG_(OSetGen_Insert)( auxmap_L2, nyu );
-   insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, nyu );
-   n_auxmap_L2_nodes++;
+   nyu->base = a & ~(Addr)0xFFFF;
+   nyu->sm   = AUXMAP_INIT_SM;
+   VG_(OSetGen_Insert)( auxmap_overflow, nyu );
+   n_auxmap_overflow_nodes++;
    return nyu;
 }
 
@@ -561,8 +402,14 @@ static INLINE SecMap** get_secmap_low_ptr ( Addr a )
 
 static INLINE SecMap** get_secmap_high_ptr ( Addr a )
 {
-   AuxMapEnt* am = find_or_alloc_in_auxmap(a);
-   return &am->sm;
+   UWord top = AUXMAP_TOP_IX(a);
+   if (LIKELY(top < N_AUXMAP_TOP)) {
+      SecMap** leaf = auxmap_top[top];
+      if (UNLIKELY(leaf == NULL))
+         leaf = alloc_auxmap_leaf(top);
+      return &leaf[ AUXMAP_LEAF_IX(a) ];
+   }
+   return &find_or_alloc_in_auxmap_overflow(a)->sm;
 }
 
 static SecMap** get_secmap_ptr ( Addr a )
@@ -581,8 +428,15 @@ static INLINE SecMap* get_secmap_for_reading_low ( Addr a )
    return *get_secmap_low_ptr(a);
 }
 
+/* A missing leaf reads as its initial contents, so reading does not
+   allocate. */
 static INLINE SecMap* get_secmap_for_reading_high ( Addr a )
 {
+   UWord top = AUXMAP_TOP_IX(a);
+   if (LIKELY(top < N_AUXMAP_TOP)) {
+      SecMap** leaf = auxmap_top[top];
+      return LIKELY(leaf != NULL) ? leaf[ AUXMAP_LEAF_IX(a) ] : AUXMAP_INIT_SM;
+   }
    return *get_secmap_high_ptr(a);
 }
 
@@ -621,7 +475,7 @@ static INLINE SecMap* get_secmap_for_reading ( Addr a )
    writable copy of it, install it, and return the copy instead.  (COW
    semantics).
 */
-static SecMap* get_secmap_for_writing ( Addr a )
+static INLINE SecMap* get_secmap_for_writing ( Addr a )
 {
    return ( a <= MAX_PRIMARY_ADDRESS
           ? get_secmap_for_writing_low (a)
@@ -637,11 +491,106 @@ static SecMap* get_secmap_for_writing ( Addr a )
    if (a <= MAX_PRIMARY_ADDRESS) {
       return get_secmap_for_reading_low(a);
    } else {
-      AuxMapEnt* am = maybe_find_in_auxmap(a);
+      AuxMapEnt* am = maybe_find_in_auxmap_overflow(a);
       return am ? am->sm : NULL;
    }
 }*/
 
+/* --------------- Reclaiming secmaps --------------- */
+
+/* A private secmap stays private once copy_for_writing has made it,
+   even after the program has zeroised the secrets in it and the whole
+   64k is untainted again.  Those that are back to the contents of a
+   distinguished secmap are found and freed:
+   - by TNT_(make_mem_untainted) of large ranges, for the secmaps at both
+     ends (set_address_range_perms already frees the ones in between);
+   - by a pass over all the secmaps whenever the number of private ones
+     has doubled since the previous pass.
+   Both run outside the load/store helpers, so no caller holds on to a
+   secmap being freed. */
+
+/* Tunable parameters: the smallest range TNT_(make_mem_untainted)
+   looks at the ends of, and the fewest private secmaps for a pass. */
+#define RECLAIM_MIN_LEN   4096
+#define RECLAIM_MIN_SMS   64
+
+static Int reclaim_watermark = RECLAIM_MIN_SMS;
+
+static void drop_sec_vbits_map ( Addr a );
+static void sweep_sec_vbits_maps ( void );
+
+// True if *sm_ptr was freed
+static Bool reclaim_SM ( SecMap** sm_ptr )
+{
+   SecMap* sm = *sm_ptr;
+   SecMap* dsm;
+
+   if (is_distinguished_sm(sm))
+      return False;
+
+   // The first byte says which one it could be equal to
+   if      (sm->vabits8[0] == sm_distinguished[SM_DIST_UNTAINTED].vabits8[0])
+      dsm = &sm_distinguished[SM_DIST_UNTAINTED];
+   else if (sm->vabits8[0] == sm_distinguished[SM_DIST_TAINTED].vabits8[0])
+      dsm = &sm_distinguished[SM_DIST_TAINTED];
+   else
+      return False;
+   if (VG_(memcmp)(sm, dsm, SM_BYTES) != 0)
+      return False;
+
+   PROF_EVENT(285, "reclaim_SM");
+   VG_(am_munmap_valgrind)((Addr)sm, SM_BYTES);
+   update_SM_counts(sm, dsm);
+   *sm_ptr = dsm;
+   n_reclaimed_SMs++;
+   return True;
+}
+
+static void reclaim_all_SMs ( void )
+{
+   UWord      i, top;
+   AuxMapEnt* elem;
+
+   PROF_EVENT(286, "reclaim_all_SMs");
+   for (i = 0; i < N_PRIMARY_MAP; i++)
+      reclaim_SM(&primary_map[i]);
+
+   for (top = 0; top < N_AUXMAP_TOP; top++) {
+      SecMap** leaf = auxmap_top[top];
+      if (leaf == NULL)
+         continue;
+      for (i = 0; i < N_AUXMAP_LEAF; i++)
+         reclaim_SM(&leaf[i]);
+   }
+
+   VG_(OSetGen_ResetIter)(auxmap_overflow);
+   while ( (elem = VG_(OSetGen_Next)(auxmap_overflow)) )
+      reclaim_SM(&elem->sm);
+
+   sweep_sec_vbits_maps();
+   n_reclaim_passes++;
+   reclaim_watermark = 2 * n_non_DSM_SMs;
+   if (reclaim_watermark < RECLAIM_MIN_SMS)
+      reclaim_watermark = RECLAIM_MIN_SMS;
+}
+
+/* Called between timeslices, see tnt_start_client_code(). */
+static INLINE void maybe_reclaim_all_SMs ( void )
+{
+   if (UNLIKELY(n_non_DSM_SMs >= reclaim_watermark))
+      reclaim_all_SMs();
+}
+
+static void reclaim_range_SMs ( Addr a, SizeT len )
+{
+   if (len < RECLAIM_MIN_LEN)
+      return;
+   if (reclaim_SM(get_secmap_ptr(a)))
+      drop_sec_vbits_map(a);
+   if (reclaim_SM(get_secmap_ptr(a + len - 1)))
+      drop_sec_vbits_map(a + len - 1);
+}
+
 /* --------------- Fundamental functions --------------- */
 
 static INLINE
@@ -680,6 +629,20 @@ UChar extract_vabits4_from_vabits8 ( Addr a, UChar vabits8 )
    return 0xf & vabits8;               // mask out the rest
 }
 
+static INLINE
+void insert_tabits1_into_tabits8 ( Addr a, UChar tabits1, UChar* tabits8 )
+{
+   UInt shift = SM_SHIFT_C(a);         // shift by 0 .. 7
+   *tabits8  &= ~(0x1     << shift);   // mask out the old bit
+   *tabits8  |=  (tabits1 << shift);   // mask  in the new bit
+}
+
+static INLINE
+UChar extract_tabits1_from_tabits8 ( Addr a, UChar tabits8 )
+{
+   return 0x1 & (tabits8 >> SM_SHIFT_C(a));
+}
+
 // Note that these four are only used in slow cases.  The fast cases do
 // clever things like combine the auxmap check (in
 // get_secmap_{read,writ}able) with alignment checks.
@@ -694,6 +657,13 @@ void set_vabits2 ( Addr a, UChar vabits2 )
    SecMap* sm       = get_secmap_for_writing(a); // Taintgrind: only handle 32-bits
    UWord   sm_off   = SM_OFF(a);
 
+   if (TNT_(clo_shadow_compact)) {
+      UChar tabits1 = ( VA_BITS2_TAINTED == vabits2 || VA_BITS2_PARTUNTAINTED == vabits2 )
+                    ? TA_BITS1_TAINTED : TA_BITS1_UNTAINTED;
+      insert_tabits1_into_tabits8( a, tabits1, &(sm->vabits8[SM_OFF_C(a)]) );
+      return;
+   }
+
 #ifdef DBG_MEM
    // Taintgrind
 //   if (vabits2 == VA_BITS2_TAINTED)
@@ -730,6 +700,12 @@ void set_vabits8_for_aligned_word32 ( Addr a, UChar vabits8 )
 //static INLINE
 UChar get_vabits2 ( Addr a )
 {
+   if (TNT_(clo_shadow_compact)) {
+      SecMap* sm = get_secmap_for_reading(a);
+      return extract_tabits1_from_tabits8( a, sm->vabits8[SM_OFF_C(a)] )
+             ? VA_BITS2_TAINTED : VA_BITS2_UNTAINTED;
+   }
+
 #if _SECRETGRIND_
 	// re-use existing function
 	UChar vabits8 = get_vabits8_for_aligned_word32(a);
@@ -769,6 +745,7 @@ Bool set_vbits8 ( Addr a, UChar vbits8 )
       // longer necessary.
       if      ( V_BITS8_UNTAINTED == vbits8 ) { vabits2 = VA_BITS2_UNTAINTED; }
       else if ( V_BITS8_TAINTED   == vbits8 ) { vabits2 = VA_BITS2_TAINTED;   }
+      else if ( TNT_(clo_shadow_compact) )    { vabits2 = VA_BITS2_TAINTED;   }
       else                                    { vabits2 = VA_BITS2_PARTUNTAINTED;
                                                 set_sec_vbits8(a, vbits8);  }
       set_vabits2(a, vabits2);
@@ -805,171 +782,180 @@ Bool get_vbits8 ( Addr a, UChar* vbits8 )
 }
 
 /* --------------- Secondary V bit table ------------ */
-static OSet* secVBitTable;
-
-// Stats
-static ULong sec_vbits_new_nodes = 0;
-static ULong sec_vbits_updates   = 0;
-
-// This must be a power of two;  this is checked in tnt_pre_clo_init().
-// The size chosen here is a trade-off:  if the nodes are bigger (ie. cover
-// a larger address range) they take more space but we can get multiple
-// partially-defined bytes in one if they are close to each other, reducing
-// the number of total nodes.  In practice sometimes they are clustered (eg.
-// perf/bz2 repeatedly writes then reads more than 20,000 in a contiguous
-// row), but often not.  So we choose something intermediate.
-#define BYTES_PER_SEC_VBIT_NODE     16
-
-// We make the table bigger if more than this many nodes survive a GC.
-#define MAX_SURVIVOR_PROPORTION  0.5
 
-// Each time we make the table bigger, we increase it by this much.
-#define TABLE_GROWTH_FACTOR      2
-
-// This defines "sufficiently stale" -- any node that hasn't been touched in
-// this many GCs will be removed.
-#define MAX_STALE_AGE            2
-
-// We GC the table when it gets this many nodes in it, ie. it's effectively
-// the table size.  It can change.
-static Int  secVBitLimit = 1024;
-
-// The number of GCs done, used to age sec-V-bit nodes for eviction.
-// Because it's unsigned, wrapping doesn't matter -- the right answer will
-// come out anyway.
-static UInt GCs_done = 0;
+/* The V bits of partially tainted bytes (VA_BITS2_PARTUNTAINTED) live
+   in side maps, one per 64k of address space that has such a byte,
+   allocated on demand and hashed by secmap.  A side map is itself split
+   into 1k chunks, also allocated on demand, so a few partially tainted
+   bytes cost one chunk rather than 64k, four times their secmap.  A
+   lookup is O(1), and usually hits the one-entry cache.  Side maps are
+   not kept longer than needed either: they go away
+   with their secmap (set_address_range_perms, reclaim_range_SMs), and
+   those whose secmap no longer has a partially tainted byte are swept
+   by the reclamation passes and whenever the number of side maps has
+   doubled since the previous sweep. */
+#define SEC_VBIT_CHUNK_BITS  10
+#define SEC_VBIT_CHUNK_SIZE  (1 << SEC_VBIT_CHUNK_BITS)
+#define SEC_VBIT_CHUNK_MASK  (SEC_VBIT_CHUNK_SIZE - 1)
+#define SEC_VBIT_N_CHUNKS    (SM_SIZE / SEC_VBIT_CHUNK_SIZE)
 
 typedef
-   struct {
-      Addr  a;
-      UChar vbits8[BYTES_PER_SEC_VBIT_NODE];
-      UInt  last_touched;
+   struct _SecVBitMap {
+      struct _SecVBitMap* next;     // VgHashNode
+      UWord               key;      // address >> 16
+      UChar*              chunks[SEC_VBIT_N_CHUNKS];  // NULL until written
    }
-   SecVBitNode;
-
-static OSet* createSecVBitTable(void)
-{
-   return VG_(OSetGen_Create)( offsetof(SecVBitNode, a),
-                               NULL, // use fast comparisons
-                               VG_(malloc), "mc.cSVT.1 (sec VBit table)",
-                               VG_(free) );
-}
-
-static void gcSecVBitTable(void)
-{
-   OSet*        secVBitTable2;
-   SecVBitNode* n;
-   Int          i, n_nodes = 0, n_survivors = 0;
-
-   GCs_done++;
+   SecVBitMap;
 
-   // Create the new table.
-   secVBitTable2 = createSecVBitTable();
+static VgHashTable secVBitTable  = NULL;
+static SecVBitMap* secVBit_cache = NULL;   // last map looked up
 
-   // Traverse the table, moving fresh nodes into the new table.
-   VG_(OSetGen_ResetIter)(secVBitTable);
-   while ( (n = VG_(OSetGen_Next)(secVBitTable)) ) {
-      Bool keep = False;
-      if ( (GCs_done - n->last_touched) <= MAX_STALE_AGE ) {
-         // Keep node if it's been touched recently enough (regardless of
-         // freshness/staleness).
-         keep = True;
-      } else {
-         // Keep node if any of its bytes are non-stale.  Using
-         // get_vabits2() for the lookup is not very efficient, but I don't
-         // think it matters.
-         for (i = 0; i < BYTES_PER_SEC_VBIT_NODE; i++) { VG_(printf)( "gcSecVBitTable() -> get_vabits2\n" );
-            if (VA_BITS2_PARTUNTAINTED == get_vabits2(n->a + i)) {
-               keep = True;      // Found a non-stale byte, so keep
-               break;
-            }
-         }
-      }
+/* Tunable parameter: the fewest side maps for a sweep from
+   set_sec_vbits8(). */
+#define SEC_VBIT_MIN_MAPS  16
 
-      if ( keep ) {
-         // Insert a copy of the node into the new table.
-         SecVBitNode* n2 =
-            VG_(OSetGen_AllocNode)(secVBitTable2, sizeof(SecVBitNode));
-         *n2 = *n;
-         VG_(OSetGen_Insert)(secVBitTable2, n2);
-      }
-   }
+static Int secVBit_watermark = SEC_VBIT_MIN_MAPS;
 
-   // Get the before and after sizes.
-   n_nodes     = VG_(OSetGen_Size)(secVBitTable);
-   n_survivors = VG_(OSetGen_Size)(secVBitTable2);
+// Stats
+static ULong sec_vbits_new_maps  = 0;
+static ULong sec_vbits_updates   = 0;
+static ULong sec_vbits_sweeps    = 0;
 
-   // Destroy the old table, and put the new one in its place.
-   VG_(OSetGen_Destroy)(secVBitTable);
-   secVBitTable = secVBitTable2;
+static INLINE SecVBitMap* find_sec_vbits_map ( Addr a )
+{
+   UWord       key = a >> 16;
+   SecVBitMap* m;
 
-   if (VG_(clo_verbosity) > 1) {
-      HChar percbuf[6];
-      VG_(percentify)(n_survivors, n_nodes, 1, 6, percbuf);
-      VG_(message)(Vg_DebugMsg, "tnt_main.c: GC: %d nodes, %d survivors (%s)\n",
-                   n_nodes, n_survivors, percbuf);
-   }
+   if (LIKELY(secVBit_cache != NULL && secVBit_cache->key == key))
+      return secVBit_cache;
+   if (secVBitTable == NULL)
+      return NULL;
+   m = VG_(HT_lookup)(secVBitTable, key);
+   if (m)
+      secVBit_cache = m;
+   return m;
+}
 
-   // Increase table size if necessary.
-   if (n_survivors > (secVBitLimit * MAX_SURVIVOR_PROPORTION)) {
-      secVBitLimit *= TABLE_GROWTH_FACTOR;
-      if (VG_(clo_verbosity) > 1)
-         VG_(message)(Vg_DebugMsg, "tnt_main.c: GC: increase table size to %d\n",
-                      secVBitLimit);
-   }
+static void note_sec_vbits_alloc ( SizeT bytes )
+{
+   secVBit_bytes += bytes;
+   if (secVBit_bytes > max_secVBit_bytes)
+      max_secVBit_bytes = secVBit_bytes;
 }
 
 static UWord get_sec_vbits8(Addr a)
 {
-   Addr         aAligned = VG_ROUNDDN(a, BYTES_PER_SEC_VBIT_NODE);
-   Int          amod     = a % BYTES_PER_SEC_VBIT_NODE;
-   SecVBitNode* n        = VG_(OSetGen_Lookup)(secVBitTable, &aAligned);
-   UChar        vbits8;
-   tl_assert2(n, "get_sec_vbits8: no node for address %p (%p)\n", aAligned, a);
+   SecVBitMap* m = find_sec_vbits_map(a);
+   UChar*      chunk;
+   UChar       vbits8;
+   tl_assert2(m, "get_sec_vbits8: no map for address %p\n", a);
+   chunk = m->chunks[(a & SM_MASK) >> SEC_VBIT_CHUNK_BITS];
+   tl_assert2(chunk, "get_sec_vbits8: no chunk for address %p\n", a);
    // Shouldn't be fully defined or fully undefined -- those cases shouldn't
    // make it to the secondary V bits table.
-   vbits8 = n->vbits8[amod];
+   vbits8 = chunk[a & SEC_VBIT_CHUNK_MASK];
    tl_assert(V_BITS8_UNTAINTED != vbits8 && V_BITS8_TAINTED != vbits8);
    return vbits8;
 }
 
 static void set_sec_vbits8(Addr a, UWord vbits8)
 {
-   Addr         aAligned = VG_ROUNDDN(a, BYTES_PER_SEC_VBIT_NODE);
-   Int          i, amod  = a % BYTES_PER_SEC_VBIT_NODE;
-   SecVBitNode* n        = VG_(OSetGen_Lookup)(secVBitTable, &aAligned);
+   SecVBitMap* m = find_sec_vbits_map(a);
+   UChar**     chunk;
    // Shouldn't be fully defined or fully undefined -- those cases shouldn't
    // make it to the secondary V bits table.
    tl_assert(V_BITS8_UNTAINTED != vbits8 && V_BITS8_TAINTED != vbits8);
-   if (n) {
-      n->vbits8[amod] = vbits8;     // update
-      n->last_touched = GCs_done;
+   if (LIKELY(m != NULL)) {
       sec_vbits_updates++;
    } else {
-      // New node:  assign the specific byte, make the rest invalid (they
-      // should never be read as-is, but be cautious).
-      n = VG_(OSetGen_AllocNode)(secVBitTable, sizeof(SecVBitNode));
-      n->a            = aAligned;
-      for (i = 0; i < BYTES_PER_SEC_VBIT_NODE; i++) {
-         n->vbits8[i] = V_BITS8_TAINTED;
-      }
-      n->vbits8[amod] = vbits8;
-      n->last_touched = GCs_done;
+      // Sweep if necessary.  Nb: do this before making the new map: its
+      // byte is not VA_BITS2_PARTUNTAINTED yet, so it would be swept.
+      if (n_secVBit_maps >= secVBit_watermark)
+         sweep_sec_vbits_maps();
+
+      // New map, without chunks yet.
+      if (secVBitTable == NULL)
+         secVBitTable = VG_(HT_construct)( "mc.cSVT.1 (sec VBit table)" );
+      m = VG_(malloc)( "mc.cSVT.2 (sec VBit map)", sizeof(SecVBitMap) );
+      VG_(memset)( m, 0, sizeof(SecVBitMap) );
+      m->key = a >> 16;
+      VG_(HT_add_node)( secVBitTable, m );
+      note_sec_vbits_alloc( sizeof(SecVBitMap) );
+      secVBit_cache = m;
+      sec_vbits_new_maps++;
+
+      n_secVBit_maps++;
+      if (n_secVBit_maps > max_secVBit_maps)
+         max_secVBit_maps = n_secVBit_maps;
+   }
+   chunk = &m->chunks[(a & SM_MASK) >> SEC_VBIT_CHUNK_BITS];
+   if (UNLIKELY(*chunk == NULL)) {
+      // The other bytes should never be read as-is, but be cautious.
+      *chunk = VG_(malloc)( "mc.cSVT.3 (sec VBit chunk)", SEC_VBIT_CHUNK_SIZE );
+      VG_(memset)( *chunk, V_BITS8_TAINTED, SEC_VBIT_CHUNK_SIZE );
+      note_sec_vbits_alloc( SEC_VBIT_CHUNK_SIZE );
+   }
+   (*chunk)[a & SEC_VBIT_CHUNK_MASK] = vbits8;
+}
+
+/* Drop the side map of the 64k that 'a' is in, if any. */
+static void drop_sec_vbits_map ( Addr a )
+{
+   SecVBitMap* m;
+   UWord       i;
 
-      // Do a table GC if necessary.  Nb: do this before inserting the new
-      // node, to avoid erroneously GC'ing the new node.
-      if (secVBitLimit == VG_(OSetGen_Size)(secVBitTable)) {
-         gcSecVBitTable();
+   if (secVBitTable == NULL)
+      return;
+   m = VG_(HT_remove)( secVBitTable, a >> 16 );
+   if (m == NULL)
+      return;
+   if (secVBit_cache == m)
+      secVBit_cache = NULL;
+   for (i = 0; i < SEC_VBIT_N_CHUNKS; i++) {
+      if (m->chunks[i]) {
+         VG_(free)(m->chunks[i]);
+         secVBit_bytes -= SEC_VBIT_CHUNK_SIZE;
       }
+   }
+   VG_(free)(m);
+   secVBit_bytes -= sizeof(SecVBitMap);
+   n_secVBit_maps--;
+}
 
-      // Insert the new node.
-      VG_(OSetGen_Insert)(secVBitTable, n);
-      sec_vbits_new_nodes++;
+static Bool has_partuntainted_bytes ( SecMap* sm )
+{
+   UWord i;
+   for (i = 0; i < SM_CHUNKS; i++) {
+      UChar vabits8 = sm->vabits8[i];
+      // any 2-bit field equal to VA_BITS2_PARTUNTAINTED (11b)
+      if (vabits8 & (vabits8 >> 1) & 0x55)
+         return True;
+   }
+   return False;
+}
 
-      n_secVBit_nodes = VG_(OSetGen_Size)(secVBitTable);
-      if (n_secVBit_nodes > max_secVBit_nodes)
-         max_secVBit_nodes = n_secVBit_nodes;
+/* Drop the side maps whose secmap has no partially tainted byte left.
+   See reclaim_all_SMs() and set_sec_vbits8(). */
+static void sweep_sec_vbits_maps ( void )
+{
+   VgHashNode** maps;
+   UInt         i, n_maps;
+
+   if (secVBitTable != NULL && n_secVBit_maps > 0) {
+      maps = VG_(HT_to_array)( secVBitTable, &n_maps );
+      for (i = 0; i < n_maps; i++) {
+         Addr    base = ((SecVBitMap*)maps[i])->key << 16;
+         SecMap* sm   = get_secmap_for_reading(base);
+         if (is_distinguished_sm(sm) || !has_partuntainted_bytes(sm))
+            drop_sec_vbits_map(base);
+      }
+      VG_(free)(maps);
+      sec_vbits_sweeps++;
    }
+
+   secVBit_watermark = 2 * n_secVBit_maps;
+   if (secVBit_watermark < SEC_VBIT_MIN_MAPS)
+      secVBit_watermark = SEC_VBIT_MIN_MAPS;
 }
 
 /* --------------- Endianness helpers --------------- */
@@ -983,116 +969,6 @@ static INLINE UWord byte_offset_w ( UWord wordszB, Bool bigendian,
 
 
 /* --------------- Load/store slow cases. --------------- */
-static
-__attribute__((noinline))
-void tnt_LOADV_128_or_256_slow ( /*OUT*/ULong* res,
-                                Addr a, SizeT nBits, Bool bigendian )
-{
-   //ULong  pessim[4];     /* only used when p-l-ok=yes */
-   SSizeT szB            = nBits / 8;
-   SSizeT szL            = szB / 8;  /* Size in Longs (64-bit units) */
-   SSizeT i, j;          /* Must be signed. */
-   SizeT  n_addrs_bad = 0;
-   Addr   ai;
-   UChar  vbits8;
-   Bool   ok;
-
-   /* Code below assumes load size is a power of two and at least 64
-      bits. */
-   tl_assert((szB & (szB-1)) == 0 && szL > 0);
-
-   /* If this triggers, you probably just need to increase the size of
-      the pessim array. */
-   //tl_assert(szL <= sizeof(pessim) / sizeof(pessim[0]));
-
-   for (j = 0; j < szL; j++) {
-      //pessim[j] = V_BITS64_UNTAINTED;
-      res[j] = V_BITS64_TAINTED;
-   }
-
-   /* Make up a result V word, which contains the loaded data for
-      valid addresses and Defined for invalid addresses.  Iterate over
-      the bytes in the word, from the most significant down to the
-      least.  The vbits to return are calculated into vbits128.  Also
-      compute the pessimising value to be used when
-      --partial-loads-ok=yes.  n_addrs_bad is redundant (the relevant
-      info can be gleaned from the pessim array) but is used as a
-      cross-check. */
-   for (j = szL-1; j >= 0; j--) {
-      ULong vbits64    = V_BITS64_TAINTED;
-      //ULong pessim64   = V_BITS64_UNTAINTED;
-      UWord long_index = byte_offset_w(szL, bigendian, j);
-      for (i = 8-1; i >= 0; i--) {
-         PROF_EVENT(31, "tnt_LOADV_128_or_256_slow(loop)");
-         ai = a + 8*long_index + byte_offset_w(8, bigendian, i);
-         ok = get_vbits8(ai, &vbits8);
-         vbits64 <<= 8;
-         vbits64 |= vbits8;
-         if (!ok) n_addrs_bad++;
-         //pessim64 <<= 8;
-         //pessim64 |= (ok ? V_BITS8_UNTAINTED : V_BITS8_TAINTED);
-      }
-      res[long_index] = vbits64;
-      //pessim[long_index] = pessim64;
-   }
-
-   /* In the common case, all the addresses involved are valid, so we
-      just return the computed V bits and have done. */
-   //if (LIKELY(n_addrs_bad == 0))
-   return;
-
-   /* If there's no possibility of getting a partial-loads-ok
-      exemption, report the error and quit. */
-   //if (!MC_(clo_partial_loads_ok)) {
-   //   MC_(record_address_error)( VG_(get_running_tid)(), a, szB, False );
-   //   return;
-   //}
-
-   /* The partial-loads-ok excemption might apply.  Find out if it
-      does.  If so, don't report an addressing error, but do return
-      Undefined for the bytes that are out of range, so as to avoid
-      false negatives.  If it doesn't apply, just report an addressing
-      error in the usual way. */
-
-   /* Some code steps along byte strings in aligned chunks
-      even when there is only a partially defined word at the end (eg,
-      optimised strlen).  This is allowed by the memory model of
-      modern machines, since an aligned load cannot span two pages and
-      thus cannot "partially fault".
-      Therefore, a load from a partially-addressible place is allowed
-      if all of the following hold:
-      - the command-line flag is set [by default, it isn't]
-      - it's an aligned load
-      - at least one of the addresses in the word *is* valid
-      Since this suppresses the addressing error, we avoid false
-      negatives by marking bytes undefined when they come from an
-      invalid address.
-   */
-
-   /* "at least one of the addresses is invalid" */
-   //ok = False;
-   //for (j = 0; j < szL; j++)
-   //   ok |= pessim[j] != V_BITS8_TAINTED; //V_BITS8_UNTAINTED;
-
-   //if (0 == (a & (szB - 1)) && n_addrs_bad < szB) {
-   //   /* Exemption applies.  Use the previously computed pessimising
-   //      value and return the combined result, but don't flag an
-   //      addressing error.  The pessimising value is Defined for valid
-   //      addresses and Undefined for invalid addresses. */
-   //   /* for assumption that doing bitwise or implements UifU */
-   //   tl_assert(V_BIT_TAINTED == 1 && V_BIT_UNTAINTED == 0);
-   //   /* (really need "UifU" here...)
-   //      vbits[j] UifU= pessim[j]  (is pessimised by it, iow) */
-   //   for (j = szL-1; j >= 0; j--)
-   //      res[j] |= pessim[j];
-   //   return;
-   //}
-
-   /* Exemption doesn't apply.  Flag an addressing error in the normal
-      way. */
-   //MC_(record_address_error)( VG_(get_running_tid)(), a, szB, False );
-}
-
 static
 #ifndef PERF_FAST_LOADV
 INLINE
@@ -1121,9 +997,9 @@ ULong tnt_LOADVn_slow ( Addr a, SizeT nBits, Bool bigendian )
       omitted without loss of correctness/functionality.  Note that in
       both cases the "sizeof(void*) == 8" causes these cases to be
       folded out by compilers on 32-bit platforms.  These are derived
-      from LOADV64 and LOADV32.
+      from LOADV64 and LOADV32, and only read the standard shadow format.
    */
-   if (LIKELY(sizeof(void*) == 8
+   if (LIKELY(sizeof(void*) == 8 && !TNT_(clo_shadow_compact)
                       && nBits == 64 && VG_IS_8_ALIGNED(a))) {
       SecMap* sm       = get_secmap_for_reading(a);
       UWord   sm_off16 = SM_OFF_16(a);
@@ -1137,7 +1013,7 @@ ULong tnt_LOADVn_slow ( Addr a, SizeT nBits, Bool bigendian )
          return V_BITS64_TAINTED;
       /* else fall into the slow case */
    }
-   if (LIKELY(sizeof(void*) == 8
+   if (LIKELY(sizeof(void*) == 8 && !TNT_(clo_shadow_compact)
                       && nBits == 32 && VG_IS_4_ALIGNED(a))) {
       SecMap* sm = get_secmap_for_reading(a);
       UWord sm_off = SM_OFF(a);
@@ -1199,6 +1075,27 @@ ULong tnt_LOADVn_slow ( Addr a, SizeT nBits, Bool bigendian )
 }
 
 
+/* 128/256-bit loads that cannot take the fast path in
+   tnt_LOADV_128_or_256: handle the vector one 64-bit lane at a time, so
+   that aligned lanes still go through the semi-fast cases of
+   tnt_LOADVn_slow rather than byte by byte.  res[j] holds the V bits of
+   the 8 bytes at a+8*j. */
+static
+__attribute__((noinline))
+void tnt_LOADV_128_or_256_slow ( /*OUT*/ULong* res,
+                                Addr a, SizeT nBits, Bool bigendian )
+{
+   SizeT szL = nBits / 64;  /* Size in Longs (64-bit units) */
+   SizeT j;
+
+   tl_assert(szL == 2 || szL == 4);
+
+   for (j = 0; j < szL; j++) {
+      PROF_EVENT(31, "tnt_LOADV_128_or_256_slow(loop)");
+      res[j] = tnt_LOADVn_slow( a + 8*j, 64, bigendian );
+   }
+}
+
 static
 #ifndef PERF_FAST_STOREV
 INLINE
@@ -1219,9 +1116,9 @@ void tnt_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
       omitted without loss of correctness/functionality.  Note that in
       both cases the "sizeof(void*) == 8" causes these cases to be
       folded out by compilers on 32-bit platforms.  These are derived
-      from STOREV64 and STOREV32.
+      from STOREV64 and STOREV32, and only write the standard shadow format.
    */
-   if (LIKELY(sizeof(void*) == 8
+   if (LIKELY(sizeof(void*) == 8 && !TNT_(clo_shadow_compact)
                       && nBits == 64 && VG_IS_8_ALIGNED(a))) {
       SecMap* sm       = get_secmap_for_reading(a);
       UWord   sm_off16 = SM_OFF_16(a);
@@ -1249,7 +1146,7 @@ void tnt_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
       }
       /* else fall into the slow case */
    }
-   if (LIKELY(sizeof(void*) == 8
+   if (LIKELY(sizeof(void*) == 8 && !TNT_(clo_shadow_compact)
                       && nBits == 32 && VG_IS_4_ALIGNED(a))) {
       SecMap* sm      = get_secmap_for_reading(a);
       UWord   sm_off  = SM_OFF(a);
@@ -1308,6 +1205,9 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
 {
    UWord    sm_off, sm_off16;
    UWord    vabits2 = vabits16 & 0x3;
+   Bool     compact = TNT_(clo_shadow_compact);
+   UChar    tabits1 = (VA_BITS2_TAINTED == vabits2) ? TA_BITS1_TAINTED : TA_BITS1_UNTAINTED;
+   UChar    tabits8 = (VA_BITS2_TAINTED == vabits2) ? TA_BITS8_TAINTED : TA_BITS8_UNTAINTED;
    SizeT    lenA, lenB, len_to_next_secmap;
    Addr     aNext;
    SecMap*  sm;
@@ -1425,7 +1325,10 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       VG_(printf)("set_address_range_perms(1.1) a:0x%08lx vabits2:0x%lx sm->vabit8[sm_off]:0x%08x\n",
                   a, vabits2, (Int)&(sm->vabits8[sm_off]));
 #endif
-      insert_vabits2_into_vabits8( a, vabits2, &(sm->vabits8[sm_off]) );
+      if (compact)
+         insert_tabits1_into_tabits8( a, tabits1, &(sm->vabits8[SM_OFF_C(a)]) );
+      else
+         insert_vabits2_into_vabits8( a, vabits2, &(sm->vabits8[sm_off]) );
       a    += 1;
       lenA -= 1;
    }
@@ -1440,7 +1343,10 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       VG_(printf)("set_address_range_perms(1.2) sm->vabits8:0x%08x sm_off16:0x%lx vabits16:0x%08lx\n",
                  (Int) ((UShort*)(sm->vabits8)), sm_off16, vabits16);
 #endif
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
+      if (compact)
+         sm->vabits8[SM_OFF_C(a)] = tabits8;
+      else
+         ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
       a    += 8;
       lenA -= 8;
    }
@@ -1455,7 +1361,10 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       VG_(printf)("set_address_range_perms(1.3) a:0x%08lx vabits2:0x%lx sm->vabits8[sm_off]:0x%08x\n",
                   a, vabits2, (Int)&(sm->vabits8[sm_off]));
 #endif
-      insert_vabits2_into_vabits8( a, vabits2, &(sm->vabits8[sm_off]) );
+      if (compact)
+         insert_tabits1_into_tabits8( a, tabits1, &(sm->vabits8[SM_OFF_C(a)]) );
+      else
+         insert_vabits2_into_vabits8( a, vabits2, &(sm->vabits8[sm_off]) );
       a    += 1;
       lenA -= 1;
    }
@@ -1480,7 +1389,8 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
          PROF_EVENT(160, "set_address_range_perms-loop64K-free-dist-sm");
          // Free the non-distinguished sec-map that we're replacing.  This
          // case happens moderately often, enough to be worthwhile.
-         VG_(am_munmap_valgrind)((Addr)*sm_ptr, sizeof(SecMap));
+         VG_(am_munmap_valgrind)((Addr)*sm_ptr, SM_BYTES);
+         drop_sec_vbits_map(a);
       }
       update_SM_counts(*sm_ptr, example_dsm);
       // Make the sec-map entry point to the example DSM
@@ -1518,7 +1428,10 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       if (lenB < 8) break;
       PROF_EVENT(163, "set_address_range_perms-loop8b");
       sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
+      if (compact)
+         sm->vabits8[SM_OFF_C(a)] = tabits8;
+      else
+         ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
       a    += 8;
       lenB -= 8;
    }
@@ -1527,7 +1440,10 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       if (lenB < 1) return;
       PROF_EVENT(164, "set_address_range_perms-loop1c");
       sm_off = SM_OFF(a);
-      insert_vabits2_into_vabits8( a, vabits2, &(sm->vabits8[sm_off]) );
+      if (compact)
+         insert_tabits1_into_tabits8( a, tabits1, &(sm->vabits8[SM_OFF_C(a)]) );
+      else
+         insert_vabits2_into_vabits8( a, vabits2, &(sm->vabits8[sm_off]) );
       a    += 1;
       lenB -= 1;
    }
@@ -1555,6 +1471,12 @@ void TNT_(make_mem_tainted) ( Addr a, SizeT len )//1608
    set_address_range_perms ( a, len, VA_BITS16_TAINTED, SM_DIST_TAINTED );
 //   if (UNLIKELY( TNT_(clo_tnt_level) == 3 ))
 //      ocache_sarp_Clear_Origins ( a, len );
+   #if _SECRETGRIND_
+   // every taint source (read(), mmap(), the client request) ends up here
+   if ( UNLIKELY( TNT_(instr_lazy_pending) ) && len ) {
+      TNT_(end_lazy_instrument)( "make_mem_tainted" );
+   }
+   #endif
 }
 
 void TNT_(make_mem_untainted) ( Addr a, SizeT len )
@@ -1562,6 +1484,7 @@ void TNT_(make_mem_untainted) ( Addr a, SizeT len )
    PROF_EVENT(42, "TNT_(make_mem_untainted)");
 //   DEBUG("TNT_(make_mem_untainted)(%p, %lu)\n", a, len);
    set_address_range_perms ( a, len, VA_BITS16_UNTAINTED, SM_DIST_UNTAINTED );
+   reclaim_range_SMs ( a, len );
 //   if (UNLIKELY( TNT_(clo_tnt_level) == 3 ))
 //      ocache_sarp_Clear_Origins ( a, len );
 }
@@ -1644,10 +1567,38 @@ void TNT_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
    if (len == 0 || src == dst)
       return;
 
+#if _SECRETGRIND_
+   if (TNT_(clo_taint_labels))
+      TNT_(labels_copy)( src, dst, len );
+#endif
+
    aligned   = VG_IS_4_ALIGNED(src) && VG_IS_4_ALIGNED(dst);
    nooverlap = src+len <= dst || dst+len <= src;
 
-   if (nooverlap && aligned) {
+   if (TNT_(clo_shadow_compact) && nooverlap
+       && VG_IS_8_ALIGNED(src) && VG_IS_8_ALIGNED(dst)) {
+
+      /* Compact format: one shadow byte covers 8 bytes, and there is
+         no secondary map info to copy */
+      i = 0;
+      while (len >= 8) {
+         UChar tabits8 = get_secmap_for_reading(src+i)->vabits8[SM_OFF_C(src+i)];
+         SecMap* sm    = get_secmap_for_reading(dst+i);
+         if (sm->vabits8[SM_OFF_C(dst+i)] != tabits8) {
+            sm = get_secmap_for_writing(dst+i);
+            sm->vabits8[SM_OFF_C(dst+i)] = tabits8;
+         }
+         i += 8;
+         len -= 8;
+      }
+      /* fixup loop */
+      while (len >= 1) {
+         set_vabits2( dst+i, get_vabits2( src+i ) );
+         i++;
+         len--;
+      }
+
+   } else if (nooverlap && aligned && !TNT_(clo_shadow_compact)) {
 
       /* Vectorised fast case, when no overlap and suitably aligned */
       /* vector loop */
@@ -1855,89 +1806,366 @@ void tnt_new_mem_mmap ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx,
 /*--- Load/store handlers.                                 ---*/
 /*------------------------------------------------------------*/
 
-/* If any part of '_a' indicated by the mask is 1, either '_a' is not
-   naturally '_sz/8'-aligned, or it exceeds the range covered by the
-   primary map.  This is all very tricky (and important!), so let's
-   work through the maths by hand (below), *and* assert for these
-   values at startup. */
-#define MASK(_szInBytes) \
-   ( ~((0x10000UL-(_szInBytes)) | ((N_PRIMARY_MAP-1) << 16)) )
-
-/* MASK only exists so as to define this macro. */
-#define UNALIGNED_OR_HIGH(_a,_szInBits) \
-   ((_a) & MASK((_szInBits>>3)))
-
-/* ------------------------ Size = 16 ------------------------ */
-
+/* Nonzero if '_a' is not naturally '_sz/8'-aligned.  Addresses above
+   the primary map take the fast cases too: get_secmap_for_reading()
+   finds their secmap in the auxmap radix table, which costs about the
+   same as the primary map. */
+#define UNALIGNED(_a,_szInBits) \
+   ((_a) & (((_szInBits)>>3)-1))
+
+/* --shadow-format=compact: the fast paths of all the load/store helpers
+   below.  An aligned access of up to 8 bytes reads or writes its taint
+   bits with a single shadow byte.  A partially tainted byte is stored as
+   tainted.  Unaligned addresses go to the slow cases, which read and
+   write the compact format through get_vabits2/set_vabits2. */
 static INLINE
-void tnt_LOADV_128_or_256 ( /*OUT*/ULong* res,
-                           Addr a, SizeT nBits, Bool isBigEndian )
+ULong tnt_LOADVn_compact ( Addr a, SizeT nBits, Bool bigendian )
 {
-   PROF_EVENT(200, "tnt_LOADV_128_or_256");
-
-   #if _SECRETGRIND_
-   //TNT_(malloc_update_track_on_load)(a, __FUNCTION__);
-   #endif
+   SizeT   szB  = nBits / 8;
+   UWord   mask = (1UL << szB) - 1;
+   UWord   tabits;
+   ULong   vbits64;
+   SSizeT  i;
+   SecMap* sm;
 
-#ifndef PERF_FAST_LOADV
-   tnt_LOADV_128_or_256_slow( res, a, nBits, isBigEndian );
-   return;
-#else
-   {
-      UWord   sm_off16, vabits16, j;
-      UWord   nBytes  = nBits / 8;
-      UWord   nULongs = nBytes / 8;
-      SecMap* sm;
+   if (UNLIKELY( UNALIGNED(a,nBits) )) {
+      PROF_EVENT(281, "tnt_LOADVn_compact-slow1");
+      return tnt_LOADVn_slow( a, nBits, bigendian );
+   }
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,nBits) )) {
-         PROF_EVENT(201, "tnt_LOADV_128_or_256-slow1");
-         tnt_LOADV_128_or_256_slow( res, a, nBits, isBigEndian );
-         return;
-      }
+   sm     = get_secmap_for_reading(a);
+   tabits = (sm->vabits8[SM_OFF_C(a)] >> SM_SHIFT_C(a)) & mask;
 
-      /* Handle common cases quickly: a (and a+8 and a+16 etc.) is
-         suitably aligned, is mapped, and addressible. */
-      for (j = 0; j < nULongs; j++) {
-         sm       = get_secmap_for_reading_low(a + 8*j);
-         sm_off16 = SM_OFF_16(a + 8*j);
-         vabits16 = ((UShort*)(sm->vabits8))[sm_off16];
+   // Same result as tnt_LOADVn_slow: the bytes above nBits are tainted
+   if (LIKELY(tabits == 0))
+      return nBits == 64 ? V_BITS64_UNTAINTED : V_BITS64_TAINTED << nBits;
+   if (LIKELY(tabits == mask))
+      return V_BITS64_TAINTED;
 
-         // Convert V bits from compact memory form to expanded
-         // register form.
-         if (LIKELY(vabits16 == VA_BITS16_UNTAINTED)) {
-            res[j] = V_BITS64_UNTAINTED;
-         } else if (LIKELY(vabits16 == VA_BITS16_TAINTED)) {
-            res[j] = V_BITS64_TAINTED;
-         } else {
-            /* Slow case: some block of 8 bytes are not all-defined or
-               all-undefined. */
-            PROF_EVENT(202, "tnt_LOADV_128_or_256-slow2");
-            tnt_LOADV_128_or_256_slow( res, a, nBits, isBigEndian );
-            return;
-         }
-      }
-      return;
+   PROF_EVENT(282, "tnt_LOADVn_compact-mixed");
+   vbits64 = V_BITS64_TAINTED;
+   for (i = szB-1; i >= 0; i--) {
+      vbits64 <<= 8;
+      if ((tabits >> byte_offset_w(szB, bigendian, i)) & 1)
+         vbits64 |= V_BITS8_TAINTED;
    }
-#endif
+   return vbits64;
 }
 
-VG_REGPARM(2) void TNT_(helperc_LOADV256be) ( /*OUT*/V256* res, Addr a )
+static INLINE
+void tnt_STOREVn_compact ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
 {
-   tnt_LOADV_128_or_256(&res->w64[0], a, 256, True);
-}
+   SizeT   szB   = nBits / 8;
+   UWord   mask  = (1UL << szB) - 1;
+   ULong   vmask = nBits == 64 ? V_BITS64_TAINTED : ~(V_BITS64_TAINTED << nBits);
+   UWord   tabits, shift;
+   SizeT   i;
+   UChar*  p;
+   SecMap* sm;
+
+   if (UNLIKELY( UNALIGNED(a,nBits) )) {
+      PROF_EVENT(283, "tnt_STOREVn_compact-slow1");
+      tnt_STOREVn_slow( a, nBits, vbytes, bigendian );
+      return;
+   }
+
+   // Convert full V-bits in register to one bit per byte
+   vbytes &= vmask;
+   if (LIKELY(vbytes == 0)) {
+      tabits = 0;
+   } else if (LIKELY(vbytes == vmask)) {
+      tabits = mask;
+   } else {
+      tabits = 0;
+      for (i = 0; i < szB; i++) {
+         if (vbytes & 0xff)
+            tabits |= 1UL << byte_offset_w(szB, bigendian, i);
+         vbytes >>= 8;
+      }
+   }
+
+   // Nothing to write, eg untainted data over untainted memory: this
+   // keeps the distinguished SecMaps shared
+   sm    = get_secmap_for_reading(a);
+   shift = SM_SHIFT_C(a);
+   p     = &sm->vabits8[SM_OFF_C(a)];
+   if (LIKELY( ((*p >> shift) & mask) == tabits ))
+      return;
+
+   if (UNLIKELY( is_distinguished_sm(sm) )) {
+      PROF_EVENT(284, "tnt_STOREVn_compact-dist");
+      sm = get_secmap_for_writing(a);
+      p  = &sm->vabits8[SM_OFF_C(a)];
+   }
+   *p = (*p & ~(mask << shift)) | (tabits << shift);
+}
+
+#if _SECRETGRIND_
+/* --inline-fast-path=yes: tnt_translate.c emits the aligned, low-address
+   common case of the helpers below as IR, using the layout given here.
+   What it cannot handle (unaligned or high addresses, mixed vabits,
+   partially tainted data, writes to distinguished secondaries) is passed
+   on to the _slow helpers, which go straight to tnt_LOADVn_slow /
+   tnt_STOREVn_slow. */
+void TNT_(get_shadow_layout) ( ShadowLayout* sl )
+{
+   sl->primary_map   = (Addr)&primary_map[0];
+   sl->n_primary_map = N_PRIMARY_MAP;
+   sl->dist_sm_lo    = (Addr)&sm_distinguished[0];
+   sl->dist_sm_hi    = (Addr)&sm_distinguished[2];
+}
+
+VG_REGPARM(1) ULong TNT_(helperc_LOADV64be_slow) ( Addr a )
+{
+   PROF_EVENT(203, "tnt_LOADV64-slow-inline");
+   return tnt_LOADVn_slow( a, 64, True );
+}
+VG_REGPARM(1) ULong TNT_(helperc_LOADV64le_slow) ( Addr a )
+{
+   PROF_EVENT(203, "tnt_LOADV64-slow-inline");
+   return tnt_LOADVn_slow( a, 64, False );
+}
+VG_REGPARM(1) UWord TNT_(helperc_LOADV32be_slow) ( Addr a )
+{
+   PROF_EVENT(223, "tnt_LOADV32-slow-inline");
+   return (UWord)tnt_LOADVn_slow( a, 32, True );
+}
+VG_REGPARM(1) UWord TNT_(helperc_LOADV32le_slow) ( Addr a )
+{
+   PROF_EVENT(223, "tnt_LOADV32-slow-inline");
+   return (UWord)tnt_LOADVn_slow( a, 32, False );
+}
+VG_REGPARM(1) UWord TNT_(helperc_LOADV16be_slow) ( Addr a )
+{
+   PROF_EVENT(243, "tnt_LOADV16-slow-inline");
+   return (UWord)tnt_LOADVn_slow( a, 16, True );
+}
+VG_REGPARM(1) UWord TNT_(helperc_LOADV16le_slow) ( Addr a )
+{
+   PROF_EVENT(243, "tnt_LOADV16-slow-inline");
+   return (UWord)tnt_LOADVn_slow( a, 16, False );
+}
+VG_REGPARM(1) UWord TNT_(helperc_LOADV8_slow) ( Addr a )
+{
+   PROF_EVENT(263, "tnt_LOADV8-slow-inline");
+   return (UWord)tnt_LOADVn_slow( a, 8, False/*irrelevant*/ );
+}
+
+VG_REGPARM(1) void TNT_(helperc_STOREV64be_slow) ( Addr a, ULong vbits64 )
+{
+   PROF_EVENT(214, "tnt_STOREV64-slow-inline");
+   tnt_STOREVn_slow( a, 64, vbits64, True );
+}
+VG_REGPARM(1) void TNT_(helperc_STOREV64le_slow) ( Addr a, ULong vbits64 )
+{
+   PROF_EVENT(214, "tnt_STOREV64-slow-inline");
+   tnt_STOREVn_slow( a, 64, vbits64, False );
+}
+VG_REGPARM(2) void TNT_(helperc_STOREV32be_slow) ( Addr a, UWord vbits32 )
+{
+   PROF_EVENT(235, "tnt_STOREV32-slow-inline");
+   tnt_STOREVn_slow( a, 32, (ULong)vbits32, True );
+}
+VG_REGPARM(2) void TNT_(helperc_STOREV32le_slow) ( Addr a, UWord vbits32 )
+{
+   PROF_EVENT(235, "tnt_STOREV32-slow-inline");
+   tnt_STOREVn_slow( a, 32, (ULong)vbits32, False );
+}
+VG_REGPARM(2) void TNT_(helperc_STOREV16be_slow) ( Addr a, UWord vbits16 )
+{
+   PROF_EVENT(254, "tnt_STOREV16-slow-inline");
+   tnt_STOREVn_slow( a, 16, (ULong)vbits16, True );
+}
+VG_REGPARM(2) void TNT_(helperc_STOREV16le_slow) ( Addr a, UWord vbits16 )
+{
+   PROF_EVENT(254, "tnt_STOREV16-slow-inline");
+   tnt_STOREVn_slow( a, 16, (ULong)vbits16, False );
+}
+VG_REGPARM(2) void TNT_(helperc_STOREV8_slow) ( Addr a, UWord vbits8 )
+{
+   PROF_EVENT(274, "tnt_STOREV8-slow-inline");
+   tnt_STOREVn_slow( a, 8, (ULong)vbits8, False/*irrelevant*/ );
+}
+#endif // _SECRETGRIND_
+
+/* ------------------------ Size = 16 ------------------------ */
+
+static INLINE
+void tnt_LOADV_128_or_256 ( /*OUT*/ULong* res,
+                           Addr a, SizeT nBits, Bool isBigEndian )
+{
+   PROF_EVENT(200, "tnt_LOADV_128_or_256");
+
+   #if _SECRETGRIND_
+   //TNT_(malloc_update_track_on_load)(a, __FUNCTION__);
+   #endif
+
+#ifndef PERF_FAST_LOADV
+   tnt_LOADV_128_or_256_slow( res, a, nBits, isBigEndian );
+   return;
+#else
+   if (TNT_(clo_shadow_compact)) {
+      UWord j;
+      for (j = 0; j < nBits / 64; j++)
+         res[j] = tnt_LOADVn_compact( a + 8*j, 64, isBigEndian );
+      return;
+   }
+   {
+      UWord   vabits16, j;
+      UWord   nULongs = nBits / 64;
+      UShort* vabits16s;
+      SecMap* sm;
+
+      if (UNLIKELY( UNALIGNED(a,nBits) )) {
+         PROF_EVENT(201, "tnt_LOADV_128_or_256-slow1");
+         tnt_LOADV_128_or_256_slow( res, a, nBits, isBigEndian );
+         return;
+      }
+
+      /* Handle common cases quickly: a is aligned to the access size,
+         so all the lanes live in the same SecMap and it only needs
+         looking up once.  A lane whose 8 bytes are not all tainted or
+         all untainted is handed to tnt_LOADVn_slow on its own. */
+      sm        = get_secmap_for_reading(a);
+      vabits16s = &((UShort*)(sm->vabits8))[SM_OFF_16(a)];
+      for (j = 0; j < nULongs; j++) {
+         vabits16 = vabits16s[j];
+
+         // Convert V bits from compact memory form to expanded
+         // register form.
+         if (LIKELY(vabits16 == VA_BITS16_UNTAINTED)) {
+            res[j] = V_BITS64_UNTAINTED;
+         } else if (LIKELY(vabits16 == VA_BITS16_TAINTED)) {
+            res[j] = V_BITS64_TAINTED;
+         } else {
+            PROF_EVENT(202, "tnt_LOADV_128_or_256-slow2");
+            res[j] = tnt_LOADVn_slow( a + 8*j, 64, isBigEndian );
+         }
+      }
+      return;
+   }
+#endif
+}
+
+VG_REGPARM(2) void TNT_(helperc_LOADV256be) ( /*OUT*/V256* res, Addr a )
+{
+   tnt_LOADV_128_or_256(&res->w64[0], a, 256, True);
+   LABELS_ON_LOAD(a, 32, res->w64[0] | res->w64[1] | res->w64[2] | res->w64[3]);
+}
 VG_REGPARM(2) void TNT_(helperc_LOADV256le) ( /*OUT*/V256* res, Addr a )
 {
    tnt_LOADV_128_or_256(&res->w64[0], a, 256, False);
+   LABELS_ON_LOAD(a, 32, res->w64[0] | res->w64[1] | res->w64[2] | res->w64[3]);
 }
 
 VG_REGPARM(2) void TNT_(helperc_LOADV128be) ( /*OUT*/V128* res, Addr a )
 {
    tnt_LOADV_128_or_256(&res->w64[0], a, 128, True);
+   LABELS_ON_LOAD(a, 16, res->w64[0] | res->w64[1]);
 }
 
 VG_REGPARM(2) void TNT_(helperc_LOADV128le) ( /*OUT*/V128* res, Addr a )
 {
    tnt_LOADV_128_or_256(&res->w64[0], a, 128, False);
+   LABELS_ON_LOAD(a, 16, res->w64[0] | res->w64[1]);
+}
+
+/* vbits[j] holds the V bits for the 8 bytes at a+8*j, whatever the
+   endianness; the helpers below put the lanes in that order. */
+static INLINE
+void tnt_STOREV_128_or_256 ( Addr a, const ULong* vbits,
+                            SizeT nBits, Bool isBigEndian )
+{
+   UWord j;
+   UWord nULongs = nBits / 64;
+
+   PROF_EVENT(205, "tnt_STOREV_128_or_256");
+
+#ifndef PERF_FAST_STOREV
+   for (j = 0; j < nULongs; j++)
+      tnt_STOREVn_slow( a + 8*j, 64, vbits[j], isBigEndian );
+#else
+   if (TNT_(clo_shadow_compact)) {
+      for (j = 0; j < nULongs; j++)
+         tnt_STOREVn_compact( a + 8*j, 64, vbits[j], isBigEndian );
+      return;
+   }
+   {
+      UWord   vabits16;
+      UShort* vabits16s;
+      SecMap* sm;
+
+      if (UNLIKELY( UNALIGNED(a,nBits) )) {
+         PROF_EVENT(206, "tnt_STOREV_128_or_256-slow1");
+         for (j = 0; j < nULongs; j++)
+            tnt_STOREVn_slow( a + 8*j, 64, vbits[j], isBigEndian );
+         return;
+      }
+
+      /* As for loads, a is aligned to the access size so the whole
+         vector lives in one SecMap.  Lanes whose shadow is unchanged
+         are skipped, which also keeps the distinguished SecMaps
+         shared when untainted data is written over untainted memory. */
+      sm        = get_secmap_for_reading(a);
+      vabits16s = &((UShort*)(sm->vabits8))[SM_OFF_16(a)];
+      for (j = 0; j < nULongs; j++) {
+         vabits16 = vabits16s[j];
+
+         // Convert full V-bits in register to compact 2-bit form.
+         if (LIKELY(V_BITS64_UNTAINTED == vbits[j])) {
+            if (LIKELY(vabits16 == VA_BITS16_UNTAINTED)) continue;
+            if (LIKELY( !is_distinguished_sm(sm) &&
+                        VA_BITS16_TAINTED == vabits16 )) {
+               vabits16s[j] = (UShort)VA_BITS16_UNTAINTED;
+               continue;
+            }
+         } else if (V_BITS64_TAINTED == vbits[j]) {
+            if (vabits16 == VA_BITS16_TAINTED) continue;
+            if (LIKELY( !is_distinguished_sm(sm) &&
+                        VA_BITS16_UNTAINTED == vabits16 )) {
+               vabits16s[j] = (UShort)VA_BITS16_TAINTED;
+               continue;
+            }
+         }
+
+         /* Slow but general case -- partially tainted lane, mixed
+            shadow or distinguished SecMap.  The latter gets replaced
+            by a private copy, so look it up again afterwards. */
+         PROF_EVENT(207, "tnt_STOREV_128_or_256-slow2");
+         tnt_STOREVn_slow( a + 8*j, 64, vbits[j], isBigEndian );
+         sm        = get_secmap_for_reading(a);
+         vabits16s = &((UShort*)(sm->vabits8))[SM_OFF_16(a)];
+      }
+   }
+#endif
+}
+
+VG_REGPARM(1) void TNT_(helperc_STOREV256be) ( Addr a, ULong vbitsQ0, ULong vbitsQ1,
+                                                ULong vbitsQ2, ULong vbitsQ3 )
+{
+   ULong vbits[4] = { vbitsQ3, vbitsQ2, vbitsQ1, vbitsQ0 };
+   LABELS_ON_STORE(a, 32, vbits[0] | vbits[1] | vbits[2] | vbits[3]);
+   tnt_STOREV_128_or_256(a, vbits, 256, True);
+}
+VG_REGPARM(1) void TNT_(helperc_STOREV256le) ( Addr a, ULong vbitsQ0, ULong vbitsQ1,
+                                                ULong vbitsQ2, ULong vbitsQ3 )
+{
+   ULong vbits[4] = { vbitsQ0, vbitsQ1, vbitsQ2, vbitsQ3 };
+   LABELS_ON_STORE(a, 32, vbits[0] | vbits[1] | vbits[2] | vbits[3]);
+   tnt_STOREV_128_or_256(a, vbits, 256, False);
+}
+
+VG_REGPARM(1) void TNT_(helperc_STOREV128be) ( Addr a, ULong vbitsLo64, ULong vbitsHi64 )
+{
+   ULong vbits[2] = { vbitsHi64, vbitsLo64 };
+   LABELS_ON_STORE(a, 16, vbits[0] | vbits[1]);
+   tnt_STOREV_128_or_256(a, vbits, 128, True);
+}
+VG_REGPARM(1) void TNT_(helperc_STOREV128le) ( Addr a, ULong vbitsLo64, ULong vbitsHi64 )
+{
+   ULong vbits[2] = { vbitsLo64, vbitsHi64 };
+   LABELS_ON_STORE(a, 16, vbits[0] | vbits[1]);
+   tnt_STOREV_128_or_256(a, vbits, 128, False);
 }
 
 /* ------------------------ Size = 8 ------------------------ */
@@ -1957,16 +2185,18 @@ ULong tnt_LOADV64 ( Addr a, Bool isBigEndian )
 #ifndef PERF_FAST_LOADV
    return tnt_LOADVn_slow( a, 64, isBigEndian );
 #else
+   if (TNT_(clo_shadow_compact))
+      return tnt_LOADVn_compact( a, 64, isBigEndian );
    {
       UWord   sm_off16, vabits16;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,64) )) {
+      if (UNLIKELY( UNALIGNED(a,64) )) {
          PROF_EVENT(201, "tnt_LOADV64-slow1");
          return (ULong)tnt_LOADVn_slow( a, 64, isBigEndian );
       }
 
-      sm       = get_secmap_for_reading_low(a);
+      sm       = get_secmap_for_reading(a);
       sm_off16 = SM_OFF_16(a);
       vabits16 = ((UShort*)(sm->vabits8))[sm_off16];
 
@@ -1987,9 +2217,14 @@ ULong tnt_LOADV64 ( Addr a, Bool isBigEndian )
 }
 
 #if _SECRETGRIND_
+/* The _extended loads implement pointer-arithmetic propagation: a load
+   through a tainted address returns the address taint.  They are only
+   used without --taint-df-only, see expr2vbits_Load_WRK, so they do not
+   test the option themselves; direct-flow-only loads use the plain
+   helpers. */
 VG_REGPARM(1) ULong TNT_(helperc_LOADV64be_extended) ( Addr a, ULong taint )
 {
-	if ( !TNT_(clo_taint_df_only) && taint ) { LOG("helperc_LOADV64be_extended addr 0x%lx taint:%llx\n", a, taint); return taint;}
+	if ( taint ) { LOG("helperc_LOADV64be_extended addr 0x%lx taint:%llx\n", a, taint); return taint;}
 	return TNT_(helperc_LOADV64be)(a);
 }
 
@@ -1997,14 +2232,16 @@ VG_REGPARM(1) ULong TNT_(helperc_LOADV64be_extended) ( Addr a, ULong taint )
 
 VG_REGPARM(1) ULong TNT_(helperc_LOADV64be) ( Addr a )
 {
-   return tnt_LOADV64(a, True);
+   ULong result = tnt_LOADV64(a, True);
+   LABELS_ON_LOAD(a, 8, result);
+   return result;
 }
 
 
 #if _SECRETGRIND_
 VG_REGPARM(1) ULong TNT_(helperc_LOADV64le_extended) ( Addr a, ULong taint )
 {
-	if ( !TNT_(clo_taint_df_only) && taint ) { LOG("helperc_LOADV64le_extended addr 0x%lx taint:%llx\n", a, taint); return taint;}
+	if ( taint ) { LOG("helperc_LOADV64le_extended addr 0x%lx taint:%llx\n", a, taint); return taint;}
 	return TNT_(helperc_LOADV64le)(a);
 }
 
@@ -2023,6 +2260,7 @@ VG_REGPARM(1) ULong TNT_(helperc_LOADV64le) ( Addr a )
 //      VG_(printf)("TNT_(helperc_LOADV64le) 64 0x%08lx\n", a);
 #endif
 
+   LABELS_ON_LOAD(a, 8, result);
    return result;
 //   return tnt_LOADV64(a, False);
 }
@@ -2038,11 +2276,15 @@ void tnt_STOREV64 ( Addr a, ULong vbits64, Bool isBigEndian )
    // Investigate further.
    tnt_STOREVn_slow( a, 64, vbits64, isBigEndian );
 #else
+   if (TNT_(clo_shadow_compact)) {
+      tnt_STOREVn_compact( a, 64, vbits64, isBigEndian );
+      return;
+   }
    {
       UWord   sm_off16, vabits16;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,64) )) {
+      if (UNLIKELY( UNALIGNED(a,64) )) {
          PROF_EVENT(211, "tnt_STOREV64-slow1");
 #ifdef DBG_STORE
          VG_(printf)("tnt_STOREV64 unlikely 0x%lx 0x%lx\n", a, vbits64);
@@ -2054,7 +2296,7 @@ void tnt_STOREV64 ( Addr a, ULong vbits64, Bool isBigEndian )
       VG_(printf)("tnt_STOREV64 0x%08lx 0x%lx\n", a, vbits64);
 #endif
 
-      sm       = get_secmap_for_reading_low(a);
+      sm       = get_secmap_for_reading(a);
       sm_off16 = SM_OFF_16(a);
       vabits16 = ((UShort*)(sm->vabits8))[sm_off16];
 
@@ -2105,6 +2347,7 @@ VG_REGPARM(1) void TNT_(helperc_STOREV64be) ( Addr a, ULong vbits64 )
 	//}
 	#endif
 	
+   LABELS_ON_STORE(a, 8, vbits64);
    tnt_STOREV64(a, vbits64, True);
 }
 VG_REGPARM(1) void TNT_(helperc_STOREV64le) ( Addr a, ULong vbits64 )
@@ -2124,6 +2367,7 @@ VG_REGPARM(1) void TNT_(helperc_STOREV64le) ( Addr a, ULong vbits64 )
 	//}
 	#endif
 	
+   LABELS_ON_STORE(a, 8, vbits64);
    tnt_STOREV64(a, vbits64, False);
 }
 
@@ -2142,16 +2386,18 @@ UWord tnt_LOADV32 ( Addr a, Bool isBigEndian )
 #ifndef PERF_FAST_LOADV
    return (UWord)tnt_LOADVn_slow( a, 32, isBigEndian );
 #else
+   if (TNT_(clo_shadow_compact))
+      return (UWord)tnt_LOADVn_compact( a, 32, isBigEndian );
    {
       UWord   sm_off, vabits8;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,32) )) {
+      if (UNLIKELY( UNALIGNED(a,32) )) {
          PROF_EVENT(221, "tnt_LOADV32-slow1");
          return (UWord)tnt_LOADVn_slow( a, 32, isBigEndian );
       }
 
-      sm      = get_secmap_for_reading_low(a);
+      sm      = get_secmap_for_reading(a);
       sm_off  = SM_OFF(a);
       vabits8 = sm->vabits8[sm_off];
 
@@ -2174,9 +2420,9 @@ UWord tnt_LOADV32 ( Addr a, Bool isBigEndian )
 }
 
 #if _SECRETGRIND_
-VG_REGPARM(1) UWord TNT_(helperc_LOADV32be_extended) ( Addr a, UWord taint )
+VG_REGPARM(2) UWord TNT_(helperc_LOADV32be_extended) ( Addr a, UWord taint )
 {
-	if ( !TNT_(clo_taint_df_only) && taint ) { LOG("helperc_LOADV32be_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
+	if ( taint ) { LOG("helperc_LOADV32be_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
 	return TNT_(helperc_LOADV32be)(a);
 }
 
@@ -2194,14 +2440,15 @@ VG_REGPARM(1) UWord TNT_(helperc_LOADV32be) ( Addr a )
 //      VG_(printf)("TNT_(helperc_LOADV32be) 32 0x%08lx\n", a);
 #endif
 
+   LABELS_ON_LOAD(a, 4, (UInt)result);
    return result;
 //   return tnt_LOADV32(a, True);
 }
 
 #if _SECRETGRIND_
-VG_REGPARM(1) UWord TNT_(helperc_LOADV32le_extended) ( Addr a, UWord taint )
+VG_REGPARM(2) UWord TNT_(helperc_LOADV32le_extended) ( Addr a, UWord taint )
 {
-	if ( !TNT_(clo_taint_df_only) && taint ) { LOG("helperc_LOADV32le_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
+	if ( taint ) { LOG("helperc_LOADV32le_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
 	return TNT_(helperc_LOADV32le)(a);
 }
 
@@ -2220,6 +2467,7 @@ VG_REGPARM(1) UWord TNT_(helperc_LOADV32le) ( Addr a )
 //      VG_(printf)("TNT_(helperc_LOADV32le) 32 0x%08lx\n", a);
 #endif
 
+   LABELS_ON_LOAD(a, 4, (UInt)result);
    return result;
 //   return tnt_LOADV32(a, False);
 }
@@ -2234,17 +2482,21 @@ void tnt_STOREV32 ( Addr a, UWord vbits32, Bool isBigEndian )
 #ifndef PERF_FAST_STOREV
    tnt_STOREVn_slow( a, 32, (ULong)vbits32, isBigEndian );
 #else
+   if (TNT_(clo_shadow_compact)) {
+      tnt_STOREVn_compact( a, 32, (ULong)vbits32, isBigEndian );
+      return;
+   }
    {
       UWord   sm_off, vabits8;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,32) )) {
+      if (UNLIKELY( UNALIGNED(a,32) )) {
          PROF_EVENT(231, "tnt_STOREV32-slow1");
          tnt_STOREVn_slow( a, 32, (ULong)vbits32, isBigEndian );
          return;
       }
 
-      sm      = get_secmap_for_reading_low(a);
+      sm      = get_secmap_for_reading(a);
       sm_off  = SM_OFF(a);
       vabits8 = sm->vabits8[sm_off];
 
@@ -2297,6 +2549,7 @@ VG_REGPARM(2) void TNT_(helperc_STOREV32be) ( Addr a, UWord vbits32 )
 	//	vbits32 = 0x0; // remove taint
 	//}
 	#endif
+   LABELS_ON_STORE(a, 4, (UInt)vbits32);
    tnt_STOREV32(a, vbits32, True);
 }
 
@@ -2317,6 +2570,7 @@ VG_REGPARM(2) void TNT_(helperc_STOREV32le) ( Addr a, UWord vbits32 )
 	//	vbits32 = 0x0; // remove taint
 	//}
 	#endif
+   LABELS_ON_STORE(a, 4, (UInt)vbits32);
    tnt_STOREV32(a, vbits32, False);
 }
 
@@ -2336,16 +2590,18 @@ UWord tnt_LOADV16 ( Addr a, Bool isBigEndian )
 #ifndef PERF_FAST_LOADV
    return (UWord)tnt_LOADVn_slow( a, 16, isBigEndian );
 #else
+   if (TNT_(clo_shadow_compact))
+      return (UWord)tnt_LOADVn_compact( a, 16, isBigEndian );
    {
       UWord   sm_off, vabits8;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,16) )) {
+      if (UNLIKELY( UNALIGNED(a,16) )) {
          PROF_EVENT(241, "tnt_LOADV16-slow1");
          return (UWord)tnt_LOADVn_slow( a, 16, isBigEndian );
       }
 
-      sm      = get_secmap_for_reading_low(a);
+      sm      = get_secmap_for_reading(a);
       sm_off  = SM_OFF(a);
       vabits8 = sm->vabits8[sm_off];
       // Handle common case quickly: a is suitably aligned, is mapped, and is
@@ -2370,9 +2626,9 @@ UWord tnt_LOADV16 ( Addr a, Bool isBigEndian )
 }
 
 #if _SECRETGRIND_
-VG_REGPARM(1) UWord TNT_(helperc_LOADV16be_extended) ( Addr a, UWord taint )
+VG_REGPARM(2) UWord TNT_(helperc_LOADV16be_extended) ( Addr a, UWord taint )
 {
-	if ( !TNT_(clo_taint_df_only) && taint ) { LOG("helperc_LOADV16be_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
+	if ( taint ) { LOG("helperc_LOADV16be_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
 	return TNT_(helperc_LOADV16be)(a);
 }
 
@@ -2380,13 +2636,15 @@ VG_REGPARM(1) UWord TNT_(helperc_LOADV16be_extended) ( Addr a, UWord taint )
 
 VG_REGPARM(1) UWord TNT_(helperc_LOADV16be) ( Addr a )
 {
-   return tnt_LOADV16(a, True);
+   UWord result = tnt_LOADV16(a, True);
+   LABELS_ON_LOAD(a, 2, result & 0xffff);
+   return result;
 }
 
 #if _SECRETGRIND_
-VG_REGPARM(1) UWord TNT_(helperc_LOADV16le_extended) ( Addr a, UWord taint )
+VG_REGPARM(2) UWord TNT_(helperc_LOADV16le_extended) ( Addr a, UWord taint )
 {
-	if ( !TNT_(clo_taint_df_only) && taint ) { LOG("helperc_LOADV16le_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
+	if ( taint ) { LOG("helperc_LOADV16le_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
 	return TNT_(helperc_LOADV16le)(a);
 }
 
@@ -2405,6 +2663,7 @@ VG_REGPARM(1) UWord TNT_(helperc_LOADV16le) ( Addr a )
 //      VG_(printf)("TNT_(helperc_LOADV16le) 16 0x%08lx\n", a);
 #endif
 
+   LABELS_ON_LOAD(a, 2, result & 0xffff);
    return result;
 //   return tnt_LOADV16(a, False);
 }
@@ -2419,17 +2678,21 @@ void tnt_STOREV16 ( Addr a, UWord vbits16, Bool isBigEndian )
 #ifndef PERF_FAST_STOREV
    tnt_STOREVn_slow( a, 16, (ULong)vbits16, isBigEndian );
 #else
+   if (TNT_(clo_shadow_compact)) {
+      tnt_STOREVn_compact( a, 16, (ULong)vbits16, isBigEndian );
+      return;
+   }
    {
       UWord   sm_off, vabits8;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,16) )) {
+      if (UNLIKELY( UNALIGNED(a,16) )) {
          PROF_EVENT(251, "tnt_STOREV16-slow1");
          tnt_STOREVn_slow( a, 16, (ULong)vbits16, isBigEndian );
          return;
       }
 
-      sm      = get_secmap_for_reading_low(a);
+      sm      = get_secmap_for_reading(a);
       sm_off  = SM_OFF(a);
       vabits8 = sm->vabits8[sm_off];
       if (LIKELY( !is_distinguished_sm(sm) &&
@@ -2476,6 +2739,7 @@ VG_REGPARM(2) void TNT_(helperc_STOREV16be) ( Addr a, UWord vbits16 )
 	//}
 	#endif
 	
+   LABELS_ON_STORE(a, 2, vbits16 & 0xffff);
    tnt_STOREV16(a, vbits16, True);
 }
 VG_REGPARM(2) void TNT_(helperc_STOREV16le) ( Addr a, UWord vbits16 )
@@ -2494,6 +2758,7 @@ VG_REGPARM(2) void TNT_(helperc_STOREV16le) ( Addr a, UWord vbits16 )
 	//	vbits16 = 0x0; // remove taint
 	//}
 	#endif
+   LABELS_ON_STORE(a, 2, vbits16 & 0xffff);
    tnt_STOREV16(a, vbits16, False);
 }
 
@@ -2501,16 +2766,16 @@ VG_REGPARM(2) void TNT_(helperc_STOREV16le) ( Addr a, UWord vbits16 )
 /* ------------------------ Size = 1 ------------------------ */
 /* Note: endianness is irrelevant for size == 1 */
 #if _SECRETGRIND_
-VG_REGPARM(1)
+VG_REGPARM(2)
 UWord TNT_(helperc_LOADV8_extended) ( Addr a, UWord taint )
 { 
-	if ( !TNT_(clo_taint_df_only) && taint ) { LOG("helperc_LOADV8_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
+	if ( taint ) { LOG("helperc_LOADV8_extended addr 0x%lx taint:%lx\n", a, taint); return taint;}
 	return TNT_(helperc_LOADV8)(a);
 }
 #endif
 
-VG_REGPARM(1)
-UWord TNT_(helperc_LOADV8) ( Addr a )
+static INLINE
+UWord tnt_LOADV8 ( Addr a )
 { 
    PROF_EVENT(260, "tnt_LOADV8");
    
@@ -2523,16 +2788,18 @@ UWord TNT_(helperc_LOADV8) ( Addr a )
 #ifndef PERF_FAST_LOADV
    return (UWord)tnt_LOADVn_slow( a, 8, False/*irrelevant*/ );
 #else
+   if (TNT_(clo_shadow_compact))
+      return (UWord)tnt_LOADVn_compact( a, 8, False/*irrelevant*/ );
    {
       UWord   sm_off, vabits8;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,8) )) {
+      if (UNLIKELY( UNALIGNED(a,8) )) {
          PROF_EVENT(261, "tnt_LOADV8-slow1");
          return (UWord)tnt_LOADVn_slow( a, 8, False/*irrelevant*/ );
       }
 
-      sm      = get_secmap_for_reading_low(a);
+      sm      = get_secmap_for_reading(a);
       sm_off  = SM_OFF(a);
       vabits8 = sm->vabits8[sm_off];
       // Convert V bits from compact memory form to expanded register form
@@ -2572,6 +2839,14 @@ UWord TNT_(helperc_LOADV8) ( Addr a )
 #endif
 }
 
+VG_REGPARM(1)
+UWord TNT_(helperc_LOADV8) ( Addr a )
+{
+   UWord result = tnt_LOADV8(a);
+   LABELS_ON_LOAD(a, 1, result & 0xff);
+   return result;
+}
+
 
 VG_REGPARM(2)
 void TNT_(helperc_STOREV8) ( Addr a, UWord vbits8 )
@@ -2586,21 +2861,26 @@ void TNT_(helperc_STOREV8) ( Addr a, UWord vbits8 )
 #endif
 	
    PROF_EVENT(270, "tnt_STOREV8");
+   LABELS_ON_STORE(a, 1, vbits8 & 0xff);
 
 #ifndef PERF_FAST_STOREV
    tnt_STOREVn_slow( a, 8, (ULong)vbits8, False/*irrelevant*/ );
 #else
+   if (TNT_(clo_shadow_compact)) {
+      tnt_STOREVn_compact( a, 8, (ULong)vbits8, False/*irrelevant*/ );
+      return;
+   }
    {
       UWord   sm_off, vabits8;
       SecMap* sm;
 
-      if (UNLIKELY( UNALIGNED_OR_HIGH(a,8) )) {
+      if (UNLIKELY( UNALIGNED(a,8) )) {
          PROF_EVENT(271, "tnt_STOREV8-slow1");
          tnt_STOREVn_slow( a, 8, (ULong)vbits8, False/*irrelevant*/ );
          return;
       }
 
-      sm      = get_secmap_for_reading_low(a);
+      sm      = get_secmap_for_reading(a);
       sm_off  = SM_OFF(a);
       vabits8 = sm->vabits8[sm_off];
       if (LIKELY
@@ -2736,16 +3016,74 @@ Int atoi( HChar *s ){
 // tmp variables go from t0, t1, t2,..., t255
 // reg variables go from r0, r4, r8,..., r320
 // see libvex_guest_amd64.h
-#define TI_MAX 1024
+// Note: tnt_translate.c refreshes ti/tv inline
 #define RI_MAX 740 
-// These arrays are initialised to 0 in TNT_(clo_post_init)
+// Tmp variables are per thread and per superblock, so each thread has its own table,
+// grown to the largest tyenv TNT_(instrument) has seen (ti_max). ti/tv point to the
+// table of the thread currently running, see tnt_start_client_code()
+#define TI_INIT 1024
+typedef 
+	struct {
+		UInt  *ti;
+		ULong *tv;
+		UInt  size;
+	}
+	TmpTable;
+static TmpTable tmp_tables[VG_N_THREADS];
+static ThreadId tmp_table_tid = VG_INVALID_THREADID;
+UInt  ti_max = TI_INIT;
 // Tmp variable indices; the MSB indicates whether it's tainted (1) or not (0)
-UInt  ti[TI_MAX];
+UInt  *ti = NULL;
 // Tmp variable values
-ULong tv[TI_MAX];
+ULong *tv = NULL;
 // Reg variable indices; values are obtained in real-time
 UInt  ri[RI_MAX];
 
+static void tmp_table_switch( ThreadId tid ) {
+   TmpTable *tt;
+
+   tl_assert( tid < VG_N_THREADS );
+   tt = &tmp_tables[tid];
+   if ( tt->size < ti_max ) {
+      tt->ti = VG_(realloc)( "tnt.tmp_table_switch.1", tt->ti, ti_max * sizeof(UInt) );
+      tt->tv = VG_(realloc)( "tnt.tmp_table_switch.2", tt->tv, ti_max * sizeof(ULong) );
+      VG_(memset)( tt->ti + tt->size, 0, (ti_max - tt->size) * sizeof(UInt) );
+      VG_(memset)( tt->tv + tt->size, 0, (ti_max - tt->size) * sizeof(ULong) );
+      tt->size = ti_max;
+   }
+   ti = tt->ti;
+   tv = tt->tv;
+   tmp_table_tid = tid;
+}
+
+// make room for n tmps. Called at translation time, ie never while a helper runs.
+// Only the running thread's table is grown now, the others on their next time slice
+void TNT_(tmp_table_reserve)( UInt n ) {
+   if ( LIKELY( n <= ti_max ) ) { return; }
+   ti_max = VG_ROUNDUP( n, TI_INIT );
+   if ( tmp_table_tid != VG_INVALID_THREADID ) { tmp_table_switch( tmp_table_tid ); }
+}
+
+static void tnt_start_client_code( ThreadId tid, ULong bbs_done ) {
+   if ( tid != tmp_table_tid || tmp_tables[tid].size < ti_max ) { tmp_table_switch( tid ); }
+   maybe_reclaim_all_SMs();
+#if _SECRETGRIND_
+   TNT_(tier_promote_pending)();
+#endif
+}
+
+static void tmp_table_release( void ) {
+   ThreadId tid;
+   for ( tid = 0; tid < VG_N_THREADS; ++tid ) {
+      if ( tmp_tables[tid].size ) {
+         VG_(free)( tmp_tables[tid].ti );
+         VG_(free)( tmp_tables[tid].tv );
+      }
+   }
+   VG_(memset)( tmp_tables, 0, sizeof(tmp_tables) );
+   ti = NULL; tv = NULL; tmp_table_tid = VG_INVALID_THREADID;
+}
+
 
 struct   myStringArray lvar_s;
 int      lvar_i[STACK_SIZE];
@@ -2789,7 +3127,7 @@ Int get_and_check_reg( HChar *reg ){
 Int get_and_check_tvar( HChar *tmp ){
 
    Int tmpnum = atoi( tmp );
-   tl_assert( tmpnum < TI_MAX );
+   tl_assert( tmpnum < ti_max );
    return tmpnum;
 }
 
@@ -2811,6 +3149,196 @@ void infer_client_binary_name(UInt pc) {
 }
 #endif
 
+#if _SECRETGRIND_
+/* --event-buffer=yes. The buffer only holds the events of the superblock
+   being run: the instrumented code flushes it before leaving, so there is
+   nothing pending when the thread changes.  Slots left behind by a
+   superblock interrupted by a fault are overwritten before being read.
+   A replayed helper only gets the PC of its instruction back: the SP and
+   memory are those of the end of the superblock, hence the options that
+   depend on them are refused in tnt_post_clo_init(). */
+Event_t TNT_(events)[EVENT_BUF_SIZE];
+
+static Bool  events_replaying = False;
+static Addr  events_pc = 0;
+static ULong n_events_replayed = 0;
+static ULong n_event_flushes = 0;
+
+typedef VG_REGPARM(3) void (*event_fn_t) ( HWord, HWord, HWord );
+
+VG_REGPARM(1) void TNT_(flush_events) ( HWord n )
+{
+	HWord i;
+
+	tl_assert( n <= EVENT_BUF_SIZE );
+	++n_event_flushes;
+	events_replaying = True;
+	for (i = 0; i < n; ++i) {
+		Event_t *ev = &TNT_(events)[i];
+		if ( !ev->fn ) { continue; }
+		events_pc = ev->pc;
+		((event_fn_t)ev->fn)( ev->args[0], ev->args[1], ev->args[2] );
+		ev->fn = 0;
+		++n_events_replayed;
+	}
+	events_replaying = False;
+}
+
+/* Address of the instruction a helper reports on: when replaying buffered
+   events, the guest IP is already at the end of the superblock. */
+static Addr TNT_(helper_IP)( void )
+{
+	return events_replaying ? events_pc : VG_(get_IP)( VG_(get_running_tid)() );
+}
+#endif
+
+#if _SECRETGRIND_
+/* --tier-threshold=N. Superblocks start on the cheap tier: shadow propagation
+   only, plus a call to TNT_(tier_taint_seen) when the superblock read a tainted
+   value. Once that happened N times, the superblock is queued and retranslated
+   with the full instrumentation. The translations are not discarded from the
+   helper itself, as it runs inside the one to throw away: the queue is
+   processed by tnt_start_client_code(). There is one node per translation,
+   keyed like the clone arenas by (nraddr, vge->base[0]): the no-redirect
+   translation of a wrapped function shares its nraddr with the redirected
+   one, but not its code. Valgrind flushes no-redirect translations without
+   telling us, so the helper gets the key, not the node, and does nothing if
+   the node is gone. Nodes live until their translation is discarded, except
+   by the promotion itself. */
+#	define TIER_PENDING_MAX	64
+typedef
+	struct _TierNode_t {
+		struct _TierNode_t	*next;		// VgHashNode
+		UWord				key;		// nraddr of the translation
+		Addr64				base;		// vge.base[0] of the translation
+		struct _TierNode_t	*sibling;	// other nodes with the same nraddr, not in the table
+		ULong				nTainted;	// # executions that read taint
+		Bool				full;		// translated with full instrumentation
+		Bool				queued;		// in tier_pending[]
+		VexGuestExtents		vge;
+	}
+	TierNode_t;
+
+static VgHashTable TNT_(tier_nodes) = NULL;
+static TierNode_t* tier_pending[TIER_PENDING_MAX];
+static UInt  n_tier_pending = 0;
+static Bool  tier_discarding = False;
+static ULong n_tier_promoted = 0;
+static ULong n_tier_freed = 0;
+
+static TierNode_t* tier_lookup( Addr64 addr, Addr64 base )
+{
+	TierNode_t *node = VG_(HT_lookup)( TNT_(tier_nodes), (UWord)addr );
+	
+	while ( node && node->base != base ) { node = node->sibling; }
+	return node;
+}
+
+/* Called by TNT_(instrument): True if the translation of addr, whose code
+   starts at vge->base[0], must go on the cheap tier */
+Bool TNT_(tier_node)( Addr64 addr, const VexGuestExtents *vge )
+{
+	TierNode_t *node = tier_lookup( addr, vge->base[0] );
+	
+	if ( !node ) {
+		TierNode_t *head = VG_(HT_lookup)( TNT_(tier_nodes), (UWord)addr );
+		node = VG_(malloc)( "tnt.tier_node.1", sizeof(TierNode_t) );
+		VG_(memset)( node, 0, sizeof(TierNode_t) );
+		node->key = (UWord)addr;
+		node->base = vge->base[0];
+		if ( head ) {
+			node->sibling = head->sibling;
+			head->sibling = node;
+		} else {
+			VG_(HT_add_node)( TNT_(tier_nodes), node );
+		}
+	}
+	node->vge = *vge;
+	return !node->full;
+}
+
+VG_REGPARM(2) void TNT_(tier_taint_seen)( HWord addr, HWord base )
+{
+	TierNode_t *node = tier_lookup( (Addr64)addr, (Addr64)base );
+	
+	// the translation was discarded while a no-redirect one with the same key still runs
+	if ( !node || node->full ) { return; }
+	if ( node->queued || ++node->nTainted < TNT_(clo_tier_threshold) ) { return; }
+	// queue full: try again on the next tainted execution
+	if ( n_tier_pending == TIER_PENDING_MAX ) { return; }
+	node->queued = True;
+	tier_pending[n_tier_pending++] = node;
+}
+
+static void TNT_(tier_promote_pending)( void )
+{
+	UInt i, j;
+	
+	if ( !n_tier_pending ) { return; }
+	
+	tier_discarding = True;
+	for ( i = 0; i < n_tier_pending; ++i ) {
+		TierNode_t *node = tier_pending[i];
+		LOG("tier_promote 0x%lx after %llu tainted executions\n", node->key, node->nTainted);
+		node->full = True;
+		node->queued = False;
+		for ( j = 0; j < node->vge.n_used; ++j ) {
+			VG_(discard_translations)( node->vge.base[j], node->vge.len[j], "secretgrind-tier" );
+		}
+		++n_tier_promoted;
+	}
+	n_tier_pending = 0;
+	tier_discarding = False;
+}
+
+// the translation of addr at base is gone (code unloaded, transtab full, or retranslation of everything)
+static void TNT_(tier_discard)( Addr64 addr, Addr64 base )
+{
+	TierNode_t *head, *node, **prev;
+	UInt i;
+	
+	if ( !TNT_(tier_nodes) || tier_discarding ) { return; }
+	
+	head = VG_(HT_lookup)( TNT_(tier_nodes), (UWord)addr );
+	if ( !head ) { return; }
+	if ( head->base == base ) {
+		node = VG_(HT_remove)( TNT_(tier_nodes), (UWord)addr );
+		tl_assert ( node == head );
+		if ( node->sibling ) { VG_(HT_add_node)( TNT_(tier_nodes), node->sibling ); }
+	} else {
+		for ( prev = &head->sibling; *prev && (*prev)->base != base; prev = &(*prev)->sibling ) {}
+		node = *prev;
+		if ( !node ) { return; }
+		*prev = node->sibling;
+	}
+	if ( node->queued ) {
+		for ( i = 0; i < n_tier_pending; ++i ) {
+			if ( tier_pending[i] == node ) { tier_pending[i] = tier_pending[--n_tier_pending]; break; }
+		}
+	}
+	VG_(free)( node );
+	++n_tier_freed;
+}
+
+static void tier_free_node( void *n )
+{
+	TierNode_t *node = n;
+	while ( node ) {
+		TierNode_t *sibling = node->sibling;
+		VG_(free)( node );
+		node = sibling;
+	}
+}
+
+static void TNT_(tier_release)( void )
+{
+	if ( !TNT_(tier_nodes) ) { return; }
+	VG_(HT_destruct)( TNT_(tier_nodes), tier_free_node );
+	TNT_(tier_nodes) = NULL;
+	n_tier_pending = 0;
+}
+#endif
+
 // If stdout is not a tty, don't highlight text
 int istty = 0;
 
@@ -2863,7 +3391,7 @@ static void TNT_(print_TaintExeContext)( ExeContext* ec, UInt n_ips, Int fixed )
 									VG_(printf)("\n");		\
 								} 
    
-   #define HXX_PC	UInt  pc = VG_(get_IP)( VG_(get_running_tid)() ); \
+   #define HXX_PC	UInt  pc = TNT_(helper_IP)(); \
 					HChar fnname[FNNAME_MAX]; \
 					HChar aTmp[128]; \
 					VG_(describe_IP) ( pc, fnname, FNNAME_MAX, NULL ); 
@@ -2912,10 +3440,10 @@ static void TNT_(print_TaintExeContext)( ExeContext* ec, UInt n_ips, Int fixed )
 
 #define H_WRTMP_BOOKKEEPING \
    UInt ltmp = clone->Ist.WrTmp.tmp; \
-   if ( ltmp >= TI_MAX ) { \
+   if ( ltmp >= ti_max ) { \
       VG_(printf)("ltmp %d\n", ltmp); \
    } \
-   tl_assert( ltmp < TI_MAX ); \
+   tl_assert( ltmp < ti_max ); \
    ti[ltmp]++; \
    if ( taint ) { \
       ti[ltmp] |= 0x80000000; \
@@ -2931,9 +3459,9 @@ static void TNT_(print_TaintExeContext)( ExeContext* ec, UInt n_ips, Int fixed )
 
 #	define H_WRTMP_BOOKKEEPING_128or256 \
    UInt ltmp = clone->Ist.WrTmp.tmp; \
-   if ( ltmp >= TI_MAX ) \
+   if ( ltmp >= ti_max ) \
       LOG("ltmp %d\n", ltmp); \
-   tl_assert( ltmp < TI_MAX ); \
+   tl_assert( ltmp < ti_max ); \
    ti[ltmp]++; \
    if ( isTainted ) { \
       ti[ltmp] |= 0x80000000; \
@@ -3035,7 +3563,7 @@ void TNT_(h32_exit_t) (
    IRConst *dst  = clone->Ist.Exit.dst;
    ULong address    = extract_IRConst64(dst);
 
-   tl_assert( gtmp < TI_MAX );
+   tl_assert( gtmp < ti_max );
    
    if ( istty && is_tainted(gtmp) )
    {
@@ -3093,7 +3621,7 @@ void TNT_(h32_next_t) (
    
    UInt next = clone->Iex.RdTmp.tmp;
 
-   tl_assert( next < TI_MAX );
+   tl_assert( next < ti_max );
   
    if ( istty && is_tainted(next) )
    {
@@ -3127,110 +3655,12 @@ void TNT_(h32_next_c) (
 #endif
 }
 
-#if _SECRETGRIND_
-
-VG_REGPARM(2)
-void TNT_(h32_store_v128or256_prepare_tt) (
-   IRStmt *clone,
-   UChar offset
-    ) {
-		
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-    IRExpr *data = clone->Ist.Store.data;
-    UInt atmp = addr->Iex.RdTmp.tmp;
-	UInt dtmp = data->Iex.RdTmp.tmp;
-	
-	tl_assert( atmp < TI_MAX );
-	tl_assert( dtmp < TI_MAX );
-	
-	GH32_prepare_xx.tt.atmp = atmp;
-	GH32_prepare_xx.tt.dtmp = dtmp;
-	GH32_prepare_xx.tt.offset = offset;
-}
-
+// STORE <end> atmp = dtmp
 VG_REGPARM(3)
-void TNT_(h32_store_v128or256_tt) (
+void TNT_(h32_store_tt) (
    IRStmt *clone, 
-   ULong value, 
-   ULong taint
-    ) {
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-    IRExpr *data = clone->Ist.Store.data;
-    UInt atmp = addr->Iex.RdTmp.tmp;
-	UInt dtmp = data->Iex.RdTmp.tmp;
-	UChar offset = 0;
-	
-	tl_assert( atmp < TI_MAX );
-	tl_assert( dtmp < TI_MAX );
-	
-	/* make sure this is the right data */
-	tl_assert ( atmp == GH32_prepare_xx.tt.atmp && dtmp == GH32_prepare_xx.tt.dtmp );
-	offset = GH32_prepare_xx.tt.offset; // get the offset
-	TNT_(h32_reset_prepare_struct)(&GH32_prepare_xx); // resset immediatly
-	
-	H_EXIT_EARLY_LDST
-	
-	UInt address = tv[atmp] + offset;
-   
-	H_VAR
-   
-   // we must wait for H_VAR to get mem description before returning
-   if( !TNT_(clo_trace) ) { return; }
-   
-   H32_PC
-
-   // Check if it hasn't been seen before
-	/*if( myStringArray_getIndex( &lvar_s, varname ) == -1 ){
-      myStringArray_push( &lvar_s, varname );
-	}
-	lvar_i[ myStringArray_getIndex( &lvar_s, varname ) ]++;
-    */
-   
-   if ( istty && is_tainted(dtmp) )
-   {
-	  VG_(sprintf)( aTmp, "STORE t%d_%d_v%u = %st%d_%d_v%u%s", atmp, _ti(atmp), offset, KRED, dtmp, _ti(dtmp), offset, KNRM); 
-      
-      H32_PRINTC
-      
-   } else {
-	 
-	  VG_(sprintf)( aTmp, "STORE t%d_%d_v%u = t%d_%d_v%u", atmp, _ti(atmp), offset, dtmp, _ti(dtmp), offset);
-      
-      H32_PRINT
-   }
-   
-   // Information flow
-   // we don't want the user to see an extra _X after the varname
-   if ( is_tainted(dtmp) && is_tainted(atmp) ) {
-	  VG_(printf)( "%s <- t%d_%d_v%u", varname, dtmp, _ti(dtmp), offset );
-	  VG_(printf)( "; %s <*- t%d_%d_v%u\n", varname, atmp, _ti(atmp), offset );
-
-   } else if ( is_tainted(dtmp) ) {
-	  VG_(printf)( "%s <- t%d_%d_v%u\n", varname, dtmp, _ti(dtmp), offset );
-   }
-   else if ( is_tainted(atmp) ) {
-	  VG_(printf)( "%s <*- t%d_%d_v%u\n", varname, atmp, _ti(atmp), offset );
-   }
-   else if ( !TNT_(clo_trace_taint_only) ) {
-      VG_(printf)( "%s <- t%d_%d_v%u", varname, dtmp, _ti(dtmp), offset );
-	  VG_(printf)( "; %s <*- t%d_%d_v%u\n", varname, atmp, _ti(atmp), offset );
-   }
-   else
-	  VG_(printf)("\n");
-	
-}
-#endif
-
-// STORE <end> atmp = dtmp
-VG_REGPARM(3)
-void TNT_(h32_store_tt) (
-   IRStmt *clone, 
-   UInt value, 
-   UInt taint) {
+   UInt value, 
+   UInt taint) {
 
 #if _SECRETGRIND_
    //LOG_ENTER();
@@ -3241,8 +3671,8 @@ void TNT_(h32_store_tt) (
    UInt atmp = addr->Iex.RdTmp.tmp;
    UInt dtmp = data->Iex.RdTmp.tmp;
 
-   tl_assert( atmp < TI_MAX );
-   tl_assert( dtmp < TI_MAX );
+   tl_assert( atmp < ti_max );
+   tl_assert( dtmp < ti_max );
 
    H_EXIT_EARLY_LDST
    
@@ -3322,72 +3752,6 @@ void TNT_(h32_store_tt) (
    
 }
 
-#if _SECRETGRIND_
-
-VG_REGPARM(2)
-void TNT_(h32_store_v128or256_prepare_tc) (
-   IRStmt *clone,
-   UChar offset
-    ) {
-		
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-	IRExpr *data = clone->Ist.Store.data;
-	UInt atmp    = addr->Iex.RdTmp.tmp;
-	UInt c      = extract_IRConst64(data->Iex.Const.con);
-   
-	GH32_prepare_xx.tc.c = c;
-	GH32_prepare_xx.tc.atmp = atmp;
-	GH32_prepare_xx.tc.offset = offset;
-}
-
-// STORE atmp = c for SIMD instructions
-VG_REGPARM(3)
-void TNT_(h32_store_v128or256_tc) (
-   IRStmt *clone, 
-   ULong value, 
-   ULong taint ) {
-      
-   IRExpr *addr = clone->Ist.Store.addr;
-   IRExpr *data = clone->Ist.Store.data;
-   UInt atmp    = addr->Iex.RdTmp.tmp;
-   UInt c      = extract_IRConst64(data->Iex.Const.con);
-   UChar offset = 0;
-   
-   tl_assert( atmp < TI_MAX );
-   
-   // make sure this contains the expected data
-   tl_assert ( GH32_prepare_xx.tc.c == c && GH32_prepare_xx.tc.atmp == atmp );
-   offset = GH32_prepare_xx.tc.offset;
-   TNT_(h32_reset_prepare_struct)(&GH32_prepare_xx); // reset immediatly
-	
-   // exit after we've reset the struct above
-   H_EXIT_EARLY_LDST
-
-   UInt address = tv[atmp] + offset;
-   tl_assert (0 && "never tested so asserting, TODO: check the address is correct");
-
-   H_VAR
-
-   // we must wait for H_VAR to get mem description before returning
-   if( !TNT_(clo_trace) ) { return; }
-
-   H32_PC
-
-   VG_(sprintf)( aTmp, "STORE t%d_%d = 0x%x", atmp, _ti(atmp), c );
-   H32_PRINT
-   
-   // Information flow
-   
-   if ( !TNT_(clo_trace_taint_only) || is_tainted(atmp) )
-	  VG_(printf)( "%s <-*- t%d_%d\n", varname, atmp, _ti(atmp) );
-   else
-	  VG_(printf)("\n");
-	   
-}
-
-#endif
 // STORE atmp = const
 VG_REGPARM(3)
 void TNT_(h32_store_tc) (
@@ -3404,7 +3768,7 @@ void TNT_(h32_store_tc) (
    UInt atmp    = addr->Iex.RdTmp.tmp;
    UInt c       = extract_IRConst(data->Iex.Const.con);
 
-   tl_assert( atmp < TI_MAX );
+   tl_assert( atmp < ti_max );
 
    H_EXIT_EARLY_LDST
    
@@ -3448,77 +3812,6 @@ void TNT_(h32_store_tc) (
 #endif
 }
 
-#if _SECRETGRIND_
-VG_REGPARM(2)
-void TNT_(h32_store_v128or256_prepare_ct) (
-   IRStmt *clone,
-   UChar offset
-    ) {
-		
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-	IRExpr *data = clone->Ist.Store.data;
-	UInt c      = extract_IRConst64(addr->Iex.Const.con);
-	UInt dtmp    = data->Iex.RdTmp.tmp;
-   
-	GH32_prepare_xx.ct.c = c;
-	GH32_prepare_xx.ct.dtmp = dtmp;
-	GH32_prepare_xx.ct.offset = offset;
-}
-
-// STORE c = dtmp for SIMD instructions
-VG_REGPARM(3)
-void TNT_(h32_store_v128or256_ct) (
-   IRStmt *clone, 
-   ULong value, 
-   ULong taint
-    ) {
-
-	IRExpr *addr = clone->Ist.Store.addr;
-	IRExpr *data = clone->Ist.Store.data;
-	UInt c      = extract_IRConst64(addr->Iex.Const.con);
-	UInt dtmp    = data->Iex.RdTmp.tmp;
-	UChar offset = 0;
-	
-	tl_assert( dtmp < TI_MAX );
-	
-	// make sure this contains the expected data
-	tl_assert ( GH32_prepare_xx.ct.c == c && GH32_prepare_xx.ct.dtmp == dtmp );
-	offset = GH32_prepare_xx.ct.offset;
-	TNT_(h32_reset_prepare_struct)(&GH32_prepare_xx); // reset immediatly
-
-	// this must come after we're reset the struct
-	H_EXIT_EARLY
-	
-	ULong address = c + offset;
-	H_VAR
-   
-   // we must wait for H_VAR to get mem description before returning
-   if( !TNT_(clo_trace) ) { return; }
-
-   H32_PC
-
-   if ( istty && is_tainted(dtmp) )
-   {
-      VG_(sprintf)( aTmp, "STORE 0x%x = %st%d_%d%s",
-                    c, KRED, dtmp, _ti(dtmp), KNRM );
-      H32_PRINTC
-   } else {
-      VG_(sprintf)( aTmp, "STORE 0x%x = t%d_%d", c, dtmp, _ti(dtmp) );
-      H32_PRINT
-   }
-
-   // Information flow
-  
-   if ( !TNT_(clo_trace_taint_only) || is_tainted(dtmp) )
-	  VG_(printf)( "%s <- t%d_%d\n", varname, dtmp, _ti(dtmp) );
-   else
-	  VG_(printf)("\n");
-
-}
-#endif
-
 // STORE const = dtmp
 VG_REGPARM(3)
 void TNT_(h32_store_ct) (
@@ -3537,7 +3830,7 @@ void TNT_(h32_store_ct) (
    UInt c       = extract_IRConst(addr->Iex.Const.con);
    UInt dtmp    = data->Iex.RdTmp.tmp;
 
-   tl_assert( dtmp < TI_MAX );
+   tl_assert( dtmp < ti_max );
 
    UInt address = c;
    H_VAR
@@ -3585,6 +3878,166 @@ void TNT_(h32_store_ct) (
 #endif
 }
 
+#if _SECRETGRIND_
+/* Shadow of the nBits-wide SIMD store at a.  The store trace helpers
+   below run after helperc_STOREV128/256, so this is the taint of the
+   data that was just written.  Returns whether any of it is tainted. */
+static Bool TNT_(store_taint_128or256)( Addr a, SizeT nBits, /*OUT*/ULong *taintArr )
+{
+   UWord j;
+   Bool isTainted = False;
+
+   tnt_LOADV_128_or_256( taintArr, a, nBits, False );
+   for (j = 0; j < nBits / 64; ++j) {
+      isTainted |= (taintArr[j] != V_BITS64_UNTAINTED);
+   }
+   return isTainted;
+}
+
+/* The SIMD store helpers get the whole vector in one call, as nLanes
+   host words with the least significant lane first. */
+
+// STORE atmp = dtmp for SIMD instructions
+VG_REGPARM(3)
+void TNT_(h32_store_v128or256_tt) (
+   IRStmt *clone,
+   UInt nLanes,
+   UInt w0, UInt w1, UInt w2, UInt w3 ) {
+
+   IRExpr *addr = clone->Ist.Store.addr;
+   IRExpr *data = clone->Ist.Store.data;
+   UInt atmp = addr->Iex.RdTmp.tmp;
+   UInt dtmp = data->Iex.RdTmp.tmp;
+   UInt valueArr[4] = { w0, w1, w2, w3 };
+   ULong taintArr[2] = {0};
+   UChar loadSize = nLanes;
+   unsigned i;
+
+   tl_assert( atmp < ti_max );
+   tl_assert( dtmp < ti_max );
+   tl_assert( nLanes == 4 );
+
+   Addr address = tv[atmp];
+   Bool isTainted = TNT_(store_taint_128or256)( address, loadSize*32, taintArr );
+
+   H_EXIT_EARLY_LDST_128or256
+
+   H_VAR_128or256(sizeof(UInt))
+
+   // we must wait for H_VAR to get mem description before returning
+   if( !TNT_(clo_trace) ) { return; }
+
+   H32_PC
+
+   if ( istty && is_tainted(dtmp) ) {
+      VG_(sprintf)( aTmp, "STORE t%d_%d = %st%d_%d%s", atmp, _ti(atmp), KRED, dtmp, _ti(dtmp), KNRM );
+      H32_PRINTC_128or256(loadSize)
+   } else {
+      VG_(sprintf)( aTmp, "STORE t%d_%d = t%d_%d", atmp, _ti(atmp), dtmp, _ti(dtmp) );
+      H32_PRINT_128or256(loadSize)
+   }
+
+   // Information flow
+   if ( is_tainted(dtmp) && is_tainted(atmp) ) {
+      VG_(printf)( "%s <- t%d_%d", varname, dtmp, _ti(dtmp) );
+      VG_(printf)( "; %s <*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   } else if ( is_tainted(dtmp) ) {
+      VG_(printf)( "%s <- t%d_%d\n", varname, dtmp, _ti(dtmp) );
+   } else if ( is_tainted(atmp) ) {
+      VG_(printf)( "%s <*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   } else if ( !TNT_(clo_trace_taint_only) ) {
+      VG_(printf)( "%s <- t%d_%d", varname, dtmp, _ti(dtmp) );
+      VG_(printf)( "; %s <*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   } else
+      VG_(printf)("\n");
+}
+
+// STORE atmp = c for SIMD instructions
+VG_REGPARM(3)
+void TNT_(h32_store_v128or256_tc) (
+   IRStmt *clone,
+   UInt nLanes,
+   UInt w0, UInt w1, UInt w2, UInt w3 ) {
+
+   IRExpr *addr = clone->Ist.Store.addr;
+   UInt atmp = addr->Iex.RdTmp.tmp;
+   UInt valueArr[4] = { w0, w1, w2, w3 };
+   ULong taintArr[2] = {0};
+   UChar loadSize = nLanes;
+   unsigned i;
+
+   tl_assert( atmp < ti_max );
+   tl_assert( nLanes == 4 );
+
+   Addr address = tv[atmp];
+   Bool isTainted = TNT_(store_taint_128or256)( address, loadSize*32, taintArr );
+
+   H_EXIT_EARLY_LDST_128or256
+
+   H_VAR_128or256(sizeof(UInt))
+
+   // we must wait for H_VAR to get mem description before returning
+   if( !TNT_(clo_trace) ) { return; }
+
+   H32_PC
+
+   VG_(sprintf)( aTmp, "STORE t%d_%d = CONST V128", atmp, _ti(atmp) );
+   H32_PRINT_128or256(loadSize)
+
+   // Information flow
+   if ( !TNT_(clo_trace_taint_only) || is_tainted(atmp) )
+      VG_(printf)( "%s <-*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   else
+      VG_(printf)("\n");
+}
+
+// STORE c = dtmp for SIMD instructions
+VG_REGPARM(3)
+void TNT_(h32_store_v128or256_ct) (
+   IRStmt *clone,
+   UInt nLanes,
+   UInt w0, UInt w1, UInt w2, UInt w3 ) {
+
+   IRExpr *addr = clone->Ist.Store.addr;
+   IRExpr *data = clone->Ist.Store.data;
+   UInt c       = extract_IRConst(addr->Iex.Const.con);
+   UInt dtmp    = data->Iex.RdTmp.tmp;
+   UInt valueArr[4] = { w0, w1, w2, w3 };
+   ULong taintArr[2] = {0};
+   UChar loadSize = nLanes;
+   unsigned i;
+
+   tl_assert( dtmp < ti_max );
+   tl_assert( nLanes == 4 );
+
+   Addr address = c;
+   Bool isTainted = TNT_(store_taint_128or256)( address, loadSize*32, taintArr );
+
+   H_EXIT_BASE( isTainted )
+
+   H_VAR_128or256(sizeof(UInt))
+
+   // we must wait for H_VAR to get mem description before returning
+   if( !TNT_(clo_trace) ) { return; }
+
+   H32_PC
+
+   if ( istty && is_tainted(dtmp) ) {
+      VG_(sprintf)( aTmp, "STORE 0x%x = %st%d_%d%s", c, KRED, dtmp, _ti(dtmp), KNRM );
+      H32_PRINTC_128or256(loadSize)
+   } else {
+      VG_(sprintf)( aTmp, "STORE 0x%x = t%d_%d", c, dtmp, _ti(dtmp) );
+      H32_PRINT_128or256(loadSize)
+   }
+
+   // Information flow
+   if ( !TNT_(clo_trace_taint_only) || is_tainted(dtmp) )
+      VG_(printf)( "%s <- t%d_%d\n", varname, dtmp, _ti(dtmp) );
+   else
+      VG_(printf)("\n");
+}
+#endif
+
 #if _SECRETGRIND_
 // ltmp = LOAD <ty> atmp
 void TNT_(h32_load_v128or256_t) (
@@ -3600,7 +4053,7 @@ void TNT_(h32_load_v128or256_t) (
    IRExpr* addr = clone->Ist.WrTmp.data->Iex.Load.addr;
    UInt atmp    = addr->Iex.RdTmp.tmp;
    tl_assert ( ty+Ity_INVALID==Ity_V128 || ty+Ity_INVALID==Ity_V256 );
-   tl_assert( atmp < TI_MAX );
+   tl_assert( atmp < ti_max );
    //LOG("load:atmp:%u, tv[atmp]:%llx\n", atmp, tv[atmp]);
    ULong address = tv[atmp];
         
@@ -3694,7 +4147,7 @@ void TNT_(h32_load_t) (
    IRExpr* addr = clone->Ist.WrTmp.data->Iex.Load.addr;
    UInt atmp    = addr->Iex.RdTmp.tmp;
 
-   tl_assert( atmp < TI_MAX );
+   tl_assert( atmp < ti_max );
    
    Addr address = tv[atmp];
    
@@ -3918,7 +4371,7 @@ void TNT_(h32_put_t) (
    UInt tmp     = data->Iex.RdTmp.tmp;
 
    tl_assert( reg < RI_MAX );
-   tl_assert( tmp < TI_MAX );
+   tl_assert( tmp < ti_max );
    ri[reg]++;
  
    if ( istty && is_tainted(tmp) )
@@ -4016,7 +4469,7 @@ void TNT_(h32_puti) (
 
    // TODO: Info flow
    //tl_assert( reg < RI_MAX );
-   //tl_assert( tmp < TI_MAX );
+   //tl_assert( tmp < ti_max );
    //ri[reg]++;
 
    //VG_(printf)("r%d_%d <- t%d_%d\n", reg, ri[reg], tmp, ti[tmp]);
@@ -4070,7 +4523,7 @@ void TNT_(h32_unop_t) (
    IRExpr* arg = clone->Ist.WrTmp.data->Iex.Unop.arg;
    UInt rtmp = arg->Iex.RdTmp.tmp;
 
-   tl_assert( rtmp < TI_MAX );
+   tl_assert( rtmp < ti_max );
 
    if ( istty && is_tainted(ltmp) )
    {
@@ -4163,7 +4616,7 @@ void TNT_(h32_binop_tc) (
    UInt rtmp1 = arg1->Iex.RdTmp.tmp;
    UInt c = extract_IRConst( arg2->Iex.Const.con );
 
-   tl_assert( rtmp1 < TI_MAX );
+   tl_assert( rtmp1 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -4220,7 +4673,7 @@ void TNT_(h32_binop_ct) (
    UInt c = extract_IRConst( arg1->Iex.Const.con );
    UInt rtmp2 = arg2->Iex.RdTmp.tmp;
 
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( rtmp2 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -4277,8 +4730,8 @@ void TNT_(h32_binop_tt) (
    UInt rtmp1 = arg1->Iex.RdTmp.tmp;
    UInt rtmp2 = arg2->Iex.RdTmp.tmp;
 
-   tl_assert( rtmp1 < TI_MAX );
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( rtmp1 < ti_max );
+   tl_assert( rtmp2 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -4405,7 +4858,7 @@ void TNT_(h32_rdtmp) (
 
    UInt rtmp = clone->Ist.WrTmp.data->Iex.RdTmp.tmp;
 
-   tl_assert( rtmp < TI_MAX );
+   tl_assert( rtmp < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -4459,8 +4912,8 @@ void TNT_(h32_ite_tc) (
    UInt rtmp1   = data->Iex.ITE.iftrue->Iex.RdTmp.tmp;
    UInt c       = extract_IRConst(data->Iex.ITE.iffalse->Iex.Const.con);
 
-   tl_assert( ctmp  < TI_MAX );
-   tl_assert( rtmp1 < TI_MAX );
+   tl_assert( ctmp  < ti_max );
+   tl_assert( rtmp1 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -4514,8 +4967,8 @@ void TNT_(h32_ite_ct) (
    UInt c       = extract_IRConst(data->Iex.ITE.iftrue->Iex.Const.con);
    UInt rtmp2   = data->Iex.ITE.iffalse->Iex.RdTmp.tmp;
 
-   tl_assert( ctmp  < TI_MAX );
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( ctmp  < ti_max );
+   tl_assert( rtmp2 < ti_max );
   
    if ( istty && is_tainted(ltmp) )
    {
@@ -4569,9 +5022,9 @@ void TNT_(h32_ite_tt) (
    UInt rtmp1   = data->Iex.ITE.iftrue->Iex.RdTmp.tmp;
    UInt rtmp2   = data->Iex.ITE.iffalse->Iex.RdTmp.tmp;
 
-   tl_assert( ctmp  < TI_MAX );
-   tl_assert( rtmp1 < TI_MAX );
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( ctmp  < ti_max );
+   tl_assert( rtmp1 < ti_max );
+   tl_assert( rtmp2 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -4636,7 +5089,7 @@ void TNT_(h32_ite_cc) (
    UInt c1      = extract_IRConst(data->Iex.ITE.iftrue->Iex.Const.con);
    UInt c2      = extract_IRConst(data->Iex.ITE.iffalse->Iex.Const.con);
 
-   tl_assert( ctmp  < TI_MAX );
+   tl_assert( ctmp  < ti_max );
    // Laurent: remove below line
    //if ( (ti[ctmp] & 0x80000000) == 0 ) return;
    
@@ -4718,7 +5171,7 @@ void TNT_(h64_exit_t) (
    IRConst *dst  = clone->Ist.Exit.dst;
    ULong addr    = extract_IRConst64(dst);
 
-   tl_assert( gtmp < TI_MAX );
+   tl_assert( gtmp < ti_max );
 
    if ( istty && is_tainted(gtmp) )
    {
@@ -4765,7 +5218,7 @@ void TNT_(h64_next_t) (
 
    UInt next = clone->Iex.RdTmp.tmp;
 
-   tl_assert( next < TI_MAX );
+   tl_assert( next < ti_max );
    
    if ( istty && is_tainted(next) )
    {
@@ -4806,109 +5259,6 @@ void TNT_(h64_next_c) (
    // End of BB
 }
 
-#if _SECRETGRIND_
-
-VG_REGPARM(2)
-void TNT_(h64_store_v128or256_prepare_tt) (
-   IRStmt *clone,
-   UChar offset
-    ) {
-		
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-    IRExpr *data = clone->Ist.Store.data;
-    UInt atmp = addr->Iex.RdTmp.tmp;
-	UInt dtmp = data->Iex.RdTmp.tmp;
-	
-	tl_assert( atmp < TI_MAX );
-	tl_assert( dtmp < TI_MAX );
-	
-	GH64_prepare_xx.tt.atmp = atmp;
-	GH64_prepare_xx.tt.dtmp = dtmp;
-	GH64_prepare_xx.tt.offset = offset;
-}
-
-VG_REGPARM(3)
-void TNT_(h64_store_v128or256_tt) (
-   IRStmt *clone, 
-   ULong value, 
-   ULong taint
-    ) {
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-    IRExpr *data = clone->Ist.Store.data;
-    UInt atmp = addr->Iex.RdTmp.tmp;
-	UInt dtmp = data->Iex.RdTmp.tmp;
-	UChar offset = 0;
-	
-	tl_assert( atmp < TI_MAX );
-	tl_assert( dtmp < TI_MAX );
-	
-	/* make sure this is the right data */
-	tl_assert ( atmp == GH64_prepare_xx.tt.atmp && dtmp == GH64_prepare_xx.tt.dtmp );
-	offset = GH64_prepare_xx.tt.offset; // get the offset
-	TNT_(h64_reset_prepare_struct)(&GH64_prepare_xx); // reset immediatly
-	
-	H_EXIT_EARLY_LDST
-	
-	ULong address = tv[atmp] + offset;
-      
-	H_VAR
-	
-	// need to have H_VAR get the var description for summary before returning
-	if(!TNT_(clo_trace)) { return; }
-	
-	H64_PC
-   
-	// Check if it hasn't been seen before
-	//if( myStringArray_getIndex( &lvar_s, varname ) == -1 ){
-    //  myStringArray_push( &lvar_s, varname );
-	//}
-	//lvar_i[ myStringArray_getIndex( &lvar_s, varname ) ]++;
-   
-	
-   
-    if ( istty && is_tainted(dtmp) ) {
-		
-		VG_(sprintf)( aTmp, "STORE t%d_%d_v%u = %st%d_%d_v%u%s", atmp, _ti(atmp), offset, KRED, dtmp, _ti(dtmp), offset, KNRM); 
-
-		H64_PRINTC
-      
-	} else {
-		
-	  VG_(sprintf)( aTmp, "STORE t%d_%d_v%u = t%d_%d_v%u", atmp, _ti(atmp), offset, dtmp, _ti(dtmp), offset); 
-      
-      H64_PRINT
-   }
-   
-   // Information flow
-   
-   // we don't want the user to see an extra _X after the varname
-	if ( is_tainted(dtmp) && is_tainted(atmp) ) {
-		
-		VG_(printf)( "%s <- t%d_%d_v%u", varname, dtmp, _ti(dtmp), offset );
-		VG_(printf)( "; %s <*- t%d_%d_v%u\n", varname, atmp, _ti(atmp), offset );
-
-	} else if ( is_tainted(dtmp) ) {
-		VG_(printf)( "%s <- t%d_%d_v%u\n", varname, dtmp, _ti(dtmp), offset );
-	}
-	else if ( is_tainted(atmp) ) {
-	   
-		VG_(printf)( "%s <*- t%d_%d_v%u\n", varname, atmp, _ti(atmp), offset );
-	} else if ( !TNT_(clo_trace_taint_only) ) {
-		
-		VG_(printf)( "%s <- t%d_%d_v%u", varname, dtmp, _ti(dtmp), offset );
-		VG_(printf)( "; %s <*- t%d_%d_v%u\n", varname, atmp, _ti(atmp), offset );
-		
-	} else {
-		VG_(printf)("\n");
-	}	
-		
-}
-#endif // _SECRETGRIND_
-
 // STORE atmp = dtmp
 VG_REGPARM(3)
 void TNT_(h64_store_tt) (
@@ -4921,8 +5271,8 @@ void TNT_(h64_store_tt) (
    UInt atmp = addr->Iex.RdTmp.tmp;
    UInt dtmp = data->Iex.RdTmp.tmp;
       
-   tl_assert( atmp < TI_MAX );
-   tl_assert( dtmp < TI_MAX );
+   tl_assert( atmp < ti_max );
+   tl_assert( dtmp < ti_max );
 
 
    H_EXIT_EARLY_LDST
@@ -5003,73 +5353,6 @@ void TNT_(h64_store_tt) (
    
 }
 
-#if _SECRETGRIND_
-
-VG_REGPARM(2)
-void TNT_(h64_store_v128or256_prepare_tc) (
-   IRStmt *clone,
-   UChar offset
-    ) {
-		
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-	IRExpr *data = clone->Ist.Store.data;
-	UInt atmp    = addr->Iex.RdTmp.tmp;
-	ULong c      = extract_IRConst64(data->Iex.Const.con);
-   
-	GH64_prepare_xx.tc.c = c;
-	GH64_prepare_xx.tc.atmp = atmp;
-	GH64_prepare_xx.tc.offset = offset;
-}
-
-// STORE atmp = c for SIMD instructions
-VG_REGPARM(3)
-void TNT_(h64_store_v128or256_tc) (
-   IRStmt *clone, 
-   ULong value, 
-   ULong taint ) {
-      
-   IRExpr *addr = clone->Ist.Store.addr;
-   IRExpr *data = clone->Ist.Store.data;
-   UInt atmp    = addr->Iex.RdTmp.tmp;
-   ULong c      = extract_IRConst64(data->Iex.Const.con);
-   UChar offset = 0;
-   
-   tl_assert( atmp < TI_MAX );
-   
-   // make sure this contains the expected data
-   tl_assert ( GH64_prepare_xx.tc.c == c && GH64_prepare_xx.tc.atmp == atmp );
-   offset = GH64_prepare_xx.tc.offset;
-   TNT_(h64_reset_prepare_struct)(&GH64_prepare_xx); // reset immediatly
-	
-   // exit after we've reset the struct above
-   H_EXIT_EARLY_LDST
-
-   ULong address = tv[atmp] + offset;
-   
-   //ULong address = c;
-   
-   H_VAR
-   
-   // we must wait for H_VAR to get mem description before returning
-   if( !TNT_(clo_trace) ) { return; }
-
-   H64_PC
-   
-   VG_(sprintf)( aTmp, "STORE t%d_%d_v%u = 0x%llx", atmp, _ti(atmp), offset, value );
-   H64_PRINT
-
-   // Information flow	   
-   if ( !TNT_(clo_trace_taint_only) || is_tainted(atmp) ) 
-	  VG_(printf)( "%s <-*- t%d_%d\n", varname, atmp, _ti(atmp) );
-   else
-	  VG_(printf)("\n");
-	
-}
-
-#endif
-
 // STORE atmp = c
 VG_REGPARM(3)
 void TNT_(h64_store_tc) (
@@ -5082,7 +5365,7 @@ void TNT_(h64_store_tc) (
    UInt atmp    = addr->Iex.RdTmp.tmp;
    ULong c      = extract_IRConst64(data->Iex.Const.con);
    
-   tl_assert( atmp < TI_MAX );
+   tl_assert( atmp < ti_max );
 
    H_EXIT_EARLY_LDST
 
@@ -5128,179 +5411,250 @@ void TNT_(h64_store_tc) (
 #endif
 }
 
-#if _SECRETGRIND_
-VG_REGPARM(2)
-void TNT_(h64_store_v128or256_prepare_ct) (
-   IRStmt *clone,
-   UChar offset
-    ) {
-		
-	LOG_ENTER();
-	
-	IRExpr *addr = clone->Ist.Store.addr;
-	IRExpr *data = clone->Ist.Store.data;
-	ULong c      = extract_IRConst64(addr->Iex.Const.con);
-	UInt dtmp    = data->Iex.RdTmp.tmp;
-   
-	GH64_prepare_xx.ct.c = c;
-	GH64_prepare_xx.ct.dtmp = dtmp;
-	GH64_prepare_xx.ct.offset = offset;
-}
 
-// STORE c = dtmp for SIMD instructions
+// STORE c = dtmp
 VG_REGPARM(3)
-void TNT_(h64_store_v128or256_ct) (
-   IRStmt *clone, 
+void TNT_(h64_store_ct) (
+   IRStmt *clone,
    ULong value, 
-   ULong taint
-    ) {
+   ULong taint ) {
+      
+   H_EXIT_EARLY
 
-	IRExpr *addr = clone->Ist.Store.addr;
-	IRExpr *data = clone->Ist.Store.data;
-	ULong c      = extract_IRConst64(addr->Iex.Const.con);
-	UInt dtmp    = data->Iex.RdTmp.tmp;
-	UChar offset = 0;
-	
-	tl_assert( dtmp < TI_MAX );
-	
-	// make sure this contains the expected data
-	tl_assert ( GH64_prepare_xx.ct.c == c && GH64_prepare_xx.ct.dtmp == dtmp );
-	offset = GH64_prepare_xx.ct.offset;
-	TNT_(h64_reset_prepare_struct)(&GH64_prepare_xx); // reset immediatly
-	
-	//VG_(printf)("offset:%x, %llx\n", offset, c+offset);
-	//tl_assert (0 && "here we are");
-	
-	// this must come after we're reset the struct
-	H_EXIT_EARLY
-	
-	ULong address = c + offset;
-	H_VAR
+   IRExpr *addr = clone->Ist.Store.addr;
+   IRExpr *data = clone->Ist.Store.data;
+   ULong c      = extract_IRConst64(addr->Iex.Const.con);
+   UInt dtmp    = data->Iex.RdTmp.tmp;
    
-	// we must wait for H_VAR to get mem description before returning
-	if( !TNT_(clo_trace) ) { return; }
+   tl_assert( dtmp < ti_max );
 
-	H64_PC
+   ULong address = c;
+   H_VAR
+   
+#if _SECRETGRIND_
+   // we must wait for H_VAR to get mem description before returning
+   if( !TNT_(clo_trace) ) { return; }
+#endif
+
+   H64_PC
+   
+#if !_SECRETGRIND_
+   // Check if it hasn't been seen before
+   if( myStringArray_getIndex( &lvar_s, varname ) == -1 ){
+      myStringArray_push( &lvar_s, varname );
+   }
+   lvar_i[ myStringArray_getIndex( &lvar_s, varname ) ]++;
    
+#endif
+
    if ( istty && is_tainted(dtmp) )
    {
-      VG_(sprintf)( aTmp, "STORE 0x%llx = %st%d_%d_v%u%s", address, KRED, dtmp, _ti(dtmp), offset, KNRM );
+      VG_(sprintf)( aTmp, "STORE 0x%llx = %st%d_%d%s", c, KRED, dtmp, _ti(dtmp), KNRM );
       H64_PRINTC
    } else {
-      VG_(sprintf)( aTmp, "STORE 0x%llx = t%d_%d_v%u", address, dtmp, _ti(dtmp), offset );
+      VG_(sprintf)( aTmp, "STORE 0x%llx = t%d_%d", c, dtmp, _ti(dtmp) );
       H64_PRINT
    }
    
+   // Information flow
+#if _SECRETGRIND_
+
 	if ( !TNT_(clo_trace_taint_only) || is_tainted(dtmp) )
 	  VG_(printf)( "%s <- t%d_%d\n", varname, dtmp, _ti(dtmp) );
     else
 	  VG_(printf)("\n");
+	   
+#else
+   
+   if ( is_tainted(dtmp) )
+	  VG_(printf)( "%s_%d <- t%d_%d\n", varname, lvar_i[ myStringArray_getIndex( &lvar_s, varname ) ], dtmp, _ti(dtmp) );
+   else
+	  VG_(printf)("\n");
+   	  
+#endif
+}
+
+#if _SECRETGRIND_
+static SizeT TNT_(size_of_load)(IRType ty, SizeT n) {
+
+	tl_assert ( n==4 || n==8 );
+	SizeT loadSize = 0;
+	
+	switch (ty) {
+   
+	/* simple cases */
+	case Ity_I1:
+    case Ity_I8:
+    case Ity_I16: 
+    case Ity_I32:
+    case Ity_I64:
+    case Ity_F32:
+    case Ity_F64:
+    case Ity_D32:
+    case Ity_D64:
+		loadSize = 1;
+		break;
+     
+    /* special cases */
+    case Ity_V128:
+		loadSize = 128/(n*8);
+		break;
+		
+    case Ity_V256:
+		loadSize = 256/(n*8);
+		break;
+		
+	/* trap on these for now, because I don't know if we can handle it correctly */
+	case Ity_INVALID:
+	case Ity_I128:
+	case Ity_D128:
+	case Ity_F128:
+	default: VG_(tool_panic)("tnt_main.c: size_of_load: Unsupported type ty");
+   }
 	
+	return loadSize;
 }
 #endif
 
+#if _SECRETGRIND_
+// STORE atmp = dtmp for SIMD instructions
+VG_REGPARM(3)
+void TNT_(h64_store_v128or256_tt) (
+   IRStmt *clone,
+   ULong nLanes,
+   ULong w0, ULong w1, ULong w2, ULong w3 ) {
 
-// STORE c = dtmp
+   IRExpr *addr = clone->Ist.Store.addr;
+   IRExpr *data = clone->Ist.Store.data;
+   UInt atmp = addr->Iex.RdTmp.tmp;
+   UInt dtmp = data->Iex.RdTmp.tmp;
+   ULong valueArr[4] = { w0, w1, w2, w3 };
+   ULong taintArr[4] = {0};
+   UChar loadSize = nLanes;
+   unsigned i;
+
+   tl_assert( atmp < ti_max );
+   tl_assert( dtmp < ti_max );
+   tl_assert( nLanes == 2 || nLanes == 4 );
+
+   Addr address = tv[atmp];
+   Bool isTainted = TNT_(store_taint_128or256)( address, loadSize*64, taintArr );
+
+   H_EXIT_EARLY_LDST_128or256
+
+   H_VAR_128or256(sizeof(ULong))
+
+   // we must wait for H_VAR to get mem description before returning
+   if( !TNT_(clo_trace) ) { return; }
+
+   H64_PC
+
+   if ( istty && is_tainted(dtmp) ) {
+      VG_(sprintf)( aTmp, "STORE t%d_%d = %st%d_%d%s", atmp, _ti(atmp), KRED, dtmp, _ti(dtmp), KNRM );
+      H64_PRINTC_128or256(loadSize)
+   } else {
+      VG_(sprintf)( aTmp, "STORE t%d_%d = t%d_%d", atmp, _ti(atmp), dtmp, _ti(dtmp) );
+      H64_PRINT_128or256(loadSize)
+   }
+
+   // Information flow
+   if ( is_tainted(dtmp) && is_tainted(atmp) ) {
+      VG_(printf)( "%s <- t%d_%d", varname, dtmp, _ti(dtmp) );
+      VG_(printf)( "; %s <*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   } else if ( is_tainted(dtmp) ) {
+      VG_(printf)( "%s <- t%d_%d\n", varname, dtmp, _ti(dtmp) );
+   } else if ( is_tainted(atmp) ) {
+      VG_(printf)( "%s <*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   } else if ( !TNT_(clo_trace_taint_only) ) {
+      VG_(printf)( "%s <- t%d_%d", varname, dtmp, _ti(dtmp) );
+      VG_(printf)( "; %s <*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   } else
+      VG_(printf)("\n");
+}
+
+// STORE atmp = c for SIMD instructions
+VG_REGPARM(3)
+void TNT_(h64_store_v128or256_tc) (
+   IRStmt *clone,
+   ULong nLanes,
+   ULong w0, ULong w1, ULong w2, ULong w3 ) {
+
+   IRExpr *addr = clone->Ist.Store.addr;
+   UInt atmp = addr->Iex.RdTmp.tmp;
+   ULong valueArr[4] = { w0, w1, w2, w3 };
+   ULong taintArr[4] = {0};
+   UChar loadSize = nLanes;
+   unsigned i;
+
+   tl_assert( atmp < ti_max );
+   tl_assert( nLanes == 2 || nLanes == 4 );
+
+   Addr address = tv[atmp];
+   Bool isTainted = TNT_(store_taint_128or256)( address, loadSize*64, taintArr );
+
+   H_EXIT_EARLY_LDST_128or256
+
+   H_VAR_128or256(sizeof(ULong))
+
+   // we must wait for H_VAR to get mem description before returning
+   if( !TNT_(clo_trace) ) { return; }
+
+   H64_PC
+
+   VG_(sprintf)( aTmp, "STORE t%d_%d = CONST %s", atmp, _ti(atmp), nLanes == 4 ? "V256" : "V128" );
+   H64_PRINT_128or256(loadSize)
+
+   // Information flow
+   if ( !TNT_(clo_trace_taint_only) || is_tainted(atmp) )
+      VG_(printf)( "%s <-*- t%d_%d\n", varname, atmp, _ti(atmp) );
+   else
+      VG_(printf)("\n");
+}
+
+// STORE c = dtmp for SIMD instructions
 VG_REGPARM(3)
-void TNT_(h64_store_ct) (
+void TNT_(h64_store_v128or256_ct) (
    IRStmt *clone,
-   ULong value, 
-   ULong taint ) {
-      
-   H_EXIT_EARLY
+   ULong nLanes,
+   ULong w0, ULong w1, ULong w2, ULong w3 ) {
 
    IRExpr *addr = clone->Ist.Store.addr;
    IRExpr *data = clone->Ist.Store.data;
    ULong c      = extract_IRConst64(addr->Iex.Const.con);
    UInt dtmp    = data->Iex.RdTmp.tmp;
-   
-   tl_assert( dtmp < TI_MAX );
+   ULong valueArr[4] = { w0, w1, w2, w3 };
+   ULong taintArr[4] = {0};
+   UChar loadSize = nLanes;
+   unsigned i;
+
+   tl_assert( dtmp < ti_max );
+   tl_assert( nLanes == 2 || nLanes == 4 );
+
+   Addr address = c;
+   Bool isTainted = TNT_(store_taint_128or256)( address, loadSize*64, taintArr );
+
+   H_EXIT_BASE( isTainted )
+
+   H_VAR_128or256(sizeof(ULong))
 
-   ULong address = c;
-   H_VAR
-   
-#if _SECRETGRIND_
    // we must wait for H_VAR to get mem description before returning
    if( !TNT_(clo_trace) ) { return; }
-#endif
 
    H64_PC
-   
-#if !_SECRETGRIND_
-   // Check if it hasn't been seen before
-   if( myStringArray_getIndex( &lvar_s, varname ) == -1 ){
-      myStringArray_push( &lvar_s, varname );
-   }
-   lvar_i[ myStringArray_getIndex( &lvar_s, varname ) ]++;
-   
-#endif
 
-   if ( istty && is_tainted(dtmp) )
-   {
+   if ( istty && is_tainted(dtmp) ) {
       VG_(sprintf)( aTmp, "STORE 0x%llx = %st%d_%d%s", c, KRED, dtmp, _ti(dtmp), KNRM );
-      H64_PRINTC
+      H64_PRINTC_128or256(loadSize)
    } else {
       VG_(sprintf)( aTmp, "STORE 0x%llx = t%d_%d", c, dtmp, _ti(dtmp) );
-      H64_PRINT
+      H64_PRINT_128or256(loadSize)
    }
-   
-   // Information flow
-#if _SECRETGRIND_
 
-	if ( !TNT_(clo_trace_taint_only) || is_tainted(dtmp) )
-	  VG_(printf)( "%s <- t%d_%d\n", varname, dtmp, _ti(dtmp) );
-    else
-	  VG_(printf)("\n");
-	   
-#else
-   
-   if ( is_tainted(dtmp) )
-	  VG_(printf)( "%s_%d <- t%d_%d\n", varname, lvar_i[ myStringArray_getIndex( &lvar_s, varname ) ], dtmp, _ti(dtmp) );
+   // Information flow
+   if ( !TNT_(clo_trace_taint_only) || is_tainted(dtmp) )
+      VG_(printf)( "%s <- t%d_%d\n", varname, dtmp, _ti(dtmp) );
    else
-	  VG_(printf)("\n");
-   	  
-#endif
-}
-
-#if _SECRETGRIND_
-static SizeT TNT_(size_of_load)(IRType ty, SizeT n) {
-
-	tl_assert ( n==4 || n==8 );
-	SizeT loadSize = 0;
-	
-	switch (ty) {
-   
-	/* simple cases */
-	case Ity_I1:
-    case Ity_I8:
-    case Ity_I16: 
-    case Ity_I32:
-    case Ity_I64:
-    case Ity_F32:
-    case Ity_F64:
-    case Ity_D32:
-    case Ity_D64:
-		loadSize = 1;
-		break;
-     
-    /* special cases */
-    case Ity_V128:
-		loadSize = 128/(n*8);
-		break;
-		
-    case Ity_V256:
-		loadSize = 256/(n*8);
-		break;
-		
-	/* trap on these for now, because I don't know if we can handle it correctly */
-	case Ity_INVALID:
-	case Ity_I128:
-	case Ity_D128:
-	case Ity_F128:
-	default: VG_(tool_panic)("tnt_main.c: size_of_load: Unsupported type ty");
-   }
-	
-	return loadSize;
+      VG_(printf)("\n");
 }
 #endif
 
@@ -5319,7 +5673,7 @@ void TNT_(h64_load_v128or256_t) (
    IRExpr* addr = clone->Ist.WrTmp.data->Iex.Load.addr;
    UInt atmp    = addr->Iex.RdTmp.tmp;
    tl_assert ( ty+Ity_INVALID==Ity_V128 || ty+Ity_INVALID==Ity_V256 );
-   tl_assert( atmp < TI_MAX );
+   tl_assert( atmp < ti_max );
    //LOG("load:atmp:%u, tv[atmp]:%llx\n", atmp, tv[atmp]);
    ULong address = tv[atmp];
         
@@ -5418,7 +5772,7 @@ void TNT_(h64_load_t) (
    IRExpr* addr = clone->Ist.WrTmp.data->Iex.Load.addr;
    UInt atmp    = addr->Iex.RdTmp.tmp;
 
-   tl_assert( atmp < TI_MAX );
+   tl_assert( atmp < ti_max );
    //LOG("load:atmp:%u, tv[atmp]:%llx\n", atmp, tv[atmp]);
    ULong address = tv[atmp];
    
@@ -5632,7 +5986,7 @@ void TNT_(h64_put_t) (
    UInt tmp     = data->Iex.RdTmp.tmp;
    
    tl_assert( reg < RI_MAX );
-   tl_assert( tmp < TI_MAX );
+   tl_assert( tmp < ti_max );
    ri[reg]++;
 
    if ( istty && is_tainted(tmp) )
@@ -5724,7 +6078,7 @@ void TNT_(h64_puti) (
 
    // TODO: Info flow
    //tl_assert( reg < RI_MAX );
-   //tl_assert( tmp < TI_MAX );
+   //tl_assert( tmp < ti_max );
    //ri[reg]++;
 
    //VG_(printf)("r%d_%d <- t%d_%d\n", reg, ri[reg], tmp, ti[tmp]);
@@ -5774,7 +6128,7 @@ void TNT_(h64_unop_t) (
    IRExpr* arg = clone->Ist.WrTmp.data->Iex.Unop.arg;
    UInt rtmp = arg->Iex.RdTmp.tmp;
    
-   tl_assert( rtmp < TI_MAX );
+   tl_assert( rtmp < ti_max );
   
    if ( istty && is_tainted(ltmp) )
    {
@@ -5868,7 +6222,7 @@ void TNT_(h64_binop_tc) (
    
    ULong c = extract_IRConst64(arg2->Iex.Const.con);
    
-   tl_assert( rtmp1 < TI_MAX );
+   tl_assert( rtmp1 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -5925,7 +6279,7 @@ void TNT_(h64_binop_ct) (
    ULong c = extract_IRConst64(arg1->Iex.Const.con);
    UInt rtmp2 = arg2->Iex.RdTmp.tmp;
 
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( rtmp2 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -5982,8 +6336,8 @@ void TNT_(h64_binop_tt) (
    UInt rtmp1 = arg1->Iex.RdTmp.tmp;
    UInt rtmp2 = arg2->Iex.RdTmp.tmp;
    
-   tl_assert( rtmp1 < TI_MAX );
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( rtmp1 < ti_max );
+   tl_assert( rtmp2 < ti_max );
 
    if ( istty && is_tainted(ltmp) )
    {
@@ -6109,7 +6463,7 @@ void TNT_(h64_rdtmp) (
 
    UInt rtmp = clone->Ist.WrTmp.data->Iex.RdTmp.tmp;
 
-   tl_assert( rtmp < TI_MAX );
+   tl_assert( rtmp < ti_max );
 
    // Sanity check for the WrTmp book-keeping,
    // since RdTmp is essentially a no-op
@@ -6164,8 +6518,8 @@ void TNT_(h64_ite_tc) (
    UInt rtmp1   = data->Iex.ITE.iftrue->Iex.RdTmp.tmp;
    ULong c      = extract_IRConst64(data->Iex.ITE.iffalse->Iex.Const.con);
 
-   tl_assert( ctmp  < TI_MAX );
-   tl_assert( rtmp1 < TI_MAX );
+   tl_assert( ctmp  < ti_max );
+   tl_assert( rtmp1 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -6215,8 +6569,8 @@ void TNT_(h64_ite_ct) (
    ULong c      = extract_IRConst64(data->Iex.ITE.iftrue->Iex.Const.con);
    UInt rtmp2   = data->Iex.ITE.iffalse->Iex.RdTmp.tmp;
 
-   tl_assert( ctmp  < TI_MAX );
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( ctmp  < ti_max );
+   tl_assert( rtmp2 < ti_max );
 
    if ( istty && is_tainted(ltmp) )
    {
@@ -6267,9 +6621,9 @@ void TNT_(h64_ite_tt) (
    UInt rtmp1   = data->Iex.ITE.iftrue->Iex.RdTmp.tmp;
    UInt rtmp2   = data->Iex.ITE.iffalse->Iex.RdTmp.tmp;
 
-   tl_assert( ltmp  < TI_MAX );
-   tl_assert( rtmp1 < TI_MAX );
-   tl_assert( rtmp2 < TI_MAX );
+   tl_assert( ltmp  < ti_max );
+   tl_assert( rtmp1 < ti_max );
+   tl_assert( rtmp2 < ti_max );
    
    if ( istty && is_tainted(ltmp) )
    {
@@ -6325,7 +6679,7 @@ void TNT_(h64_ite_cc) (
    ULong c1     = extract_IRConst64(data->Iex.ITE.iftrue->Iex.Const.con);
    ULong c2     = extract_IRConst64(data->Iex.ITE.iffalse->Iex.Const.con);
 
-   tl_assert( ctmp  < TI_MAX );
+   tl_assert( ctmp  < ti_max );
    if ( (ti[ctmp] & 0x80000000) == 0 ) return;
 
    VG_(sprintf)( aTmp, "t%d_%d = t%d_%d ? 0x%llx : 0x%llx",
@@ -6448,6 +6802,12 @@ void TNT_(hxx_imark_t) ( IRStmt *clone) {
 	//tl_assert ("got ya" && TNT_(current_inst.ID) != 0x8934c6);
 }
 
+// only emitted in summary-only mode, see imark_needs_main_summary() in tnt_translate.c
+VG_REGPARM(0)
+void TNT_(hxx_main_summary) ( void ) {
+	TNT_(show_main_summary)();
+}
+
 
 static Bool TNT_(parse_data)(const char *in, const char *left, const char *right, char *out, SizeT len)
 {
@@ -6489,7 +6849,7 @@ static void TNT_(format_detailedvarname)(char *varnamebuf, SizeT bufsize, char *
 void TNT_(get_object_name)(char *objname, SizeT n)
 {
 	HChar binarynamebuf[1024] = "\0";
-	UInt pc = VG_(get_IP)(VG_(get_running_tid)());
+	UInt pc = TNT_(helper_IP)();
 	
 	// what shall I use? Both I think !
 	// VG_(describe_IP) ( pc, binarynamebuf, 1024, NULL );
@@ -6559,7 +6919,7 @@ static void TNT_(parse_all_descr)(char *descr1, char *descr2,
 		 TNT_(parse_data)(descr1, LOCAL_STACK_VAR_LEFT, 0, varname, size)  ) { LOG("varname: %s\n", varname); }
 	if ( TNT_(parse_data)(descr2, DECLARED, DDOTS, filename, size) ) { LOG("filename: %s\n", filename); }
 	if ( TNT_(parse_data)(descr2, DDOTS, COMMA, lineno, size) ) { LOG("line: %s\n", lineno); }
-	if ( VG_(get_fnname)( VG_(get_IP)(VG_(get_running_tid)()), funcname, size ) ) { LOG("funcname: %s\n", funcname); }
+	if ( VG_(get_fnname)( TNT_(helper_IP)(), funcname, size ) ) { LOG("funcname: %s\n", funcname); }
 	
 	// fix the ',' at the end
 	if ( varname[0] != '\0' && varname[ VG_(strlen)(varname) - 1 ] == ',' ) { varname[ VG_(strlen)(varname) - 1 ] = '\0'; }
@@ -7236,14 +7596,13 @@ static void init_shadow_memory ( void )
       primary_map[i] = &sm_distinguished[SM_DIST_UNTAINTED];
 //      primary_map[i] = &sm_distinguished[SM_DIST_NOACCESS];
 
-   /* Auxiliary primary maps */
-   init_auxmap_L1_L2();
+   /* Auxiliary primary map */
+   init_auxmap();
 
    /* auxmap_size = auxmap_used = 0;
       no ... these are statically initialised */
 
-   /* Secondary V bit table */
-   secVBitTable = createSecVBitTable();
+   /* Secondary V bit table: created on first use, see set_sec_vbits8() */
 
 #if 0
    // Taintgrind: Solely for testing
@@ -7251,6 +7610,27 @@ static void init_shadow_memory ( void )
 #endif
 }
 
+/* --shadow-format=compact: the distinguished secondaries hold 1 bit per
+   byte instead. Called once the options are known, before the tool is
+   told about any memory. */
+static void init_shadow_format ( void )
+{
+   Int i;
+
+   if (!TNT_(clo_shadow_compact))
+      return;
+
+   tl_assert(n_non_DSM_SMs == 0);
+   for (i = 0; i < SM_CHUNKS; i++) {
+      sm_distinguished[SM_DIST_NOACCESS ].vabits8[i] = TA_BITS8_UNTAINTED;
+      sm_distinguished[SM_DIST_TAINTED  ].vabits8[i] = TA_BITS8_TAINTED;
+      sm_distinguished[SM_DIST_UNTAINTED].vabits8[i] = TA_BITS8_UNTAINTED;
+   }
+
+   /* No partially tainted bytes, so the sec-V-bit table is never made */
+   tl_assert(secVBitTable == NULL);
+}
+
 //static void read_allowed_syscalls() {
 //	char* filename = TNT_(clo_allowed_syscalls);
 //	int fd = VG_(fd_open)(filename, VKI_O_RDONLY, 0);
@@ -7380,6 +7760,124 @@ void tnt_post_syscall(ThreadId tid, UInt syscallno,
   }
 }
 
+#if _SECRETGRIND_
+
+/*------------------------------------------------------------*/
+/*--- libc memory/string models (see tnt_wraps.c)          ---*/
+/*------------------------------------------------------------*/
+
+/* The wrappers in tnt_wraps.c hand memcpy/memmove/memset/strcpy/strlen
+   over to us. We run them natively, ie without instrumentation, and
+   apply their effect on the shadow memory in one go. Each model returns
+   False if it did not run: the wrapper then calls the original routine. */
+
+static ULong n_models_run = 0;
+static ULong n_models_bytes = 0;
+
+static Bool model_enabled ( void )
+{
+   // the trace and the verbose summary must see every instruction
+   return TNT_(clo_libc_models) && !TNT_(clo_trace) && !TNT_(clo_summary_verbose);
+}
+
+/* Length of the client string at s. False if it runs into memory
+   the client cannot read. */
+static Bool model_client_strlen ( Addr s, SizeT* len )
+{
+   Addr a = s, page_end = s;
+
+   for (;;) {
+      if (a == page_end) {
+         if (!VG_(am_is_valid_for_client)( a, 1, VKI_PROT_READ ))
+            return False;
+         page_end = VG_PGROUNDUP( a+1 );
+      }
+      if (*(const HChar*)a == '\0')
+         break;
+      ++a;
+   }
+   *len = a - s;
+   return True;
+}
+
+static Bool model_range_tainted ( Addr a, SizeT len )
+{
+   SizeT i;
+   for (i = 0; i < len; ++i) {
+      UChar vabits2 = get_vabits2( a+i );
+      if (vabits2 == VA_BITS2_TAINTED || vabits2 == VA_BITS2_PARTUNTAINTED)
+         return True;
+   }
+   return False;
+}
+
+static Bool TNT_(model_memmove) ( Addr dst, Addr src, SizeT n )
+{
+   if (!model_enabled())
+      return False;
+   if (n && !( VG_(am_is_valid_for_client)( src, n, VKI_PROT_READ )
+            && VG_(am_is_valid_for_client)( dst, n, VKI_PROT_WRITE ) ))
+      return False;
+
+   VG_(memmove)( (void*)dst, (const void*)src, n );
+   TNT_(copy_address_range_state)( src, dst, n );
+   ++n_models_run;
+   n_models_bytes += n;
+   return True;
+}
+
+static Bool TNT_(model_memset) ( Addr dst, Addr cAddr, SizeT n )
+{
+   if (!model_enabled())
+      return False;
+   if (n && !VG_(am_is_valid_for_client)( dst, n, VKI_PROT_WRITE ))
+      return False;
+
+   // memset only uses the low byte of c, ie the one at cAddr
+   VG_(memset)( (void*)dst, *(const Int*)cAddr & 0xff, n );
+   if (model_range_tainted( cAddr, 1 )) {
+      set_address_range_perms ( dst, n, VA_BITS16_TAINTED, SM_DIST_TAINTED );
+      if (TNT_(clo_taint_labels))
+         TNT_(labels_taint)( dst, n, TNT_(labels_get)( cAddr, 1 ) );
+   } else
+      TNT_(make_mem_untainted)( dst, n );
+   ++n_models_run;
+   n_models_bytes += n;
+   return True;
+}
+
+static Bool TNT_(model_strcpy) ( Addr dst, Addr src )
+{
+   SizeT len;
+
+   if (!model_enabled() || !model_client_strlen( src, &len ))
+      return False;
+   // the terminating NUL is copied too
+   return TNT_(model_memmove)( dst, src, len+1 );
+}
+
+static Bool TNT_(model_strlen) ( Addr s, Addr rAddr )
+{
+   SizeT len;
+
+   if (!model_enabled() || !model_client_strlen( s, &len ))
+      return False;
+   if (!VG_(am_is_valid_for_client)( rAddr, sizeof(SizeT), VKI_PROT_WRITE ))
+      return False;
+
+   // the length depends on every byte up to and including the NUL
+   *(SizeT*)rAddr = len;
+   if (model_range_tainted( s, len+1 ))
+      set_address_range_perms ( rAddr, sizeof(SizeT), VA_BITS16_TAINTED, SM_DIST_TAINTED );
+   else
+      TNT_(make_mem_untainted)( rAddr, sizeof(SizeT) );
+   ++n_models_run;
+   n_models_bytes += len+1;
+   return True;
+}
+
+#endif // _SECRETGRIND_
+
 Bool TNT_(handle_client_requests) ( ThreadId tid, UWord* arg, UWord* ret ) {
 	switch (arg[0]) {
 		case VG_USERREQ__TAINTGRIND_ENTER_PERSISTENT_SANDBOX: {
@@ -7448,6 +7946,7 @@ Bool TNT_(handle_client_requests) ( ThreadId tid, UWord* arg, UWord* ret ) {
 			TNT_(make_mem_tainted)(addr, len);
 			#if _SECRETGRIND_
 			TNT_(record_receive_taint_for_addr)(addr, len, True, "API call");
+			if ( TNT_(clo_taint_labels) ) { TNT_(labels_taint)(addr, len, TNT_(label_for)("API call")); }
 			// keep track of varname
 			//HChar varname[256];  HChar vardname[256]; 
 		    //TNT_(describe_data)(addr, varname, sizeof(varname), vardname, sizeof(vardname), "Store-TAINTGRIND_MAKE_MEM_TAINTED", len);
@@ -7486,6 +7985,31 @@ Bool TNT_(handle_client_requests) ( ThreadId tid, UWord* arg, UWord* ret ) {
 			var_taint_status((char*)arg[1], arg[2], arg[3]);
 			break;
 		}
+
+		case VG_USERREQ__TAINTGRIND_MODEL_MEMMOVE: {
+			*ret = TNT_(model_memmove)((Addr)arg[1], (Addr)arg[2], (SizeT)arg[3]);
+			break;
+		}
+		case VG_USERREQ__TAINTGRIND_MODEL_MEMSET: {
+			*ret = TNT_(model_memset)((Addr)arg[1], (Addr)arg[2], (SizeT)arg[3]);
+			break;
+		}
+		case VG_USERREQ__TAINTGRIND_MODEL_STRCPY: {
+			*ret = TNT_(model_strcpy)((Addr)arg[1], (Addr)arg[2]);
+			break;
+		}
+		case VG_USERREQ__TAINTGRIND_MODEL_STRLEN: {
+			*ret = TNT_(model_strlen)((Addr)arg[1], (Addr)arg[2]);
+			break;
+		}
+		case VG_USERREQ__TAINTGRIND_MODEL_ENTER: {
+			*ret = TNT_(model_enter)(tid, (const HChar*)arg[1], (const SG_region*)arg[2], arg[3]);
+			break;
+		}
+		case VG_USERREQ__TAINTGRIND_MODEL_EXIT: {
+			TNT_(model_exit)(tid, (const SG_region*)arg[1], arg[2], (const SG_region*)arg[3], arg[4]);
+			break;
+		}
 		#endif
 	}
 	return True;
@@ -7501,6 +8025,8 @@ Bool TNT_(handle_client_requests) ( ThreadId tid, UWord* arg, UWord* ret ) {
 #define LEN_DEFAULT 0x800000
 #if _SECRETGRIND_
 #	include "tnt_file_filter.h"
+#	include "tnt_instr_filter.h"
+#	include "tnt_models.h"
 #else
 HChar         TNT_(clo_file_filter)[MAX_PATH]  ;
 #endif
@@ -7523,6 +8049,22 @@ Bool 		  TNT_(clo_taint_stdin) 		   = False;
 Bool          TNT_(clo_taint_df_only)       	= False;
 Bool          TNT_(clo_taint_remove_on_release)    = False;
 Bool          TNT_(clo_batchmode)        		= False;	// this one is not passed by user. See tnt_post_clo_init()
+Bool          TNT_(instr_summary_only)        	= False;	// this one is not passed by user. See tnt_post_clo_init()
+Bool          TNT_(instr_guard_helpers)        	= False;	// this one is not passed by user. See tnt_post_clo_init()
+Bool          TNT_(clo_lazy_instrument)        	= False;
+Bool          TNT_(instr_lazy_pending)        	= False;	// this one is not passed by user. See tnt_post_clo_init()
+Bool          TNT_(clo_inline_fast_path)        	= False;
+Bool          TNT_(clo_shadow_compact)        	= False;
+Bool          TNT_(clo_taint_labels)        	= False;
+Bool          TNT_(clo_event_buffer)        	= False;
+Bool          TNT_(clo_shadow_opt)        	= False;
+UInt          TNT_(clo_tier_threshold)        	= 0;
+Bool          TNT_(clo_fast_precision)        	= False;
+UInt          TNT_(clo_instr_stats)        	= 0;	// 0: no, 1: yes, 2: per object too
+Bool          TNT_(clo_static_untainted)        	= False;
+Bool          TNT_(clo_libc_models)        	= True;
+GuestRange_t  TNT_(clo_untainted_guest)[MAX_UNTAINTED_GUEST];	// zeroed at startup since non initialized data
+UInt          TNT_(clo_n_untainted_guest)       = 0;
 Bool          TNT_(clo_summary)			        = True;
 Bool          TNT_(clo_summary_verbose)        = False;
 Bool          TNT_(clo_summary_exit_only)      = False;
@@ -7588,6 +8130,55 @@ static void parse_file_filter_list(const char *str) {
 	
 }
 
+static void parse_instr_filter_list(const char *str, void (*add)(const HChar *s)) {
+	
+	char *token;
+	const char *del = ",";
+	
+	token = VG_(strtok)((HChar*)str, del);
+	
+	while( token != NULL ) {
+		add(token);
+		token = VG_(strtok)(NULL, del);
+	}
+}
+
+// <offset>:<size>,... in bytes, see VEX/pub/libvex_guest_<arch>.h
+// str is the value of the option arg, which is refused if str is malformed
+static void parse_untainted_guest_list(const HChar *arg, const char *str) {
+	
+	char *token;
+	const char *del = ",";
+	char *ptr, *size;
+	Bool ok;
+	
+	token = VG_(strtok)((HChar*)str, del);
+	
+	while( token != NULL ) {
+		
+		GuestRange_t *r;
+		
+		if ( TNT_(clo_n_untainted_guest) == MAX_UNTAINTED_GUEST ) {
+			VG_(fmsg_bad_option)(arg, "expected at most %d <offset>:<size> pairs\n", MAX_UNTAINTED_GUEST);
+		}
+		
+		r = &TNT_(clo_untainted_guest)[TNT_(clo_n_untainted_guest)];
+		r->offset = VG_(strtoll10)(token, &ptr);
+		ok = ptr != token && *ptr == ':' && r->offset >= 0;
+		if ( ok ) {
+			size = ptr+1;
+			r->size = VG_(strtoll10)(size, &ptr);
+			ok = ptr != size && *ptr == '\0' && r->size > 0;
+		}
+		if ( !ok ) {
+			VG_(fmsg_bad_option)(arg, "malformed '%s': expected <offset>:<size> with <offset> >= 0 and <size> > 0\n", token);
+		}
+		
+		++TNT_(clo_n_untainted_guest);
+		token = VG_(strtok)(NULL, del);
+	}
+}
+
 static void parse_fix_instruction_id_list(const char *str) {
 	SizeT i = 0;
 	
@@ -7653,6 +8244,33 @@ static Bool tnt_process_cmd_line_options(const HChar* arg) {
    else if VG_BOOL_CLO(arg, "--var-name", TNT_(clo_var_name)) {}
    else if VG_BOOL_CLO(arg, "--debug", TNT_(clo_verbose)) {}
    else if VG_BOOL_CLO(arg, "--mnemonics", TNT_(clo_mnemonics)) {}
+   else if VG_BOOL_CLO(arg, "--lazy-instrument", TNT_(clo_lazy_instrument)) {}
+   else if VG_BOOL_CLO(arg, "--inline-fast-path", TNT_(clo_inline_fast_path)) {}
+   else if VG_XACT_CLO(arg, "--shadow-format=standard", TNT_(clo_shadow_compact), False) {}
+   else if VG_XACT_CLO(arg, "--shadow-format=compact", TNT_(clo_shadow_compact), True) {}
+   else if VG_BOOL_CLO(arg, "--taint-labels", TNT_(clo_taint_labels)) {}
+   else if VG_BOOL_CLO(arg, "--event-buffer", TNT_(clo_event_buffer)) {}
+   else if VG_BOOL_CLO(arg, "--shadow-opt", TNT_(clo_shadow_opt)) {}
+   else if VG_BINT_CLO(arg, "--tier-threshold", TNT_(clo_tier_threshold), 0, 1000000) {}
+   else if VG_XACT_CLO(arg, "--precision=fast", TNT_(clo_fast_precision), True) {}
+   else if VG_XACT_CLO(arg, "--precision=exact", TNT_(clo_fast_precision), False) {}
+   else if VG_XACT_CLO(arg, "--instr-stats=no", TNT_(clo_instr_stats), 0) {}
+   else if VG_XACT_CLO(arg, "--instr-stats=yes", TNT_(clo_instr_stats), 1) {}
+   else if VG_XACT_CLO(arg, "--instr-stats=objs", TNT_(clo_instr_stats), 2) {}
+   else if VG_BOOL_CLO(arg, "--static-untainted", TNT_(clo_static_untainted)) {}
+   else if VG_BOOL_CLO(arg, "--libc-models", TNT_(clo_libc_models)) {}
+   else if VG_STR_CLO (arg, "--models", tmp_str) {
+      TNT_(models_load)(tmp_str);
+   }
+   else if VG_STR_CLO (arg, "--untainted-guest-state", tmp_str) {
+      parse_untainted_guest_list(arg, tmp_str);
+   }
+   else if VG_STR_CLO (arg, "--instrument-objs", tmp_str) {
+      parse_instr_filter_list(tmp_str, TNT_(instr_filter_add_obj));
+   }
+   else if VG_STR_CLO (arg, "--instrument-fns", tmp_str) {
+      parse_instr_filter_list(tmp_str, TNT_(instr_filter_add_fn));
+   }
    
    // summary options
    else if VG_BOOL_CLO(arg, "--summary", TNT_(clo_summary)) {}
@@ -7706,6 +8324,21 @@ static void tnt_print_usage(void) {
 "%sGeneral options:%s\n"
 "    --var-name= no|yes                print variable names if possible [no]. Very slow, so try using in combination with SG_PRINT_X_INST()\n"
 "    --mnemonics= no|yes               display the mnemonics of the original instruction responsible for tainting data [no]\n"
+"    --lazy-instrument= no|yes         do not instrument until the first taint source (file, stdin or secretgrind API) [no]. Speeds up long start-ups\n"
+"    --instrument-objs=<o1,o2,...,on>  only trace/summarize instructions in these objects, eg *libcrypto.so* [\"\"]. Taint still propagates elsewhere\n"
+"    --instrument-fns=<f1,f2,...,fn>   only trace/summarize instructions in these functions, eg EVP_* [\"\"]. Taint still propagates elsewhere\n"
+"    --inline-fast-path= no|yes        check shadow memory inline for aligned loads/stores, call a helper only for the rest [no]. 64-bit hosts only\n"
+"    --shadow-format= standard|compact shadow memory layout: compact keeps 1 taint bit per byte, halving shadow memory; partially tainted bytes become tainted [standard]\n"
+"    --taint-labels= no|yes            remember the source (file, stdin, API call) of tainted bytes and show it in the taint summary [no]\n"
+"    --event-buffer= no|yes            batch the trace helpers of each superblock into one call [no]. Speeds up --trace; not with --summary-verbose, --var-name or --mnemonics\n"
+"    --shadow-opt= no|yes              fold, forward and remove redundant shadow code in each superblock [no]\n"
+"    --tier-threshold=[0,1000000]      only trace a superblock once N of its executions read tainted data, 0 to disable [0]. Speeds up --trace-taint-only=yes\n"
+"    --precision= fast|exact           exact uses memcheck's precise rules for adds, subs, compares and ctz when they matter; fast always smears taint over the whole result [exact]\n"
+"    --instr-stats= no|yes|objs        print what the instrumentation produced at exit: IR statements, helper calls per kind, clone bytes [no]. objs adds a per-object breakdown\n"
+"    --static-untainted= no|yes        never taint the stack/instruction pointers and always-defined guest state, and do not shadow temps computed only from them and constants [no]\n"
+"    --untainted-guest-state=<o1:s1,...> extra guest state slices (byte offset:size) --static-untainted never taints, eg segment bases or FPU control words [\"\"]\n"
+"    --libc-models= no|yes             run memcpy, memmove, memset, strcpy and strlen natively and update their taint in one go [yes]. Ignored with --trace and --summary-verbose\n"
+"    --models=<file>                   taint summaries for the crypto functions wrapped in tnt_wraps.c: the file enables them ('model <fn>') and lists the objects to run without propagation ('object <obj>'), which lose the taint they copy outside the model outputs [\"\"]\n"
 "    --debug= no|yes                   print debug info [no]\n",
 
    KUDL, KNRM, KUDL, KNRM, KUDL, KNRM, KUDL, KNRM, KUDL, KNRM);
@@ -7734,6 +8367,34 @@ static void tnt_print_debug_usage(void)
    );
 }
 
+#if _SECRETGRIND_
+// switch the flavour of instrumentation used by TNT_(instrument), retranslating everything if it changed
+static void TNT_(set_instrument_state)(Bool summaryOnly, Bool guardHelpers, const HChar *reason) {
+	
+	if ( summaryOnly == TNT_(instr_summary_only) && guardHelpers == TNT_(instr_guard_helpers) ) { return; }
+	
+	LOG("set_instrument_state: summary-only %u->%u, guard %u->%u (%s)\n",
+	    TNT_(instr_summary_only), summaryOnly, TNT_(instr_guard_helpers), guardHelpers, reason);
+	
+	TNT_(instr_summary_only) = summaryOnly;
+	TNT_(instr_guard_helpers) = guardHelpers;
+	// untainted instructions get printed too, so we cannot wait for a taint source anymore
+	if ( !guardHelpers ) { TNT_(instr_lazy_pending) = False; }
+	VG_(discard_translations)( (Addr64)0x1000, (ULong) ~0xfffULL, "secretgrind" );
+}
+
+// --lazy-instrument=yes: the first taint source has fired, so retranslate everything with full instrumentation
+static void TNT_(end_lazy_instrument)(const HChar *reason) {
+	
+	tl_assert ( TNT_(instr_lazy_pending) );
+	
+	LOG("end_lazy_instrument (%s)\n", reason);
+	
+	TNT_(instr_lazy_pending) = False;
+	VG_(discard_translations)( (Addr64)0x1000, (ULong) ~0xfffULL, "secretgrind" );
+}
+#endif
+
 void TNT_(stop_print)(void) {
 	TNT_(do_print) = 0;
 #if _SECRETGRIND_
@@ -7758,6 +8419,9 @@ void TNT_(start_print)(Bool taintedInstOnly) {
 	}
 	TNT_(clo_trace) = False;
 	TNT_(clo_trace_taint_only) = taintedInstOnly;
+	
+	// summary-only translations have no helpers to print with, and guarded ones skip untainted instructions
+	TNT_(set_instrument_state)( False, TNT_(instr_guard_helpers) && taintedInstOnly, "start_print" );
 #endif
 	
 }
@@ -7872,19 +8536,18 @@ static void tnt_post_clo_init(void)
 #endif
 
    if( TNT_(clo_critical_ins_only) ) { TNT_(clo_trace_taint_only) = True; }
+
+   init_shadow_format();
       
    // Initialise temporary variables/reg SSA index array
 #if _SECRETGRIND_
    // Note: this is actually not necessary as it's a global and therefore zeroed on startup...
-   VG_(memset)(ti, 0, sizeof(ti));
+   // The ti/tv tables are zeroed when allocated, see tmp_table_switch()
    VG_(memset)(ri, 0, sizeof(ri));
    VG_(memset)(lvar_i, 0, sizeof(lvar_i));
 #else
    Int i;
-   for( i=0; i< TI_MAX; i++ ) {
-      ti[i] = 0;
-      tv[i] = 0;
-   }
+   // The ti/tv tables are zeroed when allocated, see tmp_table_switch()
    for( i=0; i< RI_MAX; i++ )
       ri[i] = 0;
    for( i=0; i< STACK_SIZE; i++ )
@@ -7907,6 +8570,35 @@ static void tnt_post_clo_init(void)
         VG_(exit)(1);
 	}
 	
+	// replayed helpers would record the stack of the end of the superblock, not that of their instruction
+	if ( TNT_(clo_event_buffer) && TNT_(clo_summary_verbose) ) {
+		VG_(printf)("*** --event-buffer=yes and --summary-verbose=yes are incompatible\n");
+        VG_(exit)(1);
+	}
+	
+	// nor can they describe the variables or disassemble from the SP and memory of their instruction
+	if ( TNT_(clo_event_buffer) && TNT_(clo_var_name) ) {
+		VG_(printf)("*** --event-buffer=yes and --var-name=yes are incompatible\n");
+        VG_(exit)(1);
+	}
+	
+	if ( TNT_(clo_event_buffer) && TNT_(clo_mnemonics) ) {
+		VG_(printf)("*** --event-buffer=yes and --mnemonics=yes are incompatible\n");
+        VG_(exit)(1);
+	}
+	
+	// the inline IR reads the 2-bit layout, see TNT_(get_shadow_layout)()
+	if ( TNT_(clo_inline_fast_path) && TNT_(clo_shadow_compact) ) {
+		VG_(printf)("*** --inline-fast-path=yes and --shadow-format=compact are incompatible\n");
+        VG_(exit)(1);
+	}
+	
+	// inline fully-tainted loads and stores never reach the helpers that propagate labels
+	if ( TNT_(clo_inline_fast_path) && TNT_(clo_taint_labels) ) {
+		VG_(printf)("*** --inline-fast-path=yes and --taint-labels=yes are incompatible\n");
+        VG_(exit)(1);
+	}
+	
 	if ( TNT_(clo_taint_all) ) {
 		// Note: the reason for this is during summary display,
 		// i currently assume ranges ofr continuous address spaces do not
@@ -7917,6 +8609,21 @@ static void tnt_post_clo_init(void)
 	
 	TNT_(clo_batchmode) = TNT_(clo_summary_total_only) && !TNT_(clo_trace);
 	
+	// without a trace or a verbose summary, every per-statement helper returns straight away
+	// (see H_EXIT_BASE), so only instrument for the shadow state. TNT_(start_print)() reverts this
+	TNT_(instr_summary_only) = !TNT_(clo_trace) && !TNT_(clo_summary_verbose);
+	
+	// the helpers only do work on tainted operands, unless we trace all instructions
+	TNT_(instr_guard_helpers) = !(TNT_(clo_trace) && !TNT_(clo_trace_taint_only));
+	
+	// nothing is tainted until a source fires, so there is nothing to propagate or print
+	// until then -- unless all instructions are traced. See TNT_(make_mem_tainted)()
+	TNT_(instr_lazy_pending) = TNT_(clo_lazy_instrument) && TNT_(instr_guard_helpers);
+	
+	if ( TNT_(clo_tier_threshold) ) {
+		TNT_(tier_nodes) = VG_(HT_construct)( "TNT_(tier_nodes)" );
+	}
+	
 	// always the case fiven stuff above
 	//if ( TNT_(clo_summary_total_only) ) {
 	//	!TNT_(clo_trace) = True;
@@ -7995,6 +8702,22 @@ Bool TNT_(is_mem_byte_tainted)(Addr a)
 	UChar vabits2 = get_vabits2(a); 
 	return ( vabits2 == VA_BITS2_TAINTED || vabits2 == VA_BITS2_PARTUNTAINTED );
 }
+
+// len must not cross a 64k boundary: whole distinguished SecMaps are answered without a byte walk
+SizeT TNT_(count_tainted_bytes)(Addr a, SizeT len)
+{
+	SecMap *sm = get_secmap_for_reading(a);
+	SizeT n = 0;
+	Addr end = a + len;
+
+	tl_assert ( len == 0 || VG_ROUNDDN(a, SM_SIZE) == VG_ROUNDDN(end-1, SM_SIZE) );
+	if ( sm == &sm_distinguished[SM_DIST_TAINTED] ) { return len; }
+	if ( is_distinguished_sm(sm) ) 					{ return 0; }
+	for ( ; a<end; ++a ) {
+		if ( TNT_(is_mem_byte_tainted)(a) ) { ++n; }
+	}
+	return n;
+}
 static void var_taint_status(char *desc, Addr a, SizeT len) 
 {
 	// TODO: handle any size -- check code from other functions
@@ -8044,6 +8767,7 @@ static void var_taint_status(char *desc, Addr a, SizeT len)
 static void TNT_(display_range_summary_header)(SizeT debugNum, const char *type, Addr start, Addr end, SizeT len) {
 	if ( TNT_(clo_summary_total_only) ) { return; }
 	EMIT_ERROR("\n***(%lu) (%s)\t range [0x%lx - 0x%lx]\t (%lu bytes)\t is tainted\n", debugNum, type, start, end, len);
+	if ( TNT_(clo_taint_labels) ) { TNT_(labels_print_range)(start, len); }
 }
 
 #define INC_TOT_TAINTED() do{ tl_assert (*ptotTainted <= (Addr)(-1) - gLen); *ptotTainted += gLen; }while(0)
@@ -8071,8 +8795,15 @@ static void _do_low_secmap_entry(Addr base, SizeT * ptotTainted, SizeT * punacco
 	
 	for (; a<addEnd; a+=8) { 
 		
-		sm_off16  = SM_OFF_16(a);
-		vabits16 = ((UShort*)(sm16->vabits8))[sm_off16];
+		if ( TNT_(clo_shadow_compact) ) {
+			// map the 8 taint bits onto the standard format; any other value means mixed
+			vabits16 = sm16->vabits8[SM_OFF_C(a)];
+			if ( vabits16 == TA_BITS8_UNTAINTED )		{ vabits16 = VA_BITS16_UNTAINTED; }
+			else if ( vabits16 == TA_BITS8_TAINTED )	{ vabits16 = VA_BITS16_TAINTED; }
+		} else {
+			sm_off16  = SM_OFF_16(a);
+			vabits16 = ((UShort*)(sm16->vabits8))[sm_off16];
+		}
 		
 		// VA_BITS16_NOACCESS should NEVER happen. I've fixed the find_or_alloc function for that
 		// nevertheless, for debug purposes, assert it...
@@ -8099,9 +8830,13 @@ static void _do_low_secmap_entry(Addr base, SizeT * ptotTainted, SizeT * punacco
 			Addr b = a;
 			for ( ; b<a+8; ++b) {
 				
-				sm_off  = SM_OFF(b);
-				vabits8 = (sm->vabits8)[sm_off];
-				vabits2 = extract_vabits2_from_vabits8 (b, vabits8);
+				if ( TNT_(clo_shadow_compact) ) {
+					vabits2 = extract_tabits1_from_tabits8 (b, (sm->vabits8)[SM_OFF_C(b)]) ? VA_BITS2_TAINTED : VA_BITS2_UNTAINTED;
+				} else {
+					sm_off  = SM_OFF(b);
+					vabits8 = (sm->vabits8)[sm_off];
+					vabits2 = extract_vabits2_from_vabits8 (b, vabits8);
+				}
 				
 				// TODO: remove after testing
 				tl_assert ( vabits16 != VA_BITS2_NOACCESS );
@@ -8180,16 +8915,25 @@ static void high_secmap_entry_memory(SizeT * ptotTainted, SizeT * punaccountTain
 {
 	tl_assert (ptotTainted && punaccountTaint && "ptotTainted or unaccountTaint is NULL");
 	
-	// we don't care about L1 cache here. We can only iterate "blindly" over *ALL* L2 cache entries. 
-	// So we cannot exclude the L1 entries we may have already found.
+	// the radix leaves, then the overflow entries: both in increasing address order
 	AuxMapEnt *elem = 0;
 	Addr lastBase = 0;
-	VG_(OSetGen_ResetIter)(auxmap_L2);
+	UWord top = 0, i = 0;
+	
+	for ( top=0; top<N_AUXMAP_TOP; ++top ) {
+		SecMap **leaf = auxmap_top[top];
+		if ( !leaf ) { continue; }
+		for ( i=0; i<N_AUXMAP_LEAF; ++i ) {
+			if ( !is_distinguished_sm( leaf[i] ) ) {
+				lastBase = ( (((Addr)top) << AUXMAP_LEAF_BITS) | i ) << 16;
+				_do_low_secmap_entry(lastBase, ptotTainted, punaccountTaint);
+			}
+		}
+	}
 	
-	while ( (elem = VG_(OSetGen_Next)(auxmap_L2)) ) {
-		//VG_(printf)("L2 base addr %08lx\n", elem->base);
+	VG_(OSetGen_ResetIter)(auxmap_overflow);
+	while ( (elem = VG_(OSetGen_Next)(auxmap_overflow)) ) {
 		if ( !is_distinguished_sm( elem->sm ) ) {
-			//VG_(printf)("	L2 base addr %08lx possible candidate\n", elem->base);
 			tl_assert (elem->base == (elem->base & ~(Addr)0xFFFF));
 			lastBase = elem->base;
 			_do_low_secmap_entry(elem->base, ptotTainted, punaccountTaint);
@@ -8651,6 +9395,7 @@ static void taint_summary(const char *name)
 	tl_assert ( unaccountTaint==0 && "unaccountTaint not 0!" );
 	if ( totalTainted ) { EMIT_ERROR("\nTotal bytes tainted: %lu\n", totalTainted); }
 	else 				{ EMIT_SUCCESS("\nNo bytes tainted\n"); }
+	if ( totalTainted && TNT_(clo_taint_labels) ) { TNT_(labels_print_summary)(); }
 
     /*
     {
@@ -8716,17 +9461,108 @@ static void taint_summary(const char *name)
 
 #endif // _SECRETGRIND_
 
+// see tnt_discard_superblock_info()
+static ULong n_sb_discarded = 0;
+
+static void tnt_print_stats(void)
+{
+   SizeT live, peak;
+   ULong total, made, freed;
+
+   VG_(message)(Vg_DebugMsg,
+      " tnt: secmaps: %d issued (%lluk, %lluM), %d deissued, %s format\n",
+      n_issued_SMs,
+      n_issued_SMs * SM_BYTES / 1024ULL,
+      n_issued_SMs * SM_BYTES / (1024 * 1024ULL),
+      n_deissued_SMs, TNT_(clo_shadow_compact) ? "compact" : "standard" );
+   VG_(message)(Vg_DebugMsg,
+      " tnt: secmaps: max %d noaccess, %d tainted, %d untainted, %d non-distinguished\n",
+      max_noaccess_SMs, max_undefined_SMs, max_defined_SMs, max_non_DSM_SMs );
+   VG_(message)(Vg_DebugMsg,
+      " tnt: auxmap: %llu radix leaves (%lluk), %llu overflow nodes\n",
+      n_auxmap_leaves, n_auxmap_leaves * N_AUXMAP_LEAF * sizeof(SecMap*) / 1024ULL,
+      n_auxmap_overflow_nodes );
+   VG_(message)(Vg_DebugMsg,
+      " tnt: secmaps: %llu reclaimed, %llu full passes\n",
+      n_reclaimed_SMs, n_reclaim_passes );
+   VG_(message)(Vg_DebugMsg,
+      " tnt: sec V bits: %llu maps made, max %d live, max %lluk, %llu updates, %llu sweeps\n",
+      sec_vbits_new_maps, max_secVBit_maps,
+      max_secVBit_bytes / 1024ULL, sec_vbits_updates,
+      sec_vbits_sweeps );
+
+   getCloneArenaStats( &live, &peak, &total, &made, &freed );
+   VG_(message)(Vg_DebugMsg,
+      " tnt: clones: %llu arenas made, %llu freed on discard\n",
+      made, freed );
+   VG_(message)(Vg_DebugMsg,
+      " tnt: clones: %lu bytes live, %lu peak, %llu total\n",
+      live, peak, total );
+   VG_(message)(Vg_DebugMsg,
+      " tnt: discards: %llu superblocks, %llu clone bytes released\n",
+      n_sb_discarded, total - live );
+
+#if _SECRETGRIND_
+   if (TNT_(clo_event_buffer))
+      VG_(message)(Vg_DebugMsg,
+         " tnt: events: %llu replayed in %llu flushes\n",
+         n_events_replayed, n_event_flushes );
+   if (TNT_(clo_shadow_opt)) {
+      ULong folded, forwarded, putsRemoved, tmpsRemoved;
+      TNT_(get_shadow_opt_stats)( &folded, &forwarded, &putsRemoved, &tmpsRemoved );
+      VG_(message)(Vg_DebugMsg,
+         " tnt: shadow-opt: %llu folded, %llu GETs forwarded, %llu PUTs and %llu tmps removed\n",
+         folded, forwarded, putsRemoved, tmpsRemoved );
+   }
+   if (TNT_(clo_tier_threshold))
+      VG_(message)(Vg_DebugMsg,
+         " tnt: tiers: %llu superblocks promoted, %llu nodes freed on discard\n",
+         n_tier_promoted, n_tier_freed );
+   if (TNT_(clo_libc_models))
+      VG_(message)(Vg_DebugMsg,
+         " tnt: libc models: %llu calls, %llu bytes\n",
+         n_models_run, n_models_bytes );
+   TNT_(models_print_stats)();
+   TNT_(labels_print_stats)();
+#endif
+}
+
 static void tnt_fini(Int exitcode)
 {
+	if (VG_(clo_stats))
+		tnt_print_stats();
+
 	#if _SECRETGRIND_
 	//taint_summary();
+	TNT_(print_instr_stats)();
 	TNT_(mmap_release)();
 	TNT_(sum_names_release)();
 	TNT_(malloc_release)();
+	TNT_(tier_release)();
+	TNT_(instr_stats_release)();
 	TNT_(syswrap_release)();
 	TNT_(asm_release)();
+	TNT_(models_release)();
+	TNT_(labels_release)();
 	VG_(free)(client_binary_name); client_binary_name = NULL;
 	#endif
+	releaseCloneArenas();
+	tmp_table_release();
+}
+
+/* Translations are thrown away (code unloaded, transtab full, or our own
+   VG_(discard_translations) calls): drop everything that was allocated for
+   them, ie the statement clones (IMarks included, see --mnemonics) and the
+   tier node. Note: the small cache of no-redirect translations, used to call
+   the original of a wrapped function, is flushed without telling us, so
+   their clones live until exit. */
+static void tnt_discard_superblock_info ( Addr64 orig_addr, VexGuestExtents vge )
+{
+	++n_sb_discarded;
+	discardCloneArena( orig_addr, (Addr64)vge.base[0] );
+#if _SECRETGRIND_
+	TNT_(tier_discard)( orig_addr, (Addr64)vge.base[0] );
+#endif
 }
 
 static void TNT_(noop)(Addr a, SizeT len) { 
@@ -8790,6 +9626,10 @@ static void tnt_pre_clo_init(void)
                                    TNT_MALLOC_REDZONE_SZB );
 
    VG_(needs_client_requests)  (TNT_(handle_client_requests));
+
+   VG_(needs_superblock_discards) (tnt_discard_superblock_info);
+
+   VG_(track_start_client_code)   (tnt_start_client_code);
 	   
 //   TNT_(mempool_list) = VG_(HT_construct)( "TNT_(mempool_list)" );
 #if 0//_SECRETGRIND_
@@ -0,0 +1,291 @@
+#include "secretgrind.h"
+#include "tnt_include.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_aspacemgr.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_threadstate.h"
+#include "pub_tool_machine.h"
+#include "tnt_libc.h"
+#include "tnt_models.h"
+#include "tnt_labels.h"
+
+#if _SECRETGRIND_
+
+/* --models=<file>: library-level taint summaries for crypto code (bignums, AES,
+   SHA, HMAC). The wrappers in tnt_wraps.c hand each call of a modelled function
+   over to us: on entry we record whether any of its inputs is tainted, on exit
+   every output is tainted iff one of them was. The file says which wrappers are
+   enabled, and which objects run without taint propagation at all:
+
+   # comment
+   object *libcrypto.so*        code of these objects gets no shadow propagation
+   model  BN_*                  enable the wrappers of these functions
+
+   Entries are VG_(string_match) patterns. Object code is only right when it runs
+   on behalf of a modelled call: a function entry in such an object checks this,
+   and warns once per function if not. Even then, only the outputs declared by
+   the model get the taint: whatever the object copies elsewhere (a context
+   struct, a static buffer, the stack) is left untainted.
+
+   A modelled call left by longjmp never reaches TNT_(model_exit): its frame is
+   dropped by the next call of the thread that runs on a stack frame at or above
+   it, see model_unwind(). */
+
+#define MAX_MODELS		16
+#define MAX_MODELS_FILE	(64*1024)
+
+typedef struct {
+	HChar list[MAX_MODELS][MAX_PATH];
+	SizeT len;
+} models_list_t;
+
+static models_list_t TNT_(models_objs) = {};
+static models_list_t TNT_(models_fns) = {};
+
+// the modelled call each thread is in, if any. Calls nested in it are not modelled
+typedef
+	struct {
+		Bool			active;
+		Bool			tainted;	// any input tainted on entry
+		Label_t			labels;		// --taint-labels: the sources of the inputs
+		const HChar		*fn;
+		Addr			sp;			// SP of the wrapper on entry
+	}
+	ModelFrame_t;
+
+static ModelFrame_t model_frames[VG_N_THREADS];
+
+// functions already warned about, see TNT_(model_check_entry)
+typedef
+	struct _ModelWarned_t {
+		struct _ModelWarned_t	*next;	// VgHashNode
+		UWord					key;	// function entry
+	}
+	ModelWarned_t;
+
+static VgHashTable TNT_(models_warned) = NULL;
+
+static ULong n_model_calls = 0;
+static ULong n_model_tainted = 0;
+static ULong n_model_bytes = 0;
+static ULong n_model_outside = 0;
+
+static void list_add( models_list_t *l, const HChar *s, const HChar *path ) {
+	if ( l->len >= LEN(l->list) ) {
+		VG_(printf)("*** Too many entries in --models file %s (max %lu)\n", path, LEN(l->list));
+		VG_(exit)(1);
+	}
+	libc_strlcpy( l->list[l->len], s, sizeof(l->list[l->len]) );
+	l->len++;
+}
+
+static Bool list_match( models_list_t *l, const HChar *s ) {
+	SizeT i=0;
+	for ( i=0; i<l->len ; ++i) {
+		if ( VG_(string_match)(l->list[i], s) ) { return True; }
+	}
+	return False;
+}
+
+static void parse_line( HChar *line, const HChar *path, UInt lineno ) {
+	const HChar *del = " \t\r";
+	HChar *ssaveptr;
+	HChar *key, *val, *extra;
+
+	key = VG_(strtok_r)( line, del, &ssaveptr );
+	if ( key == NULL || key[0] == '#' ) { return; }
+	val = VG_(strtok_r)( NULL, del, &ssaveptr );
+	extra = VG_(strtok_r)( NULL, del, &ssaveptr );
+
+	if ( val == NULL || (extra && extra[0] != '#') ) {
+		VG_(printf)("*** %s:%u: expected '<object|model> <pattern>'\n", path, lineno);
+		VG_(exit)(1);
+	}
+
+	if ( VG_(strcmp)(key, "object") == 0 )		{ list_add( &TNT_(models_objs), val, path ); }
+	else if ( VG_(strcmp)(key, "model") == 0 )	{ list_add( &TNT_(models_fns), val, path ); }
+	else {
+		VG_(printf)("*** %s:%u: unknown keyword '%s'\n", path, lineno, key);
+		VG_(exit)(1);
+	}
+}
+
+void TNT_(models_load)( const HChar *path ) {
+	HChar *buf, *line, *next;
+	Int fd, n;
+	UInt lineno = 0;
+
+	fd = VG_(fd_open)( path, VKI_O_RDONLY, 0 );
+	if ( fd < 0 ) {
+		VG_(printf)("*** Cannot open --models file %s\n", path);
+		VG_(exit)(1);
+	}
+
+	buf = VG_(malloc)( "tnt.models_load.1", MAX_MODELS_FILE+1 );
+	n = VG_(read)( fd, buf, MAX_MODELS_FILE );
+	VG_(close)( fd );
+	if ( n < 0 || n == MAX_MODELS_FILE ) {
+		VG_(printf)("*** Cannot read --models file %s (max %u bytes)\n", path, MAX_MODELS_FILE);
+		VG_(exit)(1);
+	}
+	buf[n] = '\0';
+
+	for ( line = buf; line; line = next ) {
+		next = VG_(strchr)( line, '\n' );
+		if ( next ) { *next++ = '\0'; }
+		parse_line( line, path, ++lineno );
+	}
+	VG_(free)( buf );
+
+	if ( TNT_(models_objs).len && !TNT_(models_warned) ) {
+		TNT_(models_warned) = VG_(HT_construct)( "tnt.models_warned" );
+		VG_(message)(Vg_UserMsg, "Warning: --models objects run without taint propagation: taint they copy outside the model outputs is lost\n");
+	}
+}
+
+// called once per superblock at translation time, see instrument_model() in tnt_translate.c
+Bool TNT_(models_match_obj)( VexGuestExtents* vge ) {
+	HChar name[MAX_PATH];
+	const HChar *base = 0;
+
+	if ( !TNT_(models_objs).len ) { return False; }
+
+	// a superblock must not chase out of the object, or the code there would go unshadowed too
+	if ( vge->n_used != 1 ) { return False; }
+	if ( !VG_(get_objname)( (Addr)vge->base[0], name, sizeof(name) ) ) { return False; }
+
+	// full path or basename
+	if ( list_match( &TNT_(models_objs), name ) ) { return True; }
+	base = VG_(strrchr)( name, '/' );
+	return base && list_match( &TNT_(models_objs), base+1 );
+}
+
+Bool TNT_(models_is_entry)( Addr a ) {
+	HChar fnname[MAX_PATH];
+	return VG_(get_fnname_if_entry)( a, fnname, sizeof(fnname) );
+}
+
+VG_REGPARM(1) void TNT_(model_check_entry)( HWord a ) {
+	ModelWarned_t *node;
+	HChar fnname[MAX_PATH];
+
+	if ( model_frames[VG_(get_running_tid)()].active ) { return; }
+
+	++n_model_outside;
+	if ( VG_(HT_lookup)( TNT_(models_warned), (UWord)a ) ) { return; }
+	node = VG_(malloc)( "tnt.model_check_entry.1", sizeof(ModelWarned_t) );
+	node->key = (UWord)a;
+	VG_(HT_add_node)( TNT_(models_warned), node );
+
+	if ( !VG_(get_fnname)( (Addr)a, fnname, sizeof(fnname) ) ) {
+		VG_(snprintf)( fnname, sizeof(fnname), "0x%lx", (Addr)a );
+	}
+	VG_(message)(Vg_UserMsg, "Warning: %s runs without taint propagation (--models object) but outside a modelled call: add a model for its caller\n", fnname);
+}
+
+static Bool region_valid( const SG_region *r, UInt prot ) {
+	return r->addr && r->len && VG_(am_is_valid_for_client)( (Addr)r->addr, r->len, prot );
+}
+
+static Bool region_tainted( const SG_region *r ) {
+	SizeT i;
+	for ( i=0; i<r->len; ++i ) {
+		if ( TNT_(is_mem_byte_tainted)( (Addr)r->addr + i ) ) { return True; }
+	}
+	return False;
+}
+
+// drop the frame of a modelled call that was left by longjmp: the wrapper now runs at sp, at or above it
+static void model_unwind( ModelFrame_t *frame, Addr sp, Bool same_ok ) {
+	if ( !frame->active ) { return; }
+	if ( sp < frame->sp || (same_ok && sp == frame->sp) ) { return; }
+	LOG("model_unwind %s sp:0x%lx frame sp:0x%lx\n", frame->fn, sp, frame->sp);
+	frame->active = False;
+}
+
+// False if fn is not enabled, or we are already in a modelled call: the wrapper then just calls the original
+Bool TNT_(model_enter)( ThreadId tid, const HChar *fn, const SG_region *ins, UWord nins ) {
+	ModelFrame_t *frame = &model_frames[tid];
+	Addr sp;
+	UWord i;
+
+	tl_assert( tid < VG_N_THREADS );
+	sp = VG_(get_SP)( tid );
+	// a nested call runs below the frame, another call at the same depth means the frame was abandoned
+	model_unwind( frame, sp, False );
+	if ( frame->active || !list_match( &TNT_(models_fns), fn ) ) { return False; }
+
+	frame->active = True;
+	frame->sp = sp;
+	frame->tainted = False;
+	frame->labels = 0;
+	frame->fn = fn;
+	for ( i=0; i<nins && !frame->tainted; ++i ) {
+		frame->tainted = region_valid( &ins[i], VKI_PROT_READ ) && region_tainted( &ins[i] );
+	}
+	for ( i=0; i<nins && frame->tainted && TNT_(clo_taint_labels); ++i ) {
+		if ( region_valid( &ins[i], VKI_PROT_READ ) ) { frame->labels |= TNT_(labels_get)( (Addr)ins[i].addr, ins[i].len ); }
+	}
+	LOG("model_enter %s tainted:%u\n", fn, frame->tainted);
+	++n_model_calls;
+	return True;
+}
+
+// outs get the summary, clean (eg the return value, computed by unshadowed code) is untainted
+void TNT_(model_exit)( ThreadId tid, const SG_region *outs, UWord nouts, const SG_region *clean, UWord nclean ) {
+	ModelFrame_t *frame = &model_frames[tid];
+	UWord i;
+
+	tl_assert( tid < VG_N_THREADS );
+	// the exit of the call that entered runs in the same wrapper frame
+	model_unwind( frame, VG_(get_SP)( tid ), True );
+	if ( !frame->active ) { return; }
+
+	for ( i=0; i<nouts; ++i ) {
+		Addr a = (Addr)outs[i].addr;
+		SizeT len = outs[i].len;
+
+		if ( !region_valid( &outs[i], VKI_PROT_WRITE ) ) { continue; }
+		if ( frame->tainted ) {
+			TNT_(make_mem_tainted)( a, len );
+			if ( TNT_(clo_taint_labels) ) { TNT_(labels_taint)( a, len, frame->labels ); }
+			// the stores of the modelled code were not seen by the summary
+			if ( TNT_(clo_summary_verbose) ) {
+				TNT_(alloc_chunk_from_fn_and_add_sum_block)( a, len, 0, False, frame->fn );
+			}
+		} else {
+			TNT_(make_mem_untainted)( a, len );
+		}
+		n_model_bytes += len;
+	}
+
+	for ( i=0; i<nclean; ++i ) {
+		if ( region_valid( &clean[i], VKI_PROT_WRITE ) ) {
+			TNT_(make_mem_untainted)( (Addr)clean[i].addr, clean[i].len );
+		}
+	}
+
+	if ( frame->tainted ) { ++n_model_tainted; }
+	frame->active = False;
+}
+
+void TNT_(models_print_stats)( void ) {
+	if ( !TNT_(models_fns).len && !TNT_(models_objs).len ) { return; }
+	VG_(message)(Vg_DebugMsg,
+		" tnt: models: %llu calls (%llu tainted), %llu output bytes, %llu entries outside a call\n",
+		n_model_calls, n_model_tainted, n_model_bytes, n_model_outside );
+}
+
+void TNT_(models_release)( void ) {
+	if ( !TNT_(models_warned) ) { return; }
+	VG_(HT_destruct)( TNT_(models_warned), VG_(free) );
+	TNT_(models_warned) = NULL;
+}
+
+#endif // _SECRETGRIND_
@@ -0,0 +1,16 @@
+#ifndef __TNT_MODELS_H
+#define __TNT_MODELS_H
+
+#include "pub_tool_tooliface.h"	// VexGuestExtents
+#include "secretgrind.h"		// SG_region
+
+extern void TNT_(models_load)( const HChar *path );
+extern Bool TNT_(models_match_obj)( VexGuestExtents* vge );
+extern Bool TNT_(models_is_entry)( Addr a );
+extern VG_REGPARM(1) void TNT_(model_check_entry)( HWord a );
+extern Bool TNT_(model_enter)( ThreadId tid, const HChar *fn, const SG_region *ins, UWord nins );
+extern void TNT_(model_exit)( ThreadId tid, const SG_region *outs, UWord nouts, const SG_region *clean, UWord nclean );
+extern void TNT_(models_print_stats)( void );
+extern void TNT_(models_release)( void );
+
+#endif	//	__TNT_MODELS_H
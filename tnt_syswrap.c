@@ -53,6 +53,7 @@
 #include "tnt_subblock_helper.h"
 #include "tnt_syswrap.h"
 #include "tnt_file_filter.h"
+#include "tnt_labels.h"
 
 static void resolve_filename(Int fd, HChar *path, SizeT max)
 {
@@ -74,15 +75,19 @@ static void resolve_filename(Int fd, HChar *path, SizeT max)
 static struct {
 	Bool taint;
 	UInt read_offset;
+	Label_t label;	// --taint-labels: the file's source label
 } tainted_fds[VG_N_THREADS][FD_MAX] = {};
 
 static void set_fd_taint( ThreadId tid, Int fd, Bool taint ) 			{	tl_assert(fd<FD_MAX); tainted_fds[tid][fd].taint = taint; 		}
 static Bool get_fd_taint( ThreadId tid, Int fd ) 						{	tl_assert(fd<FD_MAX); return tainted_fds[tid][fd].taint;		}
 static UInt get_fd_read_offset( ThreadId tid, Int fd ) 				{	tl_assert(fd<FD_MAX); return tainted_fds[tid][fd].read_offset;	}
 static void set_fd_read_offset( ThreadId tid, Int fd, UInt offset ) 	{	tl_assert(fd<FD_MAX); tainted_fds[tid][fd].read_offset = offset;}
+static Label_t get_fd_label( ThreadId tid, Int fd ) 					{	tl_assert(fd<FD_MAX); return tainted_fds[tid][fd].label;		}
+static void set_fd_label( ThreadId tid, Int fd, Label_t label ) 		{	tl_assert(fd<FD_MAX); tainted_fds[tid][fd].label = label;		}
 #else
 static Bool tainted_fds[VG_N_THREADS][FD_MAX] = {};
 static UInt read_offset = 0;
+static Label_t get_fd_label( ThreadId tid, Int fd )					{	return 0;	}
 #endif
 
 
@@ -314,7 +319,7 @@ void _range_common(UWord *addr, Int *len, UInt taint_offset, Int taint_len,
 static
 void read_common ( UInt taint_offset, Int taint_len,
                    UInt curr_offset, Int curr_len,
-                   HChar *data ) {
+                   HChar *data, Label_t label ) {
    UWord addr = 0;
    Int   len = 0;
    //Int   i;
@@ -399,6 +404,7 @@ void read_common ( UInt taint_offset, Int taint_len,
    TNT_(make_mem_tainted)( addr, len );
 
    #if _SECRETGRIND_
+   if ( TNT_(clo_taint_labels) ) { TNT_(labels_taint)( addr, len, label ); }
    }
    
    // it is fone to call this function because it's not a master block
@@ -460,7 +466,7 @@ void TNT_(syscall_read)(ThreadId tid, UWord* args, UInt nArgs,
 #endif
    }
 
-   read_common ( taint_offset, taint_len, curr_offset, curr_len, data );
+   read_common ( taint_offset, taint_len, curr_offset, curr_len, data, get_fd_label(tid,fd) );
 
    // Update file position
 #if _SECRETGRIND_
@@ -513,7 +519,7 @@ void TNT_(syscall_pread)(ThreadId tid, UWord* args, UInt nArgs,
 
    }
 
-   read_common ( taint_offset, taint_len, curr_offset, curr_len, data );
+   read_common ( taint_offset, taint_len, curr_offset, curr_len, data, get_fd_label(tid,fd) );
 }
 
 
@@ -635,6 +641,12 @@ void TNT_(syscall_open)(ThreadId tid, UWord* args, UInt nArgs, SysRes res) {
 #endif
 		}
 
+#if _SECRETGRIND_
+		if ( get_fd_taint(tid,fd) && TNT_(clo_taint_labels) ) {
+			set_fd_label( tid, fd, TNT_(label_for)(fdpath) );
+		}
+#endif
+
     }
 }
 
@@ -843,6 +855,7 @@ void TNT_(syscall_mmap)(ThreadId tid, UWord* args, UInt nArgs, SysRes res)
 				hc->slop_szB = 0; // already 0 normally
 			}
 			TNT_(make_mem_tainted)( addr_start, addr_len );
+			if ( TNT_(clo_taint_labels) ) { TNT_(labels_taint)( addr_start, addr_len, get_fd_label(tid,fd) ); }
 			
 			// we only display and do not record because it's already done with mmap formatting above
 			TNT_(display_receive_taint_for_addr)(addr_start, addr_len, vname, "mmap'ed file");
@@ -927,6 +940,7 @@ void TNT_(syswrap_init)(void)
 	if (TNT_(clo_taint_stdin)) {
 		for(t=0; t < VG_N_THREADS; ++t) {
 			set_fd_taint(t, 0, True);
+			if ( TNT_(clo_taint_labels) ) { set_fd_label(t, 0, TNT_(label_for)("stdin")); }
 			// read_offset unchnaged: so it won't use the --file-taint-start and --file-taint-len options
 		}
 	}
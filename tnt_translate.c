@@ -25,10 +25,12 @@
 */
 
 #include "pub_tool_basics.h"
+#include "pub_tool_debuginfo.h"   // VG_(get_fnname_kind_from_IP)
 #include "pub_tool_hashtable.h"   // For tnt_include.h, VgHashtable
 #include "pub_tool_libcassert.h"  // tl_assert
 #include "pub_tool_libcbase.h"    // VG_STREQN, VG_(memset), VG_(random)
 #include "pub_tool_libcprint.h"   // VG_(message), VG_(printf)
+#include "pub_tool_libcproc.h"    // VG_(getpid)
 #include "pub_tool_machine.h"     // VG_(fnptr_to_fnentry)
 #include "pub_tool_mallocfree.h"  // VG_(malloc), VG_(free)
 //#include "pub_tool_options.h"   // VG_STR/BHEX/BINT_CLO
@@ -40,6 +42,10 @@
 #include "tnt_include.h"
 //#include "tnt_strings.h"
 #include "copy.h"
+#if _SECRETGRIND_
+#  include "tnt_instr_filter.h"
+#  include "tnt_models.h"
+#endif
 
 #define expr2vbits(m,e) expr2vbits2(m,e,__FUNCTION__)
 
@@ -124,6 +130,11 @@ typedef
          on MacOS and False everywhere else. */
       Bool useLLVMworkarounds;
 
+      /* READONLY: --precision=fast.  Always use the cheap (lazy PCast)
+         interpretations: no scan for bogus literals, and the explicitly
+         expensive ops (ExpCmpNE*, Ctz*) are instrumented cheaply. */
+      Bool fastPrecision;
+
       /* READONLY: the guest layout.  This indicates which parts of
          the guest state should be regarded as 'always defined'. */
       VexGuestLayout* layout;
@@ -132,6 +143,44 @@ typedef
          arguments of type 'HWord' to be passed to helper functions.
          Ity_I32 or Ity_I64 only. */
       IRType hWordTy;
+
+#if _SECRETGRIND_
+      /* READONLY: indicates whether the per-statement dirty helpers
+         (create_dirty_*) are emitted.  When False, only the shadow
+         V-bit IR and the LOADV/STOREV helpers are generated, which
+         is all the taint summary needs. */
+      Bool emitHelpers;
+
+      /* READONLY: indicates whether those helpers are guarded on the
+         taint of their operands, so they only run when there is
+         something tainted to report.  False for --trace-taint-only=no. */
+      Bool guardHelpers;
+
+      /* READONLY: indicates whether those helpers are recorded in the
+         event buffer rather than called (--event-buffer=yes). */
+      Bool bufferHelpers;
+
+      /* MODIFIED: the number of event buffer slots used so far, and the
+         guest address of the instruction being instrumented. */
+      UInt   nEvents;
+      Addr64 curIMark;
+
+      /* READONLY: with --tier-threshold, True if this superblock is
+         translated on the cheap tier (no helpers), and the key of its
+         node: nraddr and vge->base[0].
+         MODIFIED: an Ity_I8, non-zero iff a value read so far by the
+         superblock is tainted, or NULL if there is none yet. */
+      Bool    tierNode;
+      Addr64  tierAddr;
+      Addr64  tierBase;
+      IRAtom* tierTaint;
+
+      /* READONLY: with --static-untainted, indexed by the original
+         temps of sb_in: True if their shadow is known to be all
+         zeroes, see findUntaintedTmps.  NULL otherwise. */
+      Bool*   untaintedTmps;
+      Int     nUntaintedTmps;
+#endif
    }
    MCEnv;
 
@@ -944,6 +993,7 @@ ULong extract_IRConst64( IRConst* con );
 
 // Convert to Dirty helper arg type IRExpr*
 static IRExpr* convert_Value( MCEnv* mce, IRAtom* atom );
+IRExpr* zwidenToHostWord ( MCEnv* mce, IRAtom* vatom );
 
 // The IRStmt types
 IRDirty* create_dirty_PUT( MCEnv* mce, IRStmt *clone, Int offset, IRExpr* data );
@@ -953,9 +1003,11 @@ IRDirty* create_dirty_STORE( MCEnv* mce, IRStmt *clone, IREndness end,
                              IRExpr* data );
 #if _SECRETGRIND_
 IRDirty* create_dirty_STORE_V128or256( MCEnv* mce, IRStmt *clone,
-                             IREndness end, IRTemp resSC, 
-                             IRExpr* addr, IRExpr* data, IRExpr* vdata, IRExpr* offset );
+                             IREndness end, IRTemp resSC,
+                             IRExpr* addr, IRExpr* data );
 IRDirty* create_dirty_IMark( MCEnv* mce, IRStmt *clone );
+IRDirty* create_dirty_main_summary( MCEnv* mce );
+static Bool imark_needs_main_summary( Addr64 addr );
 #endif
 IRDirty* create_dirty_CAS( MCEnv* mce, IRCAS* details );
 IRDirty* create_dirty_DIRTY( MCEnv* mce, IRDirty* details );
@@ -982,6 +1034,347 @@ IRDirty* create_dirty_ITE( MCEnv* mce, IRStmt *clone, IRTemp tmp,
                            IRExpr* cond, IRExpr* iftrue, IRExpr* iffalse );
 IRDirty* create_dirty_from_dirty( IRDirty* di_old );
 
+#if _SECRETGRIND_
+/* Collapse the shadow of an original atom into an Ity_I1 which is 1
+   iff any of its bits is tainted.  Unlike mkPCastTo, this also takes
+   the vector shadows.  Returns NULL for a constant atom, which can
+   never be tainted. */
+static IRAtom* mkAnyTainted ( MCEnv* mce, IRAtom* atom )
+{
+   IRAtom *vatom, *q0, *q1, *q2, *q3;
+
+   tl_assert(isOriginalAtom(mce, atom));
+   if (atom->tag == Iex_Const)
+      return NULL;
+
+   vatom = atom2vbits( mce, atom );
+   /* statically untainted temp */
+   if (vatom->tag == Iex_Const)
+      return NULL;
+   switch (typeOfIRExpr(mce->sb->tyenv, vatom)) {
+      case Ity_V128:
+         q0    = assignNew('V', mce, Ity_I64, unop(Iop_V128to64, vatom));
+         q1    = assignNew('V', mce, Ity_I64, unop(Iop_V128HIto64, vatom));
+         vatom = assignNew('V', mce, Ity_I64, binop(Iop_Or64, q0, q1));
+         break;
+      case Ity_V256:
+         q0    = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_0, vatom));
+         q1    = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_1, vatom));
+         q2    = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_2, vatom));
+         q3    = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_3, vatom));
+         q0    = assignNew('V', mce, Ity_I64, binop(Iop_Or64, q0, q1));
+         q2    = assignNew('V', mce, Ity_I64, binop(Iop_Or64, q2, q3));
+         vatom = assignNew('V', mce, Ity_I64, binop(Iop_Or64, q0, q2));
+         break;
+      default:
+         break;
+   }
+   return mkPCastTo( mce, Ity_I1, vatom );
+}
+
+/* Build the guard under which a helper reporting on atom1/atom2 has
+   to run: it's only worth calling when one of them is tainted.
+   Returns NULL if the helper must run unconditionally, ie helpers are
+   not guarded (--trace-taint-only=no) or there is nothing to test, and
+   mkU1(0) if neither atom can ever be tainted. */
+static IRAtom* mkTaintGuard ( MCEnv* mce, IRAtom* atom1, IRAtom* atom2 )
+{
+   IRAtom *t1, *t2;
+
+   if (!mce->guardHelpers || (!atom1 && !atom2))
+      return NULL;
+
+   t1 = atom1 ? mkAnyTainted( mce, atom1 ) : NULL;
+   t2 = atom2 ? mkAnyTainted( mce, atom2 ) : NULL;
+
+   if (!t1 && !t2)
+      return mkU1(0);
+   if (!t1 || !t2)
+      return t1 ? t1 : t2;
+
+   /* no Iop_Or1, so go via Ity_I8 */
+   t1 = assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, t1));
+   t2 = assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, t2));
+   return assignNew('V', mce, Ity_I1,
+                    unop(Iop_CmpNEZ8, assignNew('V', mce, Ity_I8,
+                                                binop(Iop_Or8, t1, t2))));
+}
+
+/* In guarded mode the WrTmp helper of an untainted temp does not run,
+   so ti[]/tv[] are stale by the time a helper reads them for one of
+   its operand temps, and it would print edges from them.  Refresh both
+   inline: a few plain memory ops are still much cheaper than a helper
+   call.  ti and tv belong to the running thread and may be reallocated,
+   so their current base is loaded each time rather than baked into the
+   IR.  tv is only refreshed for integer temps, as the helpers only
+   compare it for those. */
+static void refresh_tmp_bookkeeping ( MCEnv* mce, IRAtom* atom )
+{
+   IRTemp  t;
+   IRAtom  *tainted, *old, *cur, *tiAddr, *tvAddr;
+   IRAtom  *value = atom;
+   IROp    widen = Iop_INVALID;
+   IRType  tyH  = mce->hWordTy;
+   IROp    opAdd = tyH == Ity_I32 ? Iop_Add32 : Iop_Add64;
+#  if defined(VG_BIGENDIAN)
+   IREndness end = Iend_BE;
+#  else
+   IREndness end = Iend_LE;
+#  endif
+
+   if (!mce->guardHelpers || atom->tag != Iex_RdTmp)
+      return;
+
+   t = atom->Iex.RdTmp.tmp;
+   tl_assert( t < ti_max );
+
+   tvAddr = assignNew('C', mce, tyH, IRExpr_Load( end, tyH, mkIRExpr_HWord((HWord)&tv) ));
+   tvAddr = assignNew('C', mce, tyH, binop(opAdd, tvAddr, mkIRExpr_HWord(t * sizeof(ULong))));
+   tiAddr = assignNew('C', mce, tyH, IRExpr_Load( end, tyH, mkIRExpr_HWord((HWord)&ti) ));
+   tiAddr = assignNew('C', mce, tyH, binop(opAdd, tiAddr, mkIRExpr_HWord(t * sizeof(UInt))));
+
+   switch (typeOfIRExpr(mce->sb->tyenv, atom)) {
+      case Ity_I1:  widen = Iop_1Uto64;  break;
+      case Ity_I8:  widen = Iop_8Uto64;  break;
+      case Ity_I16: widen = Iop_16Uto64; break;
+      case Ity_I32: widen = Iop_32Uto64; break;
+      case Ity_I64: break;
+      default:      value = NULL; break;
+   }
+   if (widen != Iop_INVALID)
+      value = assignNew('C', mce, Ity_I64, unop(widen, atom));
+   if (value)
+      stmt( 'C', mce, IRStmt_Store( end, tvAddr, value ) );
+
+   tainted = mkAnyTainted( mce, atom );
+   old = assignNew('C', mce, Ity_I32, IRExpr_Load( end, Ity_I32, tiAddr ));
+   old = assignNew('C', mce, Ity_I32, binop(Iop_And32, old, mkU32(0x7fffffff)));
+   cur = assignNew('C', mce, Ity_I32,
+                   binop(Iop_Shl32, assignNew('C', mce, Ity_I32,
+                                              unop(Iop_1Uto32, tainted)),
+                                    mkU8(31)));
+   cur = assignNew('C', mce, Ity_I32, binop(Iop_Or32, old, cur));
+   stmt( 'C', mce, IRStmt_Store( end, tiAddr, cur ) );
+}
+
+/* Same for every operand temp of e, the right-hand side of a WrTmp, or
+   a PUT/EXIT/NEXT/STORE atom. */
+static void refresh_expr_bookkeeping ( MCEnv* mce, IRExpr* e )
+{
+   Int i;
+
+   if (!mce->guardHelpers || !e)
+      return;
+
+   switch (e->tag) {
+      case Iex_RdTmp:
+         refresh_tmp_bookkeeping( mce, e );
+         break;
+      case Iex_GetI:
+         refresh_tmp_bookkeeping( mce, e->Iex.GetI.ix );
+         break;
+      case Iex_Load:
+         refresh_tmp_bookkeeping( mce, e->Iex.Load.addr );
+         break;
+      case Iex_Unop:
+         refresh_tmp_bookkeeping( mce, e->Iex.Unop.arg );
+         break;
+      case Iex_Binop:
+         refresh_tmp_bookkeeping( mce, e->Iex.Binop.arg1 );
+         refresh_tmp_bookkeeping( mce, e->Iex.Binop.arg2 );
+         break;
+      case Iex_Triop:
+         refresh_tmp_bookkeeping( mce, e->Iex.Triop.details->arg1 );
+         refresh_tmp_bookkeeping( mce, e->Iex.Triop.details->arg2 );
+         refresh_tmp_bookkeeping( mce, e->Iex.Triop.details->arg3 );
+         break;
+      case Iex_Qop:
+         refresh_tmp_bookkeeping( mce, e->Iex.Qop.details->arg1 );
+         refresh_tmp_bookkeeping( mce, e->Iex.Qop.details->arg2 );
+         refresh_tmp_bookkeeping( mce, e->Iex.Qop.details->arg3 );
+         refresh_tmp_bookkeeping( mce, e->Iex.Qop.details->arg4 );
+         break;
+      case Iex_ITE:
+         refresh_tmp_bookkeeping( mce, e->Iex.ITE.cond );
+         refresh_tmp_bookkeeping( mce, e->Iex.ITE.iftrue );
+         refresh_tmp_bookkeeping( mce, e->Iex.ITE.iffalse );
+         break;
+      case Iex_CCall:
+         for (i = 0; e->Iex.CCall.args[i]; i++)
+            refresh_tmp_bookkeeping( mce, e->Iex.CCall.args[i] );
+         break;
+      default:
+         break;
+   }
+}
+#endif // _SECRETGRIND_
+
+#if _SECRETGRIND_
+static void countHelperKind ( const HChar* name );
+
+/* --event-buffer=yes: make the calls recorded so far in this superblock,
+   in order, under guard (NULL means unconditional).  The slots are
+   only reused once they have been flushed unconditionally. */
+static void flushEvents ( MCEnv* mce, IRAtom* guard )
+{
+   IRDirty* di;
+
+   if (mce->nEvents == 0)
+      return;
+
+   di = unsafeIRDirty_0_N( 1/*regparms*/, "TNT_(flush_events)",
+                           VG_(fnptr_to_fnentry)( &TNT_(flush_events) ),
+                           mkIRExprVec_1( mkIRExpr_HWord( mce->nEvents ) ) );
+   /* the events are written with plain stores */
+   di->mFx   = Ifx_Modify;
+   di->mAddr = mkIRExpr_HWord( (HWord)&TNT_(events)[0] );
+   di->mSize = mce->nEvents * sizeof(Event_t);
+   if (guard) di->guard = guard;
+   setHelperAnns( mce, di );
+   stmt( 'V', mce, IRStmt_Dirty(di) );
+
+   if (!guard)
+      mce->nEvents = 0;
+}
+
+/* Record the helper call di2 in the event buffer instead of making it.
+   Only plain (clone, value, taint)-like calls qualify: up to 3 host word
+   arguments, all in registers, and no result.  The load helpers of
+   V128/V256 temps read guest memory, which later statements of the
+   superblock may change, so they are called straight away.  Returns
+   False if di2 must be emitted as a normal call. */
+static Bool emitBufferedDirty ( MCEnv* mce, IRDirty* di2 )
+{
+   Event_t* ev;
+   IRAtom*  fn;
+   Int      i, nargs;
+#  if defined(VG_BIGENDIAN)
+   IREndness end = Iend_BE;
+#  else
+   IREndness end = Iend_LE;
+#  endif
+
+   if (!mce->bufferHelpers)
+      return False;
+   if (di2->tmp != IRTemp_INVALID || di2->mFx != Ifx_None || di2->nFxState != 0)
+      return False;
+   if (di2->cee->addr == VG_(fnptr_to_fnentry)( &TNT_(h32_load_v128or256_t) ) ||
+       di2->cee->addr == VG_(fnptr_to_fnentry)( &TNT_(h64_load_v128or256_t) ))
+      return False;
+   for (nargs = 0; di2->args[nargs]; nargs++) {
+      IRExpr* arg = di2->args[nargs];
+      if (nargs == 3 || !isIRAtom(arg) ||
+          typeOfIRExpr(mce->sb->tyenv, arg) != mce->hWordTy)
+         return False;
+   }
+   if (nargs == 0 || di2->cee->regparms < nargs)
+      return False;
+
+   if (mce->nEvents == EVENT_BUF_SIZE)
+      flushEvents( mce, NULL );
+
+   /* not in the output as a dirty call, so count it here */
+   if (TNT_(clo_instr_stats))
+      countHelperKind( di2->cee->name );
+
+   ev = &TNT_(events)[mce->nEvents++];
+   fn = mkIRExpr_HWord( (HWord)di2->cee->addr );
+   if (!(di2->guard->tag == Iex_Const && di2->guard->Iex.Const.con->Ico.U1))
+      fn = assignNew('V', mce, mce->hWordTy,
+                     IRExpr_ITE( di2->guard, fn, mkIRExpr_HWord(0) ));
+
+   stmt( 'V', mce, IRStmt_Store( end, mkIRExpr_HWord( (HWord)&ev->fn ), fn ) );
+   for (i = 0; i < nargs; i++)
+      stmt( 'V', mce, IRStmt_Store( end, mkIRExpr_HWord( (HWord)&ev->args[i] ),
+                                    di2->args[i] ) );
+   stmt( 'V', mce, IRStmt_Store( end, mkIRExpr_HWord( (HWord)&ev->pc ),
+                                 mkIRExpr_HWord( (HWord)mce->curIMark ) ) );
+   return True;
+}
+#endif
+
+#if _SECRETGRIND_
+/* --tier-threshold: note the Ity_I1 t, True if a value just read by
+   the superblock is tainted. */
+static void tierNoteTaint ( MCEnv* mce, IRAtom* t )
+{
+   t = assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, t));
+   mce->tierTaint = mce->tierTaint
+                    ? assignNew('V', mce, Ity_I8, binop(Iop_Or8, mce->tierTaint, t))
+                    : t;
+}
+
+/* --tier-threshold: note whether the value of atom, just read by the
+   superblock, is tainted.  Any tainted operand of the superblock comes
+   from a GET, a load, a CAS, a load-linked or a dirty helper, so their
+   results are all that is tracked. */
+static void tierNoteRead ( MCEnv* mce, IRAtom* atom )
+{
+   IRAtom* t;
+
+   if (!mce->tierNode)
+      return;
+   t = mkAnyTainted( mce, atom );
+   if (t)
+      tierNoteTaint( mce, t );
+}
+
+/* --tier-threshold: same for the Ity_I32 shadow vatom. */
+static void tierNoteShadow32 ( MCEnv* mce, IRAtom* vatom )
+{
+   if (!mce->tierNode)
+      return;
+   tierNoteTaint( mce, assignNew('V', mce, Ity_I1, unop(Iop_CmpNEZ32, vatom)) );
+}
+
+/* --tier-threshold: before leaving the superblock under guard (NULL
+   means unconditionally), tell TNT_(tier_taint_seen) if it read taint. */
+static void tierReport ( MCEnv* mce, IRAtom* guard )
+{
+   IRDirty* di;
+   IRAtom*  cond;
+
+   if (!mce->tierNode || !mce->tierTaint)
+      return;
+
+   cond = mce->tierTaint;
+   if (guard)
+      cond = assignNew('V', mce, Ity_I8,
+                       binop(Iop_And8, cond,
+                             assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, guard))));
+
+   di = unsafeIRDirty_0_N( 2/*regparms*/, "TNT_(tier_taint_seen)",
+                           VG_(fnptr_to_fnentry)( &TNT_(tier_taint_seen) ),
+                           mkIRExprVec_2( mkIRExpr_HWord( (HWord)mce->tierAddr ),
+                                          mkIRExpr_HWord( (HWord)mce->tierBase ) ) );
+   di->guard = assignNew('V', mce, Ity_I1, unop(Iop_CmpNEZ8, cond));
+   setHelperAnns( mce, di );
+   stmt( 'V', mce, IRStmt_Dirty(di) );
+}
+#endif
+
+/* Emit the helper call di2, under the taint guard cond built by
+   mkTaintGuard.  A NULL cond means unconditional. */
+static void emitGuardedDirty ( MCEnv* mce, IRAtom* cond, IRDirty* di2 )
+{
+   if( !di2 ) return;
+
+   if( cond ) {
+      /* statically untainted: the helper would bail out anyway */
+      if( cond->tag == Iex_Const )
+         return;
+      di2->guard = cond;
+   }
+#if _SECRETGRIND_
+   if( emitBufferedDirty( mce, di2 ) )
+      return;
+   /* keep the output in order */
+   flushEvents( mce, NULL );
+#endif
+   setHelperAnns( mce, di2 );
+   stmt( 'V', mce, IRStmt_Dirty(di2));
+}
+
 /* Check the supplied **original** atom for undefinedness, and emit
    a complaint if so.  Once that happens, mark it as defined.  This is
    possible because the atom is either a tmp or literal.  If it's a
@@ -997,64 +1390,25 @@ IRDirty* create_dirty_from_dirty( IRDirty* di_old );
    The IRDirty statement di2 is created by the respective function so
    we know which IRStmt is currently being checked. This is for the
    purpose of pretty printing the IRStmt during run-time.
+   Secretgrind: unless --trace-taint-only=no, di2 is guarded so it only
+   runs when the atom is tainted, as the helper has nothing to do
+   otherwise.
 */
-static void complainIfTainted ( MCEnv* mce, IRAtom* atom, IRDirty* di2 )
+static void complainIfEitherTainted ( MCEnv* mce, IRAtom* atom1, IRAtom* atom2, IRDirty* di2 )
 {
-//   IRAtom*  vatom;
-//   IRAtom*  cond;
-//   IRType   ty;
-
-   /* Since the original expression is atomic, there's no duplicated
-      work generated by making multiple V-expressions for it.  So we
-      don't really care about the possibility that someone else may
-      also create a V-interpretion for it. */
-//   tl_assert(isOriginalAtom(mce, atom));
-//   vatom = atom2vbits( mce, atom );
-//   tl_assert(isShadowAtom(mce, vatom));
-//   tl_assert(sameKindedAtoms(atom, vatom));
-
-   // Taintgrind: mkPCastTo can't handle Ity_F32, Ity_F64, Ity_V128 types
- /*  if( typeOfIRExpr(mce->sb->tyenv, vatom) == Ity_F32 ||
-       typeOfIRExpr(mce->sb->tyenv, vatom) == Ity_F32 ||
-       typeOfIRExpr(mce->sb->tyenv, vatom) == Ity_V128 ){
-     // VG_(printf)("\nTaintgrind: Can't handle IEEE floats/doubles,");
-     // VG_(printf)(" or 128-bit SIMD operations atm.\n");
-     // VG_(printf)("atom: "); ppIRExpr(atom); VG_(printf)("\n");
-     // VG_(printf)("di2: ");  ppIRDirty(di2); VG_(printf)("\n");
-      return;
-   }
-*/
-//   cond = mkPCastTo( mce, Ity_I1, vatom );
-   /* cond will be 0 if all defined, and 1 if any not defined. */
-
    if( !di2 ) return;
 
-//   di2->guard = cond;
-   // Taintgrind: unconditional
-//   di2->guard = NULL;
-   setHelperAnns( mce, di2 );
-   stmt( 'V', mce, IRStmt_Dirty(di2));
-
-   /* Set the shadow tmp to be defined.  First, update the
-      orig->shadow tmp mapping to reflect the fact that this shadow is
-      getting a new value. */
-//   ty = typeOfIRExpr(mce->sb->tyenv, vatom);
-
-//   tl_assert(isIRAtom(vatom));
-   /* sameKindedAtoms ... */
-/*   if (vatom->tag == Iex_RdTmp &&
-       ty    != Ity_I8    &&
-       ty    != Ity_I16   &&
-       ty    != Ity_I32   &&
-       ty    != Ity_I64  ) {
-      tl_assert(atom->tag == Iex_RdTmp);
-      newShadowTmpV(mce, atom->Iex.RdTmp.tmp);
-      assign('V', mce, findShadowTmpV(mce, atom->Iex.RdTmp.tmp),
-                       definedOfType(ty));
-   }*/
+#if _SECRETGRIND_
+   emitGuardedDirty( mce, mkTaintGuard( mce, atom1, atom2 ), di2 );
+#else
+   emitGuardedDirty( mce, NULL, di2 );
+#endif
 }
 
-
+static void complainIfTainted ( MCEnv* mce, IRAtom* atom, IRDirty* di2 )
+{
+   complainIfEitherTainted( mce, atom, NULL, di2 );
+}
 
 /*------------------------------------------------------------*/
 /*--- Shadowing PUTs/GETs, and indexed variants thereof    ---*/
@@ -1089,6 +1443,154 @@ static Bool isAlwaysDefd ( MCEnv* mce, Int offset, Int size ) //1159
    return False; /* could not find any containing section */
 }
 
+#if _SECRETGRIND_
+/*------------------------------------------------------------*/
+/*--- Condition code helpers                               ---*/
+/*------------------------------------------------------------*/
+
+/* The flag helpers compute their result from the CC_OP/CC_DEP1/CC_DEP2/
+   CC_NDEP thunk.  CC_OP is a constant that only selects the computation,
+   so the result is only as tainted as the DEP fields.  Returns the index
+   of the CC_DEP1 argument, CC_DEP2 and CC_NDEP following it, or -1 if
+   cee is not one of these helpers. */
+static Int ccallThunkDep1 ( IRCallee* cee )
+{
+   if (VG_(strcmp)( cee->name, "amd64g_calculate_condition" ) == 0
+       || VG_(strcmp)( cee->name, "x86g_calculate_condition" ) == 0)
+      return 2; /* cond, cc_op, dep1, dep2, ndep */
+   if (VG_(strcmp)( cee->name, "amd64g_calculate_rflags_c" ) == 0
+       || VG_(strcmp)( cee->name, "amd64g_calculate_rflags_all" ) == 0
+       || VG_(strcmp)( cee->name, "x86g_calculate_eflags_c" ) == 0
+       || VG_(strcmp)( cee->name, "x86g_calculate_eflags_all" ) == 0)
+      return 1; /* cc_op, dep1, dep2, ndep */
+   return -1;
+}
+
+/*------------------------------------------------------------*/
+/*--- Statically untainted temps (--static-untainted)     ---*/
+/*------------------------------------------------------------*/
+
+/* With --static-untainted=yes, the shadow of the stack and instruction
+   pointers, of the always-defined guest state and of the ranges given
+   with --untainted-guest-state is never written, so it stays untainted.
+   do_shadow_PUT/PUTI skip it and shadow_GET/GETI read it as zeroes. */
+static Bool isPinnedUntainted ( MCEnv* mce, Int offset, Int size )
+{
+   UInt i;
+
+   if (!TNT_(clo_static_untainted))
+      return False;
+   if (offset == mce->layout->offset_SP && size == mce->layout->sizeof_SP)
+      return True;
+   if (offset == mce->layout->offset_IP && size == mce->layout->sizeof_IP)
+      return True;
+   for (i = 0; i < TNT_(clo_n_untainted_guest); i++) {
+      const GuestRange_t* r = &TNT_(clo_untainted_guest)[i];
+      if (offset >= r->offset && offset + size <= r->offset + r->size)
+         return True;
+   }
+   return isAlwaysDefd( mce, offset, size );
+}
+
+static Bool isUntaintedAtom ( MCEnv* mce, IRAtom* a )
+{
+   if (a->tag == Iex_Const)
+      return True;
+   tl_assert(a->tag == Iex_RdTmp);
+   return mce->untaintedTmps[a->Iex.RdTmp.tmp];
+}
+
+/* Forward pass over the flat sb_in, marking in mce->untaintedTmps the
+   temps whose shadow is all zeroes whatever happens at run time: those
+   computed only from constants, pinned guest state (see above) and
+   other such temps.  Every propagation rule maps untainted operands to
+   an untainted result, so none of them needs a shadow temp, and their
+   helpers could only run on unguarded (trace everything) translations.
+   Temps with no zero atom of their shadow type are left alone. */
+static void findUntaintedTmps ( MCEnv* mce, IRSB* sb_in )
+{
+   Int i, j;
+
+   mce->nUntaintedTmps = sb_in->tyenv->types_used;
+   mce->untaintedTmps  = VG_(calloc)( "tnt.findUntaintedTmps.1",
+                                      sb_in->tyenv->types_used, sizeof(Bool) );
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      IRStmt* st = sb_in->stmts[i];
+      IRExpr* e;
+      Bool    u;
+
+      if (st->tag != Ist_WrTmp)
+         continue;
+      switch (shadowTypeV( typeOfIRTemp(sb_in->tyenv, st->Ist.WrTmp.tmp) )) {
+         case Ity_I1: case Ity_I8: case Ity_I16:
+         case Ity_I32: case Ity_I64: case Ity_V128:
+            break;
+         default:
+            continue;
+      }
+
+      e = st->Ist.WrTmp.data;
+      switch (e->tag) {
+         case Iex_Const:
+         case Iex_RdTmp:
+            u = isUntaintedAtom( mce, e );
+            break;
+         case Iex_Get:
+            u = isPinnedUntainted( mce, e->Iex.Get.offset,
+                                   sizeofIRType(e->Iex.Get.ty) );
+            break;
+         case Iex_Unop:
+            u = isUntaintedAtom( mce, e->Iex.Unop.arg );
+            break;
+         case Iex_Binop:
+            u = isUntaintedAtom( mce, e->Iex.Binop.arg1 )
+                && isUntaintedAtom( mce, e->Iex.Binop.arg2 );
+            break;
+         case Iex_Triop:
+            u = isUntaintedAtom( mce, e->Iex.Triop.details->arg1 )
+                && isUntaintedAtom( mce, e->Iex.Triop.details->arg2 )
+                && isUntaintedAtom( mce, e->Iex.Triop.details->arg3 );
+            break;
+         case Iex_Qop:
+            u = isUntaintedAtom( mce, e->Iex.Qop.details->arg1 )
+                && isUntaintedAtom( mce, e->Iex.Qop.details->arg2 )
+                && isUntaintedAtom( mce, e->Iex.Qop.details->arg3 )
+                && isUntaintedAtom( mce, e->Iex.Qop.details->arg4 );
+            break;
+         case Iex_ITE:
+            u = isUntaintedAtom( mce, e->Iex.ITE.cond )
+                && isUntaintedAtom( mce, e->Iex.ITE.iftrue )
+                && isUntaintedAtom( mce, e->Iex.ITE.iffalse );
+            break;
+         case Iex_CCall:
+            j = ccallThunkDep1( e->Iex.CCall.cee );
+            if (j >= 0) {
+               u = isUntaintedAtom( mce, e->Iex.CCall.args[j] )
+                   && isUntaintedAtom( mce, e->Iex.CCall.args[j+1] )
+                   && isUntaintedAtom( mce, e->Iex.CCall.args[j+2] );
+               break;
+            }
+            u = True;
+            for (j = 0; u && e->Iex.CCall.args[j]; j++)
+               u = isUntaintedAtom( mce, e->Iex.CCall.args[j] );
+            break;
+         default:
+            /* loads and GETIs */
+            u = False;
+            break;
+      }
+      mce->untaintedTmps[st->Ist.WrTmp.tmp] = u;
+   }
+}
+
+static Bool isUntaintedTmp ( MCEnv* mce, IRTemp orig )
+{
+   return mce->untaintedTmps && orig < mce->nUntaintedTmps
+          && mce->untaintedTmps[orig];
+}
+#endif // _SECRETGRIND_
+
 /* Generate into bb suitable actions to shadow this Put.  If the state
    slice is marked 'always defined', do nothing.  Otherwise, write the
    supplied V bits to the shadow state.  We can pass in either an
@@ -1126,6 +1628,13 @@ void do_shadow_PUT ( MCEnv* mce, IRStmt *clone, Int offset,
       /* emit code to emit a complaint if any of the vbits are 1. */
       /* complainIfTainted(mce, atom); */
 //   } else {
+#if _SECRETGRIND_
+   if (isPinnedUntainted(mce, offset, sizeofIRType(ty))) {
+      /* No shadow Put, and a guarded helper would never run */
+      if (!mce->emitHelpers || mce->guardHelpers)
+         return;
+   } else {
+#endif
       /* Do a plain shadow Put. */
       if (guard) {
          /* If the guard expression evaluates to false we simply Put the value
@@ -1138,13 +1647,19 @@ void do_shadow_PUT ( MCEnv* mce, IRStmt *clone, Int offset,
          vatom   = assignNew('V', mce, ty, IRExpr_ITE(cond, vatom, iffalse));
       }
       stmt( 'V', mce, IRStmt_Put( offset + mce->layout->total_sizeB, vatom ) );
+#if _SECRETGRIND_
+   }
+#endif
 
       // Taintgrind: include this check only if we're not tracking critical ins
       // For why total_sizeB is added to offset, 
       // see VEX/pub/libvex.h "A note about guest state layout"
       if( atom && clone && !TNT_(clo_critical_ins_only) ){
          IRDirty* di2 = create_dirty_PUT( mce, clone, offset, atom );
-         if ( di2 ) complainIfTainted( mce, NULL /*atom*/, di2 ); 
+#if _SECRETGRIND_
+         if ( di2 ) refresh_expr_bookkeeping( mce, atom );
+#endif
+         if ( di2 ) complainIfTainted( mce, atom, di2 ); 
       }
 //   }
 }
@@ -1183,8 +1698,20 @@ void do_shadow_PUTI ( MCEnv* mce, IRPutI *puti )
    tl_assert(isOriginalAtom(mce,ix));
 
    // Taintgrind:
+#if _SECRETGRIND_
+   if ( mce->emitHelpers ) {
+#endif
    di2 = create_dirty_PUTI( mce, descr, ix, bias, atom );
-   complainIfTainted(mce, ix, di2);
+#if _SECRETGRIND_
+   if ( di2 ) {
+      refresh_expr_bookkeeping( mce, ix );
+      refresh_expr_bookkeeping( mce, atom );
+   }
+#endif
+   complainIfEitherTainted(mce, ix, atom, di2);
+#if _SECRETGRIND_
+   }
+#endif
 
    // Taintgrind: Let's keep the vbits regardless
 //   if (isAlwaysDefd(mce, descr->base, arrSize)) {
@@ -1194,6 +1721,10 @@ void do_shadow_PUTI ( MCEnv* mce, IRPutI *puti )
 //   } else {
       /* Do a cloned version of the Put that refers to the shadow
          area. */
+#if _SECRETGRIND_
+   if (isPinnedUntainted(mce, descr->base, descr->nElems * sizeofIRType(ty)))
+      return;
+#endif
       IRRegArray* new_descr
          = mkIRRegArray( descr->base + mce->layout->total_sizeB,
                          tyS, descr->nElems);
@@ -1217,6 +1748,11 @@ IRExpr* shadow_GET ( MCEnv* mce, Int offset, IRType ty ) //1270
       /* Always defined, return all zeroes of the relevant type */
 //      return definedOfType(tyS);
 //   } else {
+#if _SECRETGRIND_
+   /* never written by do_shadow_PUT, see isPinnedUntainted */
+   if (isPinnedUntainted(mce, offset, sizeofIRType(ty)))
+      return definedOfType(tyS);
+#endif
       /* return a cloned version of the Get that refers to the shadow
          area. */
       /* FIXME: this isn't an atom! */
@@ -1244,6 +1780,10 @@ IRExpr* shadow_GETI ( MCEnv* mce,
       /* Always defined, return all zeroes of the relevant type */
 //      return definedOfType(tyS);
 //   } else {
+#if _SECRETGRIND_
+   if (isPinnedUntainted(mce, descr->base, descr->nElems * sizeofIRType(ty)))
+      return definedOfType(tyS);
+#endif
       /* return a cloned version of the Get that refers to the shadow
          area. */
       IRRegArray* new_descr
@@ -1562,6 +2102,43 @@ IRAtom* mkLazyN ( MCEnv* mce,
    return mkPCastTo(mce, finalVtype, curr );
 }
 
+#if _SECRETGRIND_
+/* mkLazyN for the flag helpers (see ccallThunkDep1): only CC_DEP1,
+   CC_DEP2 and CC_NDEP are merged, at their own type.  CC_NDEP only
+   carries data for adc/sbb/inc/dec; everywhere else the front end sets
+   it to zero, so skip it when it's a constant.  If none of them can be
+   tainted, the result is a constant for the shadow-opt pass to fold. */
+static
+IRAtom* mkLazyCC ( MCEnv* mce, IRAtom** args, IRType finalVtype, Int dep1 )
+{
+   IRAtom* aDep1 = args[dep1];
+   IRAtom* aDep2 = args[dep1+1];
+   IRAtom* aNDep = args[dep1+2];
+   IRAtom  *vDep1, *vDep2, *vNDep, *curr;
+   IRType  ty;
+
+   tl_assert(aDep1 && aDep2 && aNDep);
+   tl_assert(isOriginalAtom(mce, aDep1));
+   tl_assert(isOriginalAtom(mce, aDep2));
+   tl_assert(isOriginalAtom(mce, aNDep));
+
+   /* constants and statically untainted temps have a constant shadow */
+   vDep1 = atom2vbits(mce, aDep1);
+   vDep2 = atom2vbits(mce, aDep2);
+   vNDep = aNDep->tag == Iex_Const ? NULL : atom2vbits(mce, aNDep);
+   if (vDep1->tag == Iex_Const && vDep2->tag == Iex_Const
+       && (!vNDep || vNDep->tag == Iex_Const))
+      return definedOfType(finalVtype);
+
+   /* the thunk fields are all I64 on amd64, I32 on x86 */
+   ty   = typeOfIRExpr(mce->sb->tyenv, aDep1);
+   curr = mkUifU( mce, ty, vDep1, vDep2 );
+   if (vNDep)
+      curr = mkUifU( mce, ty, curr, vNDep );
+   return mkPCastTo( mce, finalVtype, curr );
+}
+#endif
+
 
 /*------------------------------------------------------------*/
 /*--- Generating expensive sequences for exact carry-chain ---*/
@@ -3524,6 +4101,8 @@ IRAtom* expr2vbits_Binop ( MCEnv* mce,
 
       expensive_cmp64:
       case Iop_ExpCmpNE64:
+         if (mce->fastPrecision)
+            goto cheap_cmp64;
          return expensiveCmpEQorNE(mce,Ity_I64, vatom1,vatom2, atom1,atom2 );
 
       cheap_cmp64:
@@ -3540,6 +4119,8 @@ IRAtom* expr2vbits_Binop ( MCEnv* mce,
 
       expensive_cmp32:
       case Iop_ExpCmpNE32:
+         if (mce->fastPrecision)
+            goto cheap_cmp32;
          return expensiveCmpEQorNE(mce,Ity_I32, vatom1,vatom2, atom1,atom2 );
 
       cheap_cmp32:
@@ -3547,12 +4128,13 @@ IRAtom* expr2vbits_Binop ( MCEnv* mce,
       case Iop_CmpLT32U: case Iop_CmpLT32S:
          return mkPCastTo(mce, Ity_I1, mkUifU32(mce, vatom1,vatom2));
 
+      case Iop_ExpCmpNE16:
+         if (!mce->fastPrecision)
+            return expensiveCmpEQorNE(mce,Ity_I16, vatom1,vatom2, atom1,atom2 );
+         /* fall through */
       case Iop_CmpEQ16: case Iop_CmpNE16:
          return mkPCastTo(mce, Ity_I1, mkUifU16(mce, vatom1,vatom2));
 
-      case Iop_ExpCmpNE16:
-         return expensiveCmpEQorNE(mce,Ity_I16, vatom1,vatom2, atom1,atom2 );
-
       case Iop_CmpEQ8: case Iop_CmpNE8:
          return mkPCastTo(mce, Ity_I1, mkUifU8(mce, vatom1,vatom2));
 
@@ -3915,6 +4497,8 @@ IRExpr* expr2vbits_Unop ( MCEnv* mce, IROp op, IRAtom* atom )
 
       case Iop_Ctz32:
       case Iop_Ctz64:
+         if (mce->fastPrecision)
+            return mkPCastTo(mce, op == Iop_Ctz32 ? Ity_I32 : Ity_I64, vatom);
          return expensiveCountTrailingZeroes(mce, op, atom, vatom);
 
       case Iop_1Uto64:
@@ -4110,33 +4694,307 @@ IRExpr* expr2vbits_Unop ( MCEnv* mce, IROp op, IRAtom* atom )
 
 
 
-/* Worker function; do not call directly. */
 #if _SECRETGRIND_
+/*------------------------------------------------------------*/
+/*--- Inline shadow memory fast path (--inline-fast-path)  ---*/
+/*------------------------------------------------------------*/
 
-static
-IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
-                              IREndness end, IRType ty,
-                              IRAtom* addr, UInt bias, IRAtom* guard )
+/* The common case of tnt_LOADVn/tnt_STOREVn -- an aligned access below
+   the top of primary_map, whose bytes are all tainted or all untainted
+   -- emitted as IR so that no helper is called at all.  Everything else
+   goes to the _slow helpers.  The primary_map lookup is done with the
+   index masked, so the IR never reads out of bounds even for the
+   accesses it then hands over to the helper.  64-bit hosts only. */
+
+static Bool useInlineFastPath ( MCEnv* mce, IRType ty )
 {
-   tl_assert(isOriginalAtom(mce,addr));
-   tl_assert(end == Iend_LE || end == Iend_BE);
-   
-   /* First, emit a definedness test for the address.  This also sets
-      the address (shadow) to 'defined' following the test. */
-   //complainIfUndefined( mce, addr, guard );
+   if (!TNT_(clo_inline_fast_path) || mce->hWordTy != Ity_I64)
+      return False;
+   return ty == Ity_I64 || ty == Ity_I32 || ty == Ity_I16 || ty == Ity_I8;
+}
 
-   /* Now cook up a call to the relevant helper function, to read the
-      data V bits from shadow memory. */
-   ty = shadowTypeV(ty);
+/* no Iop_And1/Iop_Or1, so go via Ity_I8 */
+static IRAtom* mkAnd1 ( MCEnv* mce, IRAtom* a1, IRAtom* a2 )
+{
+   a1 = assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, a1));
+   a2 = assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, a2));
+   return assignNew('V', mce, Ity_I1,
+                    unop(Iop_CmpNEZ8, assignNew('V', mce, Ity_I8,
+                                                binop(Iop_And8, a1, a2))));
+}
 
-   void*        helper           = NULL;
-   const HChar* hname            = NULL;
-   Bool         ret_via_outparam = False;
-   
-   //LOG("expr2vbits_Load_WRK with tag %d\n", addr->tag-Iex_Binder);
-   tl_assert (addr->tag ==  Iex_RdTmp || addr->tag == Iex_Const);
-   IRTemp tmp = -1;
-   if (addr->tag == Iex_RdTmp) { tmp = addr->Iex.RdTmp.tmp; }
+static IRAtom* mkOr1 ( MCEnv* mce, IRAtom* a1, IRAtom* a2 )
+{
+   a1 = assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, a1));
+   a2 = assignNew('V', mce, Ity_I8, unop(Iop_1Uto8, a2));
+   return assignNew('V', mce, Ity_I1,
+                    unop(Iop_CmpNEZ8, assignNew('V', mce, Ity_I8,
+                                                binop(Iop_Or8, a1, a2))));
+}
+
+static IRAtom* mkNot1 ( MCEnv* mce, IRAtom* a1 )
+{
+   return assignNew('V', mce, Ity_I1, unop(Iop_Not1, a1));
+}
+
+/* vabits of szB all-untainted/all-tainted bytes, as extracted by
+   mkFastPathVAbits */
+#define FP_VABITS_UNTAINTED(szB)  (0xaaaa >> (16 - 2*(szB)))
+#define FP_VABITS_TAINTED(szB)    (0x5555 >> (16 - 2*(szB)))
+
+/* Look up the shadow of the szB bytes at addr.  Returns their vabits as
+   an Ity_I32, or 0xffffffff (which matches neither pattern above) when
+   addr is misaligned or above the primary map.  *sm gets the SecMap,
+   *unit the address of the vabits16 (szB == 8) or vabits8 containing
+   them and *raw that unit as loaded. */
+static IRAtom* mkFastPathVAbits ( MCEnv* mce, IRAtom* addr, Int szB,
+                                  IRAtom** sm, IRAtom** unit, IRAtom** raw )
+{
+   ShadowLayout sl;
+   ULong        mask;
+   IRAtom       *ok, *idx, *ent, *low, *off, *vab;
+#  if defined(VG_BIGENDIAN)
+   IREndness end = Iend_BE;
+#  else
+   IREndness end = Iend_LE;
+#  endif
+
+   TNT_(get_shadow_layout)( &sl );
+   /* same as UNALIGNED_OR_HIGH in tnt_main.c */
+   mask = ~((0x10000ULL - szB) | ((ULong)(sl.n_primary_map - 1) << 16));
+
+   ok  = assignNew('V', mce, Ity_I1,
+                   binop(Iop_CmpEQ64,
+                         assignNew('V', mce, Ity_I64, binop(Iop_And64, addr, mkU64(mask))),
+                         mkU64(0)));
+
+   idx = assignNew('V', mce, Ity_I64, binop(Iop_Shr64, addr, mkU8(16)));
+   idx = assignNew('V', mce, Ity_I64, binop(Iop_And64, idx, mkU64(sl.n_primary_map - 1)));
+   ent = assignNew('V', mce, Ity_I64, binop(Iop_Shl64, idx, mkU8(3)));
+   ent = assignNew('V', mce, Ity_I64, binop(Iop_Add64, ent, mkU64(sl.primary_map)));
+   *sm = assignNew('V', mce, Ity_I64, IRExpr_Load(end, Ity_I64, ent));
+
+   low = assignNew('V', mce, Ity_I64, binop(Iop_And64, addr, mkU64(0xffff)));
+   if (szB == 8) {
+      /* SM_OFF_16 */
+      off   = assignNew('V', mce, Ity_I64, binop(Iop_Shr64, low, mkU8(3)));
+      off   = assignNew('V', mce, Ity_I64, binop(Iop_Shl64, off, mkU8(1)));
+      *unit = assignNew('V', mce, Ity_I64, binop(Iop_Add64, *sm, off));
+      *raw  = assignNew('V', mce, Ity_I16, IRExpr_Load(end, Ity_I16, *unit));
+      vab   = assignNew('V', mce, Ity_I32, unop(Iop_16Uto32, *raw));
+   } else {
+      /* SM_OFF */
+      off   = assignNew('V', mce, Ity_I64, binop(Iop_Shr64, low, mkU8(2)));
+      *unit = assignNew('V', mce, Ity_I64, binop(Iop_Add64, *sm, off));
+      *raw  = assignNew('V', mce, Ity_I8, IRExpr_Load(end, Ity_I8, *unit));
+      vab   = assignNew('V', mce, Ity_I32, unop(Iop_8Uto32, *raw));
+      if (szB < 4) {
+         /* extract_vabits4_from_vabits8/extract_vabits2_from_vabits8 */
+         IRAtom* shift = assignNew('V', mce, Ity_I64, binop(Iop_And64, addr, mkU64(3)));
+         shift = assignNew('V', mce, Ity_I64, binop(Iop_Shl64, shift, mkU8(1)));
+         shift = assignNew('V', mce, Ity_I8, unop(Iop_64to8, shift));
+         vab   = assignNew('V', mce, Ity_I32, binop(Iop_Shr32, vab, shift));
+         vab   = assignNew('V', mce, Ity_I32,
+                           binop(Iop_And32, vab, mkU32((1 << (2*szB)) - 1)));
+      }
+   }
+
+   return assignNew('V', mce, Ity_I32, IRExpr_ITE(ok, vab, mkU32(0xffffffff)));
+}
+
+static IRAtom* mkAllOnes ( IRType ty )
+{
+   switch (ty) {
+      case Ity_I8:  return mkU8(V_BITS8_TAINTED);
+      case Ity_I16: return mkU16(V_BITS16_TAINTED);
+      case Ity_I32: return mkU32(V_BITS32_TAINTED);
+      case Ity_I64: return mkU64(V_BITS64_TAINTED);
+      default:      VG_(tool_panic)("tnt_translate.c:mkAllOnes");
+   }
+}
+
+/* The inline counterpart of expr2vbits_Load_WRK.  taint is the (host
+   word) shadow of the address when pointer taint has to be propagated,
+   as the _extended helpers do, or NULL. */
+static IRAtom* expr2vbits_Load_fast ( MCEnv* mce, IREndness end, IRType ty,
+                                      IRAtom* addrAct, IRAtom* taint,
+                                      IRAtom* guard )
+{
+   Int          szB = sizeofIRType(ty);
+   void*        helper = NULL;
+   const HChar* hname  = NULL;
+   IRAtom       *sm, *unit, *raw, *vab, *isU, *isT, *slow, *res;
+   IRTemp       datavbits;
+   IRDirty*     di;
+
+   switch (ty) {
+      case Ity_I64: helper = end == Iend_LE ? (void*)&TNT_(helperc_LOADV64le_slow) : (void*)&TNT_(helperc_LOADV64be_slow);
+                    hname  = end == Iend_LE ? "TNT_(helperc_LOADV64le_slow)" : "TNT_(helperc_LOADV64be_slow)";
+                    break;
+      case Ity_I32: helper = end == Iend_LE ? (void*)&TNT_(helperc_LOADV32le_slow) : (void*)&TNT_(helperc_LOADV32be_slow);
+                    hname  = end == Iend_LE ? "TNT_(helperc_LOADV32le_slow)" : "TNT_(helperc_LOADV32be_slow)";
+                    break;
+      case Ity_I16: helper = end == Iend_LE ? (void*)&TNT_(helperc_LOADV16le_slow) : (void*)&TNT_(helperc_LOADV16be_slow);
+                    hname  = end == Iend_LE ? "TNT_(helperc_LOADV16le_slow)" : "TNT_(helperc_LOADV16be_slow)";
+                    break;
+      case Ity_I8:  helper = (void*)&TNT_(helperc_LOADV8_slow);
+                    hname  = "TNT_(helperc_LOADV8_slow)";
+                    break;
+      default:      ppIRType(ty);
+                    VG_(tool_panic)("tnt_translate.c:expr2vbits_Load_fast");
+   }
+
+   vab  = mkFastPathVAbits( mce, addrAct, szB, &sm, &unit, &raw );
+   isU  = assignNew('V', mce, Ity_I1, binop(Iop_CmpEQ32, vab, mkU32(FP_VABITS_UNTAINTED(szB))));
+   isT  = assignNew('V', mce, Ity_I1, binop(Iop_CmpEQ32, vab, mkU32(FP_VABITS_TAINTED(szB))));
+   slow = mkNot1( mce, mkOr1( mce, isU, isT ) );
+   if (guard)
+      slow = mkAnd1( mce, slow, guard );
+
+   datavbits = newTemp(mce, ty, VSh);
+   di = unsafeIRDirty_1_N( datavbits,
+                           1/*regparms*/,
+                           hname, VG_(fnptr_to_fnentry)( helper ),
+                           mkIRExprVec_1( addrAct ) );
+   di->guard = slow;
+   setHelperAnns( mce, di );
+   stmt( 'V', mce, IRStmt_Dirty(di) );
+
+   /* a not-called helper leaves junk in datavbits, so select */
+   res = assignNew('V', mce, ty, IRExpr_ITE(isT, mkAllOnes(ty), mkexpr(datavbits)));
+   res = assignNew('V', mce, ty, IRExpr_ITE(isU, definedOfType(ty), res));
+
+   if (taint) {
+      IRAtom* tainted = assignNew('V', mce, Ity_I1, binop(Iop_CmpNE64, taint, mkU64(0)));
+      IRAtom* narrow  = taint;
+      switch (ty) {
+         case Ity_I32: narrow = assignNew('V', mce, ty, unop(Iop_64to32, taint)); break;
+         case Ity_I16: narrow = assignNew('V', mce, ty, unop(Iop_64to16, taint)); break;
+         case Ity_I8:  narrow = assignNew('V', mce, ty, unop(Iop_64to8,  taint)); break;
+         default:      break;
+      }
+      res = assignNew('V', mce, ty, IRExpr_ITE(tainted, narrow, res));
+   }
+   return res;
+}
+
+/* The inline counterpart of the 8/16/32/64-bit helper call in
+   do_shadow_Store. */
+static void do_shadow_Store_fast ( MCEnv* mce, IREndness end,
+                                   IRAtom* addrAct, IRAtom* vdata,
+                                   IRAtom* guard )
+{
+   IRType       ty  = typeOfIRExpr(mce->sb->tyenv, vdata);
+   Int          szB = sizeofIRType(ty);
+   void*        helper = NULL;
+   const HChar* hname  = NULL;
+   IROp         opEQ   = Iop_INVALID;
+   ShadowLayout sl;
+   IRAtom       *sm, *unit, *raw, *vab, *isU, *isT, *vabU, *vabT, *fast, *slow;
+   IRDirty*     di;
+#  if defined(VG_BIGENDIAN)
+   IREndness hend = Iend_BE;
+#  else
+   IREndness hend = Iend_LE;
+#  endif
+
+   switch (ty) {
+      case Ity_I64: helper = end == Iend_LE ? (void*)&TNT_(helperc_STOREV64le_slow) : (void*)&TNT_(helperc_STOREV64be_slow);
+                    hname  = end == Iend_LE ? "TNT_(helperc_STOREV64le_slow)" : "TNT_(helperc_STOREV64be_slow)";
+                    opEQ   = Iop_CmpEQ64;
+                    break;
+      case Ity_I32: helper = end == Iend_LE ? (void*)&TNT_(helperc_STOREV32le_slow) : (void*)&TNT_(helperc_STOREV32be_slow);
+                    hname  = end == Iend_LE ? "TNT_(helperc_STOREV32le_slow)" : "TNT_(helperc_STOREV32be_slow)";
+                    opEQ   = Iop_CmpEQ32;
+                    break;
+      case Ity_I16: helper = end == Iend_LE ? (void*)&TNT_(helperc_STOREV16le_slow) : (void*)&TNT_(helperc_STOREV16be_slow);
+                    hname  = end == Iend_LE ? "TNT_(helperc_STOREV16le_slow)" : "TNT_(helperc_STOREV16be_slow)";
+                    opEQ   = Iop_CmpEQ16;
+                    break;
+      case Ity_I8:  helper = (void*)&TNT_(helperc_STOREV8_slow);
+                    hname  = "TNT_(helperc_STOREV8_slow)";
+                    opEQ   = Iop_CmpEQ8;
+                    break;
+      default:      ppIRType(ty);
+                    VG_(tool_panic)("tnt_translate.c:do_shadow_Store_fast");
+   }
+
+   vab  = mkFastPathVAbits( mce, addrAct, szB, &sm, &unit, &raw );
+   isU  = assignNew('V', mce, Ity_I1, binop(opEQ, vdata, definedOfType(ty)));
+   isT  = assignNew('V', mce, Ity_I1, binop(opEQ, vdata, mkAllOnes(ty)));
+   vabU = assignNew('V', mce, Ity_I1, binop(Iop_CmpEQ32, vab, mkU32(FP_VABITS_UNTAINTED(szB))));
+   vabT = assignNew('V', mce, Ity_I1, binop(Iop_CmpEQ32, vab, mkU32(FP_VABITS_TAINTED(szB))));
+
+   /* storing what is already there, which includes untainted data into
+      the distinguished untainted secondary: nothing to do */
+   fast = mkOr1( mce, mkAnd1( mce, isU, vabU ), mkAnd1( mce, isT, vabT ) );
+
+   if (szB >= 4) {
+      /* a whole vabits8/vabits16 flipping between tainted and untainted
+         in a private secondary: rewrite it.  Otherwise the unit is
+         written back unchanged, which is harmless. */
+      IRAtom *priv, *write, *newUnit;
+      IRType tyUnit = szB == 8 ? Ity_I16 : Ity_I8;
+
+      TNT_(get_shadow_layout)( &sl );
+      priv  = mkOr1( mce,
+                     assignNew('V', mce, Ity_I1, binop(Iop_CmpLT64U, sm, mkU64(sl.dist_sm_lo))),
+                     assignNew('V', mce, Ity_I1, binop(Iop_CmpLT64U, mkU64(sl.dist_sm_hi), sm)) );
+      write = mkAnd1( mce, priv,
+                      mkAnd1( mce, mkOr1( mce, vabU, vabT ), mkOr1( mce, isU, isT ) ) );
+      if (guard)
+         write = mkAnd1( mce, write, guard );
+
+      newUnit = szB == 8
+                ? assignNew('V', mce, tyUnit, IRExpr_ITE(isU, mkU16(0xaaaa), mkU16(0x5555)))
+                : assignNew('V', mce, tyUnit, IRExpr_ITE(isU, mkU8(0xaa), mkU8(0x55)));
+      newUnit = assignNew('V', mce, tyUnit, IRExpr_ITE(write, newUnit, raw));
+      stmt( 'V', mce, IRStmt_Store(hend, unit, newUnit) );
+
+      fast = mkOr1( mce, fast, write );
+   }
+
+   slow = mkNot1( mce, fast );
+   if (guard)
+      slow = mkAnd1( mce, slow, guard );
+
+   di = unsafeIRDirty_0_N( ty == Ity_I64 ? 1 : 2/*regparms*/,
+                           hname, VG_(fnptr_to_fnentry)( helper ),
+                           mkIRExprVec_2( addrAct,
+                                          ty == Ity_I64 ? vdata : zwidenToHostWord( mce, vdata ) ) );
+   di->guard = slow;
+   setHelperAnns( mce, di );
+   stmt( 'V', mce, IRStmt_Dirty(di) );
+}
+#endif // _SECRETGRIND_
+
+/* Worker function; do not call directly. */
+#if _SECRETGRIND_
+
+static
+IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
+                              IREndness end, IRType ty,
+                              IRAtom* addr, UInt bias, IRAtom* guard )
+{
+   tl_assert(isOriginalAtom(mce,addr));
+   tl_assert(end == Iend_LE || end == Iend_BE);
+   
+   /* First, emit a definedness test for the address.  This also sets
+      the address (shadow) to 'defined' following the test. */
+   //complainIfUndefined( mce, addr, guard );
+
+   /* Now cook up a call to the relevant helper function, to read the
+      data V bits from shadow memory. */
+   ty = shadowTypeV(ty);
+
+   void*        helper           = NULL;
+   const HChar* hname            = NULL;
+   Bool         ret_via_outparam = False;
+   
+   //LOG("expr2vbits_Load_WRK with tag %d\n", addr->tag-Iex_Binder);
+   tl_assert (addr->tag ==  Iex_RdTmp || addr->tag == Iex_Const);
+   IRTemp tmp = -1;
+   if (addr->tag == Iex_RdTmp) { tmp = addr->Iex.RdTmp.tmp; }
    //IRConstTag ctag = addr->Iex.Const.con->tag;
 	//tl_assert ( ctag >= Ico_U1 && ctag <= Ico_U64 && "non supported ctag -- ask maintainer"); // for testing purposes
 	//#define GET_IF_U(n) if ( ctag == Ico_U ## n ) { tmp = addr->Iex.Const.con->Ico.U ## n ; } 
@@ -4150,6 +5008,14 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
    //			I don't think it's possible in practice with 64-bit integers...
    //			except if there are special instructions...
    
+   /* Pick the helper family here rather than in the helpers: the
+      _extended variants propagate the address taint (pointer
+      arithmetic), the plain ones only do direct flow.  With
+      --taint-df-only or an untracked (constant) or statically
+      untainted address the plain ones are used, so no mode check runs
+      per load. */
+   Bool ptrTaint = tmp != -1 && !TNT_(clo_taint_df_only) && !isUntaintedTmp(mce, tmp);
+
    if (end == Iend_LE) {
       switch (ty) {
          case Ity_V256: helper = &TNT_(helperc_LOADV256le);
@@ -4162,17 +5028,17 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
                         ret_via_outparam = True;
                         //tl_assert ( tmp == -1 && "helperc_LOADV128le not supported");
                         break;
-         case Ity_I64:  helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV64le) : (void*)&TNT_(helperc_LOADV64le_extended);
-                        hname = tmp==-1 ? "TNT_(helperc_LOADV64le)" : "helperc_LOADV64le_extended";
+         case Ity_I64:  helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV64le) : (void*)&TNT_(helperc_LOADV64le_extended);
+                        hname = !ptrTaint ? "TNT_(helperc_LOADV64le)" : "TNT_(helperc_LOADV64le_extended)";
                         break;
-         case Ity_I32:  helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV32le) : (void*)TNT_(helperc_LOADV32le_extended);
-                        hname = "TNT_(helperc_LOADV32le)";
+         case Ity_I32:  helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV32le) : (void*)&TNT_(helperc_LOADV32le_extended);
+                        hname = !ptrTaint ? "TNT_(helperc_LOADV32le)" : "TNT_(helperc_LOADV32le_extended)";
                         break;
-         case Ity_I16:  helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV16le) : (void*)&TNT_(helperc_LOADV16le_extended);  
-                        hname = tmp==-1 ? "TNT_(helperc_LOADV16le)" : "TNT_(helperc_LOADV16le_extended)";
+         case Ity_I16:  helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV16le) : (void*)&TNT_(helperc_LOADV16le_extended);  
+                        hname = !ptrTaint ? "TNT_(helperc_LOADV16le)" : "TNT_(helperc_LOADV16le_extended)";
                         break;
-         case Ity_I8:  helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV8) : (void*)&TNT_(helperc_LOADV8_extended);   
-						hname = tmp==-1 ? "TNT_(helperc_LOADV8)" : "TNT_(helperc_LOADV8)";
+         case Ity_I8:  helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV8) : (void*)&TNT_(helperc_LOADV8_extended);   
+						hname = !ptrTaint ? "TNT_(helperc_LOADV8)" : "TNT_(helperc_LOADV8_extended)";
                         break;
          default:       ppIRType(ty);
                         VG_(tool_panic)("tnt_translate.c:expr2vbits_Load_WRK(LE)");
@@ -4189,17 +5055,17 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
                         ret_via_outparam = True;
                         //tl_assert ( tmp == -1 && "helperc_LOADV128be not supported");
                         break;
-         case Ity_I64:  helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV64be) : (void*)&TNT_(helperc_LOADV64be_extended);
-                        hname = tmp==-1 ? "TNT_(helperc_LOADV64be)" : "helperc_LOADV64be_extended";
+         case Ity_I64:  helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV64be) : (void*)&TNT_(helperc_LOADV64be_extended);
+                        hname = !ptrTaint ? "TNT_(helperc_LOADV64be)" : "TNT_(helperc_LOADV64be_extended)";
                         break;
-         case Ity_I32:  helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV32be) : (void*)&TNT_(helperc_LOADV32be_extended);
-                        hname = tmp==-1 ? "TNT_(helperc_LOADV32be)" : "TNT_(helperc_LOADV32be_extended)";
+         case Ity_I32:  helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV32be) : (void*)&TNT_(helperc_LOADV32be_extended);
+                        hname = !ptrTaint ? "TNT_(helperc_LOADV32be)" : "TNT_(helperc_LOADV32be_extended)";
                         break;
-         case Ity_I16:  helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV16be) : (void*)&TNT_(helperc_LOADV16be_extended);  
-                        hname = tmp==-1 ? "TNT_(helperc_LOADV16be)" : "TNT_(helperc_LOADV16be_extended)";
+         case Ity_I16:  helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV16be) : (void*)&TNT_(helperc_LOADV16be_extended);  
+                        hname = !ptrTaint ? "TNT_(helperc_LOADV16be)" : "TNT_(helperc_LOADV16be_extended)";
                         break;
-         case Ity_I8:   helper = tmp==-1 ? (void*)&TNT_(helperc_LOADV8) : (void*)&TNT_(helperc_LOADV8_extended);   
-						hname = tmp==-1 ? "TNT_(helperc_LOADV8)" : "TNT_(helperc_LOADV8)";
+         case Ity_I8:   helper = !ptrTaint ? (void*)&TNT_(helperc_LOADV8) : (void*)&TNT_(helperc_LOADV8_extended);   
+						hname = !ptrTaint ? "TNT_(helperc_LOADV8)" : "TNT_(helperc_LOADV8_extended)";
                         break;
          default:       ppIRType(ty);
                         VG_(tool_panic)("tnt_translate.c::expr2vbits_Load_WRK(BE)");
@@ -4223,6 +5089,13 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
       addrAct = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBias) );
    }
 
+   if (useInlineFastPath( mce, ty )) {
+      IRAtom* taint = NULL;
+      if ( ptrTaint )
+         taint = convert_Value( mce, atom2vbits( mce, IRExpr_RdTmp( tmp ) ) );
+      return expr2vbits_Load_fast( mce, end, ty, addrAct, taint, guard );
+   }
+
    /* We need to have a place to park the V bits we're just about to
       read. */
    IRTemp datavbits = newTemp(mce, ty, VSh);
@@ -4235,9 +5108,9 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
                               hname, VG_(fnptr_to_fnentry)( helper ),
                               mkIRExprVec_2( IRExpr_VECRET(), addrAct ) );
    } else {
-	   if ( tmp != -1 ) {
+	   if ( ptrTaint ) {
 		   di = unsafeIRDirty_1_N( datavbits,
-                              2/*regparms*/,
+                              ty == Ity_I64 ? 1 : 2/*regparms*/,
                               hname, VG_(fnptr_to_fnentry)( helper ),
                               mkIRExprVec_2( addrAct, convert_Value( mce, atom2vbits( mce, IRExpr_RdTmp( tmp ) ) ) ) );
 	   } else {
@@ -4513,7 +5386,7 @@ IRExpr* expr2vbits2 ( MCEnv* mce, IRExpr* e, const char *fn ) //2909
                                   e->Iex.GetI.ix, e->Iex.GetI.bias );
 
       case Iex_RdTmp:
-         return IRExpr_RdTmp( findShadowTmpV(mce, e->Iex.RdTmp.tmp) );
+         return atom2vbits( mce, e );
 
       case Iex_Const:
          return definedOfType(shadowTypeV(typeOfIRExpr(mce->sb->tyenv, e)));
@@ -4552,6 +5425,14 @@ IRExpr* expr2vbits2 ( MCEnv* mce, IRExpr* e, const char *fn ) //2909
                                       NULL/* guard == "always True"*/ );
 
       case Iex_CCall:
+#if _SECRETGRIND_
+         {
+            Int dep1 = ccallThunkDep1( e->Iex.CCall.cee );
+            if (dep1 >= 0)
+               return mkLazyCC( mce, e->Iex.CCall.args,
+                                     e->Iex.CCall.retty, dep1 );
+         }
+#endif
          return mkLazyN( mce, e->Iex.CCall.args,
                               e->Iex.CCall.retty,
                               e->Iex.CCall.cee );
@@ -4578,6 +5459,10 @@ IRExpr* atom2vbits ( MCEnv* mce, IRAtom* atom )
    switch (atom->tag) {
 
       case Iex_RdTmp:
+#if _SECRETGRIND_
+         if (isUntaintedTmp(mce, atom->Iex.RdTmp.tmp))
+            return definedOfType(shadowTypeV(typeOfIRExpr(mce->sb->tyenv, atom)));
+#endif
          return IRExpr_RdTmp( findShadowTmpV(mce, atom->Iex.RdTmp.tmp) );
 
       case Iex_Const:
@@ -4602,11 +5487,33 @@ void do_shadow_WRTMP ( MCEnv* mce, IRStmt *clone, IRTemp tmp, IRExpr* expr )
 	//LOG("do_shadow_WRTMP\n");
    stmt( 'C', mce, IRStmt_WrTmp( tmp, expr ) );
 
+#if _SECRETGRIND_
+   if( isUntaintedTmp( mce, tmp ) ) {
+      /* no shadow temp, see atom2vbits; a guarded helper would never run */
+      if( !mce->emitHelpers || mce->guardHelpers )
+         return;
+   } else
+#endif
    assign( 'V', mce, findShadowTmpV( mce, tmp ), expr2vbits( mce, expr )  );
 
+#if _SECRETGRIND_
+   if( !mce->emitHelpers )
+      return;
+#endif
+
    if( expr->tag != Iex_Const ){
       di2 = create_dirty_WRTMP( mce, clone, tmp, expr );
 
+#if _SECRETGRIND_
+      // the helper prints the version and taint of the operand temps
+      if( di2 != NULL )
+         refresh_expr_bookkeeping( mce, expr );
+      // load helpers also report on the address temp, see H_EXIT_EARLY_LDST
+      if( di2 != NULL && expr->tag == Iex_Load ) {
+         complainIfEitherTainted( mce, IRExpr_RdTmp( tmp ), expr->Iex.Load.addr, di2 );
+         return;
+      }
+#endif
       if( di2 != NULL )
          complainIfTainted( mce, IRExpr_RdTmp( tmp ), di2 );
    }
@@ -4686,6 +5593,9 @@ void do_shadow_Store ( MCEnv* mce,
    const HChar*   hname = NULL;
 //   IRConst* c;
    IRDirty* di2;
+#if _SECRETGRIND_
+   IRAtom*  tguard = NULL;
+#endif
 
    tyAddr = mce->hWordTy;
    mkAdd  = tyAddr==Ity_I32 ? Iop_Add32 : Iop_Add64;
@@ -4737,14 +5647,25 @@ void do_shadow_Store ( MCEnv* mce,
       di2 = create_dirty_STORE( mce, clone, end, 0/*resSC*/, addr, data );
       if ( di2 ) complainIfTainted( mce, addr, di2 );
    }
+   #else
+   // the store helpers report on both the address and the data
+   if( data && clone ){
+      refresh_tmp_bookkeeping( mce, addr );
+      refresh_tmp_bookkeeping( mce, data );
+      tguard = mkTaintGuard( mce, addr, data );
+   }
    #endif
 
    /* Now decide which helper function to call to write the data V
       bits into shadow memory. */
    if (end == Iend_LE) {
       switch (ty) {
-         case Ity_V256: /* we'll use the helper four times */
-         case Ity_V128: /* we'll use the helper twice */
+         case Ity_V256: helper = &TNT_(helperc_STOREV256le);
+                        hname = "TNT_(helperc_STOREV256le)";
+                        break;
+         case Ity_V128: helper = &TNT_(helperc_STOREV128le);
+                        hname = "TNT_(helperc_STOREV128le)";
+                        break;
          case Ity_I64: helper = &TNT_(helperc_STOREV64le);
                        hname = "TNT_(helperc_STOREV64le)";
                        break;
@@ -4761,7 +5682,12 @@ void do_shadow_Store ( MCEnv* mce,
       }
    } else {
       switch (ty) {
-         case Ity_V128: /* we'll use the helper twice */
+         case Ity_V256: helper = &TNT_(helperc_STOREV256be);
+                        hname = "TNT_(helperc_STOREV256be)";
+                        break;
+         case Ity_V128: helper = &TNT_(helperc_STOREV128be);
+                        hname = "TNT_(helperc_STOREV128be)";
+                        break;
          case Ity_I64: helper = &TNT_(helperc_STOREV64be);
                        hname = "TNT_(helperc_STOREV64be)";
                        break;
@@ -4778,196 +5704,53 @@ void do_shadow_Store ( MCEnv* mce,
       }
    }
 
-   if (UNLIKELY(ty == Ity_V256)) {
+   if (UNLIKELY(ty == Ity_V256 || ty == Ity_V128)) {
 
-      /* V256-bit case -- phrased in terms of 64 bit units (Qs), with
-         Q3 being the most significant lane. */
-      /* These are the offsets of the Qs in memory. */
-      Int     offQ0, offQ1, offQ2, offQ3;
+      /* V128/V256-bit case -- a single helper call, taking the vector
+         as 64-bit lanes (Qs) with Q0 being the least significant.  The
+         helper deals with endianness.  See comment in next clause re
+         64-bit regparms. */
+      IRDirty *di;
+      IRAtom  *addrAct;
 
-      /* Various bits for constructing the 4 lane helper calls */
-      IRDirty *diQ0,    *diQ1,    *diQ2,    *diQ3;
-      IRAtom  *addrQ0,  *addrQ1,  *addrQ2,  *addrQ3;
-      IRAtom  *vdataQ0, *vdataQ1, *vdataQ2, *vdataQ3;
-      IRAtom  *eBiasQ0, *eBiasQ1, *eBiasQ2, *eBiasQ3;
-#if _SECRETGRIND_
-      IRAtom  *_vdata = 0;
-#endif
-      
-      if (end == Iend_LE) {
-         offQ0 = 0; offQ1 = 8; offQ2 = 16; offQ3 = 24;
+      if (bias == 0) {
+         addrAct = addr;
       } else {
-         offQ3 = 0; offQ2 = 8; offQ1 = 16; offQ0 = 24;
+         IRAtom* eBias   = tyAddr==Ity_I32 ? mkU32(bias) : mkU64(bias);
+         addrAct = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBias));
       }
 
-	  /* =========== Q0 ================= */
-	  eBiasQ0 = tyAddr==Ity_I32 ? mkU32(bias+offQ0) : mkU64(bias+offQ0);
-      addrQ0  = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBiasQ0) );
-      vdataQ0 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_0, vdata));
-      diQ0    = unsafeIRDirty_0_N(
-                   1/*regparms*/,
-                   hname, VG_(fnptr_to_fnentry)( helper ),
-                   mkIRExprVec_2( addrQ0, vdataQ0 )
-                );
-#if _SECRETGRIND_
-     if( data && clone ) {
-		  
-		/* this one is for subsequent limbs */
-	    _vdata = atom2vbits( mce, data );
-	    
-		IRAtom  *_dataQ0  = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_0, data));
-		IRAtom  *_vdataQ0 = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_0, _vdata));
-		IRAtom  *_eBiasQ0 = tyAddr==Ity_I32 ? mkU32(bias+offQ0) : mkU64(bias+offQ0);
-		di2 = create_dirty_STORE_V128or256( mce, clone, end, 0/*resSC*/, addr, _dataQ0, _vdataQ0, _eBiasQ0);
-		if ( di2 ) { complainIfTainted( mce, addr, di2 ); }
-	  }
-#endif
-	  
-	  /* =========== Q1 ================= */ 
-      eBiasQ1 = tyAddr==Ity_I32 ? mkU32(bias+offQ1) : mkU64(bias+offQ1);
-      addrQ1  = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBiasQ1) );
-      vdataQ1 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_1, vdata));
-      diQ1    = unsafeIRDirty_0_N(
-                   1/*regparms*/,
-                   hname, VG_(fnptr_to_fnentry)( helper ),
-                   mkIRExprVec_2( addrQ1, vdataQ1 )
-                );
-#if _SECRETGRIND_
-	  if( data && clone ) {
-		IRAtom  *_dataQ1  = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_1, data));
-		IRAtom  *_vdataQ1 = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_1, _vdata));
-		IRAtom  *_eBiasQ1 = tyAddr==Ity_I32 ? mkU32(bias+offQ1) : mkU64(bias+offQ1);
-		di2 = create_dirty_STORE_V128or256( mce, clone, end, 0/*resSC*/, addr, _dataQ1, _vdataQ1, _eBiasQ1);
-		if ( di2 ) { complainIfTainted( mce, addr, di2 ); }
-		 ppIRExpr(addrQ1); VG_(printf)("\n");
-	  }
-#endif
-	  
-	  /* =========== Q2 ================= */ 
-      eBiasQ2 = tyAddr==Ity_I32 ? mkU32(bias+offQ2) : mkU64(bias+offQ2);
-      addrQ2  = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBiasQ2) );
-      vdataQ2 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_2, vdata));
-      diQ2    = unsafeIRDirty_0_N(
-                   1/*regparms*/,
-                   hname, VG_(fnptr_to_fnentry)( helper ),
-                   mkIRExprVec_2( addrQ2, vdataQ2 )
-                );
-#if _SECRETGRIND_
-	  if( data && clone) {
-		IRAtom  *_dataQ2  = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_2, data));
-		IRAtom  *_vdataQ2 = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_2, _vdata));
-		IRAtom  *_eBiasQ2 = tyAddr==Ity_I32 ? mkU32(bias+offQ2) : mkU64(bias+offQ2);
-		di2 = create_dirty_STORE_V128or256( mce, clone, end, 0/*resSC*/, addr, _dataQ2, _vdataQ2, _eBiasQ2);
-		if ( di2 ) { complainIfTainted( mce, addr, di2 ); }
-	  }
-#endif
-	  
-	  /* =========== Q3 ================= */ 
-      eBiasQ3 = tyAddr==Ity_I32 ? mkU32(bias+offQ3) : mkU64(bias+offQ3);
-      addrQ3  = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBiasQ3) );
-      vdataQ3 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_3, vdata));
-      diQ3    = unsafeIRDirty_0_N(
-                   1/*regparms*/,
-                   hname, VG_(fnptr_to_fnentry)( helper ),
-                   mkIRExprVec_2( addrQ3, vdataQ3 )
-                );
-                
-#if _SECRETGRIND_
-	  if( data && clone ) {
-		IRAtom  *_dataQ3  = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_3, data));
-		IRAtom  *_vdataQ3 = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_3, _vdata));
-		IRAtom  *_eBiasQ3 = tyAddr==Ity_I32 ? mkU32(bias+offQ3) : mkU64(bias+offQ3);
-		di2 = create_dirty_STORE_V128or256( mce, clone, end, 0/*resSC*/, addr, _dataQ3, _vdataQ3, _eBiasQ3);
-		if ( di2 ) { complainIfTainted( mce, addr, di2 ); }
-	  }
-#endif
-                
-      if (guard)
-         diQ0->guard = diQ1->guard = diQ2->guard = diQ3->guard = guard;
-
-      setHelperAnns( mce, diQ0 );
-      setHelperAnns( mce, diQ1 );
-      setHelperAnns( mce, diQ2 );
-      setHelperAnns( mce, diQ3 );
-      stmt( 'V', mce, IRStmt_Dirty(diQ0) );
-      stmt( 'V', mce, IRStmt_Dirty(diQ1) );
-      stmt( 'V', mce, IRStmt_Dirty(diQ2) );
-      stmt( 'V', mce, IRStmt_Dirty(diQ3) );
-
-   }
-   else if (UNLIKELY(ty == Ity_V128)) {
-
-      /* V128-bit case */
-      /* See comment in next clause re 64-bit regparms */
-      /* also, need to be careful about endianness */
-      Int     offLo64, offHi64;
-      IRDirty *diLo64, *diHi64;
-      IRAtom  *addrLo64, *addrHi64;
-      IRAtom  *vdataLo64, *vdataHi64;
-      IRAtom  *eBiasLo64, *eBiasHi64;
-#if _SECRETGRIND_
-      IRAtom  *_vdata = 0;
-#endif
-
-      if (end == Iend_LE) {
-         offLo64 = 0;
-         offHi64 = 8;
+      if (ty == Ity_V256) {
+         IRAtom *vdataQ0 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_0, vdata));
+         IRAtom *vdataQ1 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_1, vdata));
+         IRAtom *vdataQ2 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_2, vdata));
+         IRAtom *vdataQ3 = assignNew('V', mce, Ity_I64, unop(Iop_V256to64_3, vdata));
+         di = unsafeIRDirty_0_N(
+                 1/*regparms*/,
+                 hname, VG_(fnptr_to_fnentry)( helper ),
+                 mkIRExprVec_5( addrAct, vdataQ0, vdataQ1, vdataQ2, vdataQ3 )
+              );
       } else {
-         offLo64 = 8;
-         offHi64 = 0;
+         IRAtom *vdataLo64 = assignNew('V', mce, Ity_I64, unop(Iop_V128to64, vdata));
+         IRAtom *vdataHi64 = assignNew('V', mce, Ity_I64, unop(Iop_V128HIto64, vdata));
+         di = unsafeIRDirty_0_N(
+                 1/*regparms*/,
+                 hname, VG_(fnptr_to_fnentry)( helper ),
+                 mkIRExprVec_3( addrAct, vdataLo64, vdataHi64 )
+              );
       }
-      
-      /* =========== low ================= */
-      eBiasLo64 = tyAddr==Ity_I32 ? mkU32(bias+offLo64) : mkU64(bias+offLo64);
-	  addrLo64  = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBiasLo64) );
-      vdataLo64 = assignNew('V', mce, Ity_I64, unop(Iop_V128to64, vdata));
-      diLo64    = unsafeIRDirty_0_N(
-                     1/*regparms*/,
-                     hname, VG_(fnptr_to_fnentry)( helper ),
-                     mkIRExprVec_2( addrLo64, vdataLo64 )
-                  );
-                  
-#if _SECRETGRIND_
-	  if( data && clone ) {
-		
-		/* this one is for subsequent limbs */
-	    _vdata = atom2vbits( mce, data );
-	 
-		IRAtom  *_dataLo64  = assignNew('C', mce, Ity_I64, unop(Iop_V128to64, data)); 
-		IRAtom  *_vdataLo64 = assignNew('C', mce, Ity_I64, unop(Iop_V128to64, _vdata));
-		IRAtom  *_eBiasLo64 = tyAddr==Ity_I32 ? mkU32(bias+offLo64) : mkU64(bias+offLo64);
-		di2 = create_dirty_STORE_V128or256( mce, clone, end, 0/*resSC*/, addr, _dataLo64, _vdataLo64, _eBiasLo64);
-		if ( di2 ) { complainIfTainted( mce, addr, di2 ); }
-	  }
-#endif
-	  
-      /* =========== high ================= */
-      eBiasHi64 = tyAddr==Ity_I32 ? mkU32(bias+offHi64) : mkU64(bias+offHi64);
-      addrHi64  = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBiasHi64) );
-      vdataHi64 = assignNew('V', mce, Ity_I64, unop(Iop_V128HIto64, vdata));
-      diHi64    = unsafeIRDirty_0_N(
-                     1/*regparms*/,
-                     hname, VG_(fnptr_to_fnentry)( helper ),
-                     mkIRExprVec_2( addrHi64, vdataHi64 )
-                  );
-                  
+
+      if (guard) di->guard = guard;
+      setHelperAnns( mce, di );
+      stmt( 'V', mce, IRStmt_Dirty(di) );
+
 #if _SECRETGRIND_
+      // after the shadow store, as the helper reads the taint back from memory
       if( data && clone ) {
-		IRAtom  *_dataHi64  = assignNew('C', mce, Ity_I64, unop(Iop_V128HIto64, data));
-		IRAtom  *_vdataHi64 = assignNew('C', mce, Ity_I64, unop(Iop_V128HIto64, _vdata));
-		IRAtom  *_eBiasHi64 = tyAddr==Ity_I32 ? mkU32(bias+offHi64) : mkU64(bias+offHi64);
-		di2 = create_dirty_STORE_V128or256( mce, clone, end, 0/*resSC*/, addr, _dataHi64, _vdataHi64, _eBiasHi64);
-		if ( di2 ) { complainIfTainted( mce, addr, di2 ); }
-	  }
+         di2 = create_dirty_STORE_V128or256( mce, clone, end, 0/*resSC*/, addr, data );
+         if ( di2 ) { emitGuardedDirty( mce, tguard, di2 ); }
+      }
 #endif
-	  
-      
-      if (guard) diLo64->guard = guard;
-      if (guard) diHi64->guard = guard;
-      setHelperAnns( mce, diLo64 );
-      setHelperAnns( mce, diHi64 );
-      stmt( 'V', mce, IRStmt_Dirty(diLo64) );
-      stmt( 'V', mce, IRStmt_Dirty(diHi64) );
 
    } else {
 
@@ -4983,6 +5766,17 @@ void do_shadow_Store ( MCEnv* mce,
          addrAct = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBias));
       }
 
+     #if _SECRETGRIND_
+      if (useInlineFastPath( mce, ty )) {
+         if( data && clone ){
+            di2 = create_dirty_STORE( mce, clone, end, 0/*resSC*/, addr, data );
+            if ( di2 ) emitGuardedDirty( mce, tguard, di2 );
+         }
+         do_shadow_Store_fast( mce, end, addrAct, vdata, guard );
+         return;
+      }
+     #endif
+
       if (ty == Ity_I64) {
          /* We can't do this with regparm 2 on 32-bit platforms, since
             the back ends aren't clever enough to handle 64-bit
@@ -5005,7 +5799,7 @@ void do_shadow_Store ( MCEnv* mce,
      // just like the original code
 	 if( data && clone ){
 		di2 = create_dirty_STORE( mce, clone, end, 0/*resSC*/, addr, data );
-		if ( di2 ) complainIfTainted( mce, addr, di2 );
+		if ( di2 ) emitGuardedDirty( mce, tguard, di2 );
      }
      #endif
    
@@ -5179,6 +5973,12 @@ void do_shadow_Dirty ( MCEnv* mce, IRDirty* d )
       tl_assert(toDo == 0); /* also need to handle 1-byte excess */
    }
 
+#if _SECRETGRIND_
+   /* the guest state and memory the helper reads are not seen by
+      tierNoteRead */
+   tierNoteShadow32( mce, curr );
+#endif
+
    /* Whew!  So curr is a 32-bit V-value summarising pessimistically
       all the inputs to the helper.  Now we need to re-distribute the
       results to all destinations. */
@@ -5248,7 +6048,20 @@ void do_shadow_Dirty ( MCEnv* mce, IRDirty* d )
    }
    
    // Taintgrind: Check for taint
+#if _SECRETGRIND_
+   if( !mce->emitHelpers )
+      return;
+   // nothing to report on without a result
+   if( mce->guardHelpers && d->tmp == IRTemp_INVALID )
+      return;
+#endif
    di2 = create_dirty_DIRTY( mce, d );
+#if _SECRETGRIND_
+   if( d->tmp != IRTemp_INVALID ) {
+      complainIfTainted(mce, IRExpr_RdTmp( d->tmp ), di2);
+      return;
+   }
+#endif
    complainIfTainted(mce, NULL /*d->guard*/, di2);
 }
 
@@ -5320,8 +6133,16 @@ void do_shadow_CAS ( MCEnv* mce, IRCAS* cas )
    }
 
    // Taintgrind: Check for taint
+#if _SECRETGRIND_
+   if( !mce->emitHelpers )
+      return;
+#endif
    di2 = create_dirty_CAS( mce, cas );
+#if _SECRETGRIND_
+   complainIfTainted( mce, IRExpr_RdTmp( cas->oldLo ), di2 );
+#else
    complainIfTainted( mce, NULL, di2 );
+#endif
 }
 
 static void bind_shadow_tmp_to_orig ( UChar how,
@@ -6112,106 +6933,158 @@ IRDirty* create_dirty_IMark( MCEnv* mce, IRStmt *clone ) {
    return unsafeIRDirty_0_N ( nargs/*regparms*/, nm, VG_(fnptr_to_fnentry)( fn ), args );
 }
 
+/* In summary-only mode there are no GET helpers left to notice that
+   main() has returned, and in guarded mode they only run on tainted
+   data, so a helper is placed on the few IMarks that can matter:
+   instructions of main(), below-main, and the entry of exit(). */
+static Bool imark_needs_main_summary( Addr64 addr ) {
+   HChar fnname[FNNAME_MAX];
+   Vg_FnNameKind kind;
+
+   if ( !TNT_(clo_summary) || TNT_(clo_summary_exit_only) ) { return False; }
+
+   kind = VG_(get_fnname_kind_from_IP)( (Addr)addr );
+   if ( kind == Vg_FnNameMain || kind == Vg_FnNameBelowMain ) { return True; }
+
+   return VG_(get_fnname_if_entry)( (Addr)addr, fnname, sizeof(fnname) )
+          && VG_(strcmp)( fnname, "exit" ) == 0;
+}
+
+IRDirty* create_dirty_main_summary( MCEnv* mce ) {
+   return unsafeIRDirty_0_N ( 0/*regparms*/, "TNT_(hxx_main_summary)",
+                              VG_(fnptr_to_fnentry)( &TNT_(hxx_main_summary) ),
+                              mkIRExprVec_0() );
+}
+
+/* --lazy-instrument=yes, before any taint source has fired: nothing is
+   tainted, so the shadow state needs no maintaining. The superblock runs
+   as is, save for the main() summary hooks. */
+static IRSB* instrument_lazy( IRSB* sb_in ) {
+   Int    i;
+   IRSB*  sb_out = deepCopyIRSBExceptStmts( sb_in );
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      IRStmt* st = sb_in->stmts[i];
+      addStmtToIRSB( sb_out, st );
+      if ( st->tag == Ist_IMark && imark_needs_main_summary( st->Ist.IMark.addr ) )
+         addStmtToIRSB( sb_out, IRStmt_Dirty( create_dirty_main_summary( NULL ) ) );
+   }
+   return sb_out;
+}
+
+/* Superblocks of the objects listed in the --models file run without taint
+   propagation: calls into them are modelled by the wrappers in tnt_wraps.c,
+   see tnt_models.c. A function entry checks it runs on behalf of such a call. */
+static IRSB* instrument_model( IRSB* sb_in, VexGuestExtents* vge ) {
+   Int    i;
+   Bool   entry = TNT_(models_is_entry)( (Addr)vge->base[0] );
+   IRSB*  sb_out = deepCopyIRSBExceptStmts( sb_in );
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      IRStmt* st = sb_in->stmts[i];
+      addStmtToIRSB( sb_out, st );
+      if ( st->tag != Ist_IMark )
+         continue;
+      if ( entry ) {
+         IRDirty* di = unsafeIRDirty_0_N( 1, "TNT_(model_check_entry)",
+                          VG_(fnptr_to_fnentry)( &TNT_(model_check_entry) ),
+                          mkIRExprVec_1( mkIRExpr_HWord( (HWord)vge->base[0] ) ) );
+         addStmtToIRSB( sb_out, IRStmt_Dirty( di ) );
+         entry = False;
+      }
+      if ( imark_needs_main_summary( st->Ist.IMark.addr ) )
+         addStmtToIRSB( sb_out, IRStmt_Dirty( create_dirty_main_summary( NULL ) ) );
+   }
+   return sb_out;
+}
+
 IRDirty* create_dirty_STORE_V128or256( MCEnv* mce, IRStmt *clone,
-                             IREndness end, IRTemp resSC, 
-                             IRExpr* addr, IRExpr* data, IRExpr* vdata, IRExpr* offset ){
+                             IREndness end, IRTemp resSC,
+                             IRExpr* addr, IRExpr* data ){
 //         ppIRExpr output: ST<end>(<addr>) = <data>
    Int          nargs = 3;
-   const HChar* nm = 0, *dnm = 0;
-   void*        fn = 0, *dfn = 0;
+   const HChar* nm = 0;
+   void*        fn = 0;
    IRExpr**     args = 0;
-   IRDirty *di = 0;
-   IRExpr * A = clone->Ist.Store.addr;
-   IRExpr * D = clone->Ist.Store.data;
-   
-   /* WARNING: clone and addr are NOT in sync with data, vdata. The latter two correspond to addr+offset
-    * Note: addr is a temp value used by the emulator, not the actual memory address, so we cannot use 
-    * addr+offset to recompute the address
-    * The test of Iex_Const and Iex_RdTmp use the clone struct
-    * The test on sizes use the data/addr struct
-    * This is because when getting high/lower limb from clone, new variables are created for addr and data
-    * Especially, the size of clone will be 128/256 and might be constants values, whereas data/addr
-    * are never constants and should have sizes of 64 (maybe 32 on 32bit arch). I dont check the size
-    * as this requires testing the type (flag), etc and it's enforced by code calling this function...
+   IRExpr*      lanes[4];
+   UInt         nLanes = 0;
+   IRType       ty = typeOfIRExpr(mce->sb->tyenv, data);
+   IRExpr *A = clone->Ist.Store.addr;
+   IRExpr *D = clone->Ist.Store.data;
+
+   /* The whole vector goes to the helper in one call, split in host
+    * words with the least significant lane first. The taint is not passed:
+    * the helper runs after helperc_STOREV128/256 and reads it back from
+    * shadow memory.
+    * The tests of Iex_Const and Iex_RdTmp use the clone struct, as the
+    * helpers decode the statement from it.
     * */
+   tl_assert( ty == Ity_V128 || ty == Ity_V256 );
+
    if ( A->tag == Iex_Const && D->tag == Iex_Const ) return NULL;
 
    if(mce->hWordTy == Ity_I32){
-	   
+
+      /* no 256-bit vectors on 32-bit hosts */
+      if ( ty != Ity_V128 ) {
+         VG_(tool_panic)("tnt_translate.c: create_dirty_STORE_V128or256: V256 on 32-bit host");
+      }
+
       if ( A->tag == Iex_RdTmp && D->tag == Iex_RdTmp ) {
-		  
          fn    = &TNT_(h32_store_v128or256_tt);
          nm    = "TNT_(h32_store_v128or256_tt)";
-         dnm   = "TNT_(h32_store_v128or256_prepare_tt)";
-         dfn   = &TNT_(h32_store_v128or256_prepare_tt);
-         
       } else if ( A->tag == Iex_RdTmp && D->tag == Iex_Const ) {
-		  
-		 fn    = &TNT_(h32_store_v128or256_tc);
+         fn    = &TNT_(h32_store_v128or256_tc);
          nm    = "TNT_(h32_store_v128or256_tc)";
-         dnm   = "TNT_(h32_store_v128or256_prepare_tc)";
-         dfn   = &TNT_(h32_store_v128or256_prepare_tc);
-         
       } else if ( A->tag == Iex_Const && D->tag == Iex_RdTmp ) {
-		  
          fn    = &TNT_(h32_store_v128or256_ct);
          nm    = "TNT_(h32_store_v128or256_ct)";
-         dnm   = "TNT_(h32_store_v128or256_prepare_ct)";
-         dfn   = &TNT_(h32_store_v128or256_prepare_ct);
-         
       } else {
          VG_(tool_panic)("tnt_translate.c: create_dirty_STORE_V128or256: unk 32-bit cfg");
       }
+
+      IRAtom *lo64 = assignNew('C', mce, Ity_I64, unop(Iop_V128to64, data));
+      IRAtom *hi64 = assignNew('C', mce, Ity_I64, unop(Iop_V128HIto64, data));
+      lanes[0] = assignNew('C', mce, Ity_I32, unop(Iop_64to32, lo64));
+      lanes[1] = assignNew('C', mce, Ity_I32, unop(Iop_64HIto32, lo64));
+      lanes[2] = assignNew('C', mce, Ity_I32, unop(Iop_64to32, hi64));
+      lanes[3] = assignNew('C', mce, Ity_I32, unop(Iop_64HIto32, hi64));
+      nLanes   = 4;
+
    }else if(mce->hWordTy == Ity_I64){
-	   
+
       if ( A->tag == Iex_RdTmp && D->tag == Iex_RdTmp ) {
          fn    = &TNT_(h64_store_v128or256_tt);
          nm    = "TNT_(h64_store_v128or256_tt)";
-         dnm   = "TNT_(h64_store_v128or256_prepare_tt)";
-         dfn   = &TNT_(h64_store_v128or256_prepare_tt);
-         
-         //VG_(printf)("addr->Iex.RdTmp.tmp:%u %u\n", addr->Iex.RdTmp.tmp, clone->Ist.Store.addr->Iex.RdTmp.tmp);
-         //VG_(printf)("data->Iex.RdTmp.tmp:%u %u\n", data->Iex.RdTmp.tmp, clone->Ist.Store.data->Iex.RdTmp.tmp);
-         //VG_(printf)("clone->data.tag %x data->tag %x\n", clone->Ist.Store.data->tag, data->tag);
-         //VG_(printf)("clone->addr.tag %x addr->tag %x\n", clone->Ist.Store.addr->tag, addr->tag);
-         
       } else if ( A->tag == Iex_RdTmp && D->tag == Iex_Const ) {
-		  
          fn    = &TNT_(h64_store_v128or256_tc);
          nm    = "TNT_(h64_store_v128or256_tc)";
-         dnm   = "TNT_(h64_store_v128or256_prepare_tc)";
-         dfn   = &TNT_(h64_store_v128or256_prepare_tc);
-         
       } else if ( A->tag == Iex_Const && D->tag == Iex_RdTmp ) {
-		  
          fn    = &TNT_(h64_store_v128or256_ct);
          nm    = "TNT_(h64_store_v128or256_ct)";
-         dnm   = "TNT_(h64_store_v128or256_prepare_ct)";
-         dfn   = &TNT_(h64_store_v128or256_prepare_ct);
-         
       } else {
          ppIRExpr(addr);
          ppIRExpr(data);
          VG_(tool_panic)("tnt_translate.c: create_dirty_STORE_V128or256: unk 64-bit cfg");
       }
+
+      if ( ty == Ity_V256 ) {
+         lanes[0] = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_0, data));
+         lanes[1] = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_1, data));
+         lanes[2] = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_2, data));
+         lanes[3] = assignNew('C', mce, Ity_I64, unop(Iop_V256to64_3, data));
+         nLanes   = 4;
+      } else {
+         lanes[0] = assignNew('C', mce, Ity_I64, unop(Iop_V128to64, data));
+         lanes[1] = assignNew('C', mce, Ity_I64, unop(Iop_V128HIto64, data));
+         lanes[2] = lanes[3] = mkU64(0);
+         nLanes   = 2;
+      }
    }else
       VG_(tool_panic)("tnt_translate.c: create_dirty_STORE_V128or256: Unknown platform");
 
-   /* TODO: just add a param to the commented function, and copy the code from h64_store_tt/h32_store_tt 
-    * I've not done it because I'm not sure the path is feasible
-    * */
-   if (!(fn && nm && dfn && dnm)) { VG_(tool_panic)("tnt_translate.c: create_dirty_STORE_V128or256: Unsupported operation:TODO"); }
-   
-   /* first prepare the call and pass the offset */
-   IRExpr *edata = convert_Value( mce, data );
-   args = mkIRExprVec_2( mkIRExpr_HWord((HWord)clone), convert_Value(mce, offset) );
-   di = unsafeIRDirty_0_N ( 2/*regparms*/, dnm, VG_(fnptr_to_fnentry)( dfn ), args );
-   setHelperAnns( mce, di );
-   stmt( 'V', mce, IRStmt_Dirty(di));
-   
-   /* finally call the callback */
-   IRExpr *evdata = convert_Value( mce, vdata );
-   args = mkIRExprVec_3( mkIRExpr_HWord((HWord)clone), edata, evdata ); 
+   args = mkIRExprVec_6( mkIRExpr_HWord((HWord)clone), mkIRExpr_HWord(nLanes),
+                         lanes[0], lanes[1], lanes[2], lanes[3] );
 
    return unsafeIRDirty_0_N ( nargs/*regparms*/, nm, VG_(fnptr_to_fnentry)( fn ), args );
 }
@@ -6300,7 +7173,7 @@ typedef
    tl_assert( isIRAtom(details->expdLo) );
    tl_assert( isIRAtom(details->dataLo) );
 
-   aStr = (HChar*)VG_(malloc)( "create_dirty_CAS", sizeof(HChar)*128 );
+   aStr = (HChar*)mallocClone( "create_dirty_CAS", sizeof(HChar)*128 );
 
    if( details->oldHi == IRTemp_INVALID )
       VG_(sprintf)( aStr, "0x%x 0x%x t%d = CAS 0x%x t%d", 
@@ -6390,7 +7263,7 @@ typedef
    Int      i, num_args = 0;
    HChar*   aStr;
 
-   aStr = (HChar*)VG_(malloc)( "create_dirty_DIRTY", sizeof(HChar)*128 );
+   aStr = (HChar*)mallocClone( "create_dirty_DIRTY", sizeof(HChar)*128 );
 
    if( details->tmp == IRTemp_INVALID )
       VG_(sprintf)( aStr, "0x%x", Ist_Dirty );
@@ -7068,6 +7941,695 @@ IRDirty* create_dirty_from_dirty( IRDirty* di_old ){
    return unsafeIRDirty_0_N ( regparms, nm, VG_(fnptr_to_fnentry)( fn ), di_args );
 }
 
+#if _SECRETGRIND_
+/*------------------------------------------------------------*/
+/*--- Shadow IR clean-up (--shadow-opt)                    ---*/
+/*------------------------------------------------------------*/
+
+/* The shadow code is emitted statement by statement without looking at
+   the rest of the superblock, so it is full of untainted constants
+   (definedOfType), GETs of shadow registers that were just PUT or GOT,
+   and shadow PUTs overwritten a few statements later.  Vex's own
+   post-instrumentation cleanup only does constant propagation and
+   dead code removal, and never looks at GETs and PUTs, so
+   optimiseShadowSB() does the following once the superblock is built:
+
+   - forward: constant-fold untainted V-bits, copy-propagate shadow
+     temps and forward shadow GETs from the last PUT/GET of the same
+     slot;
+   - backward: remove shadow PUTs overwritten before being read, and
+     shadow temps that are no longer used.
+
+   Only VSh temps and PUTs to the shadow area are rewritten; the
+   original statements and the helper calls are left untouched. */
+
+#define SHADOW_OPT_N_SLOTS 32
+
+typedef
+   struct {
+      Int     off;
+      IRType  ty;
+      IRAtom* atom;
+   }
+   ShadowSlot;
+
+static ULong n_shadow_folded    = 0;
+static ULong n_shadow_forwarded = 0;
+static ULong n_shadow_puts_rm   = 0;
+static ULong n_shadow_tmps_rm   = 0;
+
+void TNT_(get_shadow_opt_stats) ( ULong* folded, ULong* forwarded,
+                                  ULong* putsRemoved, ULong* tmpsRemoved )
+{
+   *folded      = n_shadow_folded;
+   *forwarded   = n_shadow_forwarded;
+   *putsRemoved = n_shadow_puts_rm;
+   *tmpsRemoved = n_shadow_tmps_rm;
+}
+
+static Bool isShadowTmp ( MCEnv* mce, IRTemp t )
+{
+   TempMapEnt* ent = VG_(indexXA)( mce->tmpMap, t );
+   return ent->kind == VSh;
+}
+
+static Bool isShadowOffset ( MCEnv* mce, Int off )
+{
+   return off >= mce->layout->total_sizeB
+          && off < 2 * mce->layout->total_sizeB;
+}
+
+static Bool isZeroAtom ( IRAtom* a )
+{
+   if (a->tag != Iex_Const) return False;
+   switch (a->Iex.Const.con->tag) {
+      case Ico_U1:   return a->Iex.Const.con->Ico.U1 == False;
+      case Ico_U8:   return a->Iex.Const.con->Ico.U8 == 0;
+      case Ico_U16:  return a->Iex.Const.con->Ico.U16 == 0;
+      case Ico_U32:  return a->Iex.Const.con->Ico.U32 == 0;
+      case Ico_U64:  return a->Iex.Const.con->Ico.U64 == 0;
+      case Ico_V128: return a->Iex.Const.con->Ico.V128 == 0;
+      default:       return False;
+   }
+}
+
+/* Same as definedOfType, but only for the types whose untainted value
+   is an atom; NULL otherwise. */
+static IRAtom* definedAtomOfType ( IRType ty )
+{
+   switch (ty) {
+      case Ity_I1: case Ity_I8: case Ity_I16:
+      case Ity_I32: case Ity_I64: case Ity_V128:
+         return definedOfType(ty);
+      default:
+         return NULL;
+   }
+}
+
+static Bool sameAtoms ( IRAtom* a1, IRAtom* a2 )
+{
+   if (a1->tag == Iex_RdTmp && a2->tag == Iex_RdTmp)
+      return a1->Iex.RdTmp.tmp == a2->Iex.RdTmp.tmp;
+   return isZeroAtom(a1) && isZeroAtom(a2);
+}
+
+/* Ops whose result is all zeroes (untainted) when their args are. */
+static Bool isZeroPreservingUnop ( IROp op )
+{
+   switch (op) {
+      case Iop_CmpNEZ8: case Iop_CmpNEZ16:
+      case Iop_CmpNEZ32: case Iop_CmpNEZ64:
+      case Iop_CmpwNEZ32: case Iop_CmpwNEZ64:
+      case Iop_Left8: case Iop_Left16: case Iop_Left32: case Iop_Left64:
+      case Iop_1Uto8: case Iop_1Uto32: case Iop_1Uto64:
+      case Iop_1Sto8: case Iop_1Sto16: case Iop_1Sto32: case Iop_1Sto64:
+      case Iop_8Uto16: case Iop_8Uto32: case Iop_8Uto64:
+      case Iop_16Uto32: case Iop_16Uto64: case Iop_32Uto64:
+      case Iop_8Sto16: case Iop_8Sto32: case Iop_8Sto64:
+      case Iop_16Sto32: case Iop_16Sto64: case Iop_32Sto64:
+      case Iop_64to8: case Iop_64to16: case Iop_64to32:
+      case Iop_32to8: case Iop_32to16: case Iop_16to8:
+      case Iop_16HIto8: case Iop_32HIto16: case Iop_64HIto32:
+      case Iop_128to64: case Iop_128HIto64:
+      case Iop_V128to64: case Iop_V128HIto64:
+      case Iop_32UtoV128: case Iop_64UtoV128:
+         return True;
+      default:
+         return False;
+   }
+}
+
+static IRAtom* substAtom ( IRAtom** repl, IRAtom* a )
+{
+   if (a && a->tag == Iex_RdTmp && repl[a->Iex.RdTmp.tmp])
+      return repl[a->Iex.RdTmp.tmp];
+   return a;
+}
+
+/* Substitute the known atoms into the (flat) expression e of type ty
+   and simplify it.  Returns an atom, a new expression, or e itself. */
+static IRExpr* foldShadowExpr ( IRAtom** repl, IRType ty, IRExpr* e )
+{
+   IRAtom *a1, *a2, *a3, *a4;
+   IRAtom* zero = definedAtomOfType(ty);
+
+   switch (e->tag) {
+      case Iex_RdTmp:
+         return substAtom(repl, e);
+      case Iex_Unop:
+         a1 = substAtom(repl, e->Iex.Unop.arg);
+         if (zero && isZeroAtom(a1) && isZeroPreservingUnop(e->Iex.Unop.op))
+            return zero;
+         return a1 == e->Iex.Unop.arg ? e : unop(e->Iex.Unop.op, a1);
+      case Iex_Binop:
+         a1 = substAtom(repl, e->Iex.Binop.arg1);
+         a2 = substAtom(repl, e->Iex.Binop.arg2);
+         switch (e->Iex.Binop.op) {
+            case Iop_Or8: case Iop_Or16: case Iop_Or32: case Iop_Or64:
+            case Iop_OrV128: case Iop_OrV256:
+               /* UifU with an untainted arg */
+               if (isZeroAtom(a2)) return a1;
+               if (isZeroAtom(a1)) return a2;
+               if (sameAtoms(a1, a2)) return a1;
+               break;
+            case Iop_And8: case Iop_And16: case Iop_And32: case Iop_And64:
+            case Iop_AndV128:
+               /* DifD with an untainted arg */
+               if (zero && (isZeroAtom(a1) || isZeroAtom(a2))) return zero;
+               break;
+            case Iop_8HLto16: case Iop_16HLto32: case Iop_32HLto64:
+            case Iop_64HLtoV128:
+               if (zero && isZeroAtom(a1) && isZeroAtom(a2)) return zero;
+               break;
+            default:
+               break;
+         }
+         if (a1 == e->Iex.Binop.arg1 && a2 == e->Iex.Binop.arg2) return e;
+         return binop(e->Iex.Binop.op, a1, a2);
+      case Iex_Triop:
+         a1 = substAtom(repl, e->Iex.Triop.details->arg1);
+         a2 = substAtom(repl, e->Iex.Triop.details->arg2);
+         a3 = substAtom(repl, e->Iex.Triop.details->arg3);
+         if (a1 == e->Iex.Triop.details->arg1
+             && a2 == e->Iex.Triop.details->arg2
+             && a3 == e->Iex.Triop.details->arg3) return e;
+         return triop(e->Iex.Triop.details->op, a1, a2, a3);
+      case Iex_Qop:
+         a1 = substAtom(repl, e->Iex.Qop.details->arg1);
+         a2 = substAtom(repl, e->Iex.Qop.details->arg2);
+         a3 = substAtom(repl, e->Iex.Qop.details->arg3);
+         a4 = substAtom(repl, e->Iex.Qop.details->arg4);
+         if (a1 == e->Iex.Qop.details->arg1
+             && a2 == e->Iex.Qop.details->arg2
+             && a3 == e->Iex.Qop.details->arg3
+             && a4 == e->Iex.Qop.details->arg4) return e;
+         return IRExpr_Qop(e->Iex.Qop.details->op, a1, a2, a3, a4);
+      case Iex_ITE:
+         a1 = substAtom(repl, e->Iex.ITE.cond);
+         a2 = substAtom(repl, e->Iex.ITE.iftrue);
+         a3 = substAtom(repl, e->Iex.ITE.iffalse);
+         if (a1->tag == Iex_Const)
+            return a1->Iex.Const.con->Ico.U1 ? a2 : a3;
+         if (sameAtoms(a2, a3)) return a2;
+         if (a1 == e->Iex.ITE.cond && a2 == e->Iex.ITE.iftrue
+             && a3 == e->Iex.ITE.iffalse) return e;
+         return IRExpr_ITE(a1, a2, a3);
+      default:
+         return e;
+   }
+}
+
+static void forgetShadowSlots ( ShadowSlot* slots, Int* nSlots,
+                                Int off, Int size )
+{
+   Int i, j;
+   for (i = j = 0; i < *nSlots; i++) {
+      Int sOff  = slots[i].off;
+      Int sSize = sizeofIRType(slots[i].ty);
+      if (sOff + sSize <= off || off + size <= sOff)
+         slots[j++] = slots[i];
+   }
+   *nSlots = j;
+}
+
+static void rememberShadowSlot ( ShadowSlot* slots, Int* nSlots,
+                                 Int off, IRType ty, IRAtom* atom )
+{
+   if (*nSlots == SHADOW_OPT_N_SLOTS) return;
+   slots[*nSlots].off  = off;
+   slots[*nSlots].ty   = ty;
+   slots[*nSlots].atom = atom;
+   (*nSlots)++;
+}
+
+static IRAtom* findShadowSlot ( ShadowSlot* slots, Int nSlots,
+                                Int off, IRType ty )
+{
+   Int i;
+   for (i = 0; i < nSlots; i++)
+      if (slots[i].off == off && slots[i].ty == ty)
+         return slots[i].atom;
+   return NULL;
+}
+
+static void shadowOptForward ( MCEnv* mce, IRAtom** repl )
+{
+   IRSB*      sb = mce->sb;
+   ShadowSlot slots[SHADOW_OPT_N_SLOTS];
+   Int        nSlots = 0;
+   Int        i;
+
+   for (i = 0; i < sb->stmts_used; i++) {
+      IRStmt* st = sb->stmts[i];
+      switch (st->tag) {
+         case Ist_WrTmp: {
+            IRTemp  t = st->Ist.WrTmp.tmp;
+            IRExpr* e = st->Ist.WrTmp.data;
+            IRType  ty;
+            IRExpr* e2;
+            if (!isShadowTmp(mce, t)) break;
+            ty = typeOfIRTemp(sb->tyenv, t);
+            if (e->tag == Iex_Get && isShadowOffset(mce, e->Iex.Get.offset)) {
+               IRAtom* a = findShadowSlot(slots, nSlots, e->Iex.Get.offset, ty);
+               if (a) {
+                  n_shadow_forwarded++;
+                  repl[t] = a;
+                  sb->stmts[i] = IRStmt_WrTmp(t, a);
+               } else {
+                  rememberShadowSlot(slots, &nSlots, e->Iex.Get.offset, ty,
+                                     mkexpr(t));
+               }
+               break;
+            }
+            e2 = foldShadowExpr(repl, ty, e);
+            if (e2 == e) break;
+            if (isIRAtom(e2)) {
+               n_shadow_folded++;
+               repl[t] = e2;
+            }
+            sb->stmts[i] = IRStmt_WrTmp(t, e2);
+            break;
+         }
+         case Ist_Put: {
+            Int     off = st->Ist.Put.offset;
+            IRAtom* a   = st->Ist.Put.data;
+            IRType  ty  = typeOfIRExpr(sb->tyenv, a);
+            if (!isShadowOffset(mce, off)) break;
+            a = substAtom(repl, a);
+            if (a != st->Ist.Put.data)
+               sb->stmts[i] = IRStmt_Put(off, a);
+            forgetShadowSlots(slots, &nSlots, off, sizeofIRType(ty));
+            rememberShadowSlot(slots, &nSlots, off, ty, a);
+            break;
+         }
+         case Ist_PutI: {
+            IRRegArray* descr = st->Ist.PutI.details->descr;
+            forgetShadowSlots(slots, &nSlots, descr->base,
+                              descr->nElems * sizeofIRType(descr->elemTy));
+            break;
+         }
+         case Ist_Dirty: {
+            IRDirty* d = st->Ist.Dirty.details;
+            Int      k;
+            for (k = 0; k < d->nFxState; k++)
+               if (d->fxState[k].fx != Ifx_Read)
+                  nSlots = 0;
+            break;
+         }
+         default:
+            break;
+      }
+   }
+}
+
+static void markUsedExpr ( IRExpr* e, UChar* used )
+{
+   Int i;
+   switch (e->tag) {
+      case Iex_RdTmp:
+         used[e->Iex.RdTmp.tmp] = 1;
+         break;
+      case Iex_GetI:
+         markUsedExpr(e->Iex.GetI.ix, used);
+         break;
+      case Iex_Qop:
+         markUsedExpr(e->Iex.Qop.details->arg1, used);
+         markUsedExpr(e->Iex.Qop.details->arg2, used);
+         markUsedExpr(e->Iex.Qop.details->arg3, used);
+         markUsedExpr(e->Iex.Qop.details->arg4, used);
+         break;
+      case Iex_Triop:
+         markUsedExpr(e->Iex.Triop.details->arg1, used);
+         markUsedExpr(e->Iex.Triop.details->arg2, used);
+         markUsedExpr(e->Iex.Triop.details->arg3, used);
+         break;
+      case Iex_Binop:
+         markUsedExpr(e->Iex.Binop.arg1, used);
+         markUsedExpr(e->Iex.Binop.arg2, used);
+         break;
+      case Iex_Unop:
+         markUsedExpr(e->Iex.Unop.arg, used);
+         break;
+      case Iex_Load:
+         markUsedExpr(e->Iex.Load.addr, used);
+         break;
+      case Iex_CCall:
+         for (i = 0; e->Iex.CCall.args[i]; i++)
+            markUsedExpr(e->Iex.CCall.args[i], used);
+         break;
+      case Iex_ITE:
+         markUsedExpr(e->Iex.ITE.cond, used);
+         markUsedExpr(e->Iex.ITE.iftrue, used);
+         markUsedExpr(e->Iex.ITE.iffalse, used);
+         break;
+      default:
+         break;
+   }
+}
+
+static void markUsedStmt ( IRStmt* st, UChar* used )
+{
+   Int      i;
+   IRDirty* d;
+   IRCAS*   cas;
+   switch (st->tag) {
+      case Ist_WrTmp:
+         markUsedExpr(st->Ist.WrTmp.data, used);
+         break;
+      case Ist_Put:
+         markUsedExpr(st->Ist.Put.data, used);
+         break;
+      case Ist_PutI:
+         markUsedExpr(st->Ist.PutI.details->ix, used);
+         markUsedExpr(st->Ist.PutI.details->data, used);
+         break;
+      case Ist_Store:
+         markUsedExpr(st->Ist.Store.addr, used);
+         markUsedExpr(st->Ist.Store.data, used);
+         break;
+      case Ist_StoreG:
+         markUsedExpr(st->Ist.StoreG.details->addr, used);
+         markUsedExpr(st->Ist.StoreG.details->data, used);
+         markUsedExpr(st->Ist.StoreG.details->guard, used);
+         break;
+      case Ist_LoadG:
+         markUsedExpr(st->Ist.LoadG.details->addr, used);
+         markUsedExpr(st->Ist.LoadG.details->alt, used);
+         markUsedExpr(st->Ist.LoadG.details->guard, used);
+         break;
+      case Ist_Dirty:
+         d = st->Ist.Dirty.details;
+         for (i = 0; d->args[i]; i++)
+            if (LIKELY(!is_IRExpr_VECRET_or_BBPTR(d->args[i])))
+               markUsedExpr(d->args[i], used);
+         if (d->guard) markUsedExpr(d->guard, used);
+         if (d->mAddr) markUsedExpr(d->mAddr, used);
+         break;
+      case Ist_CAS:
+         cas = st->Ist.CAS.details;
+         markUsedExpr(cas->addr, used);
+         if (cas->expdHi) markUsedExpr(cas->expdHi, used);
+         markUsedExpr(cas->expdLo, used);
+         if (cas->dataHi) markUsedExpr(cas->dataHi, used);
+         markUsedExpr(cas->dataLo, used);
+         break;
+      case Ist_LLSC:
+         markUsedExpr(st->Ist.LLSC.addr, used);
+         if (st->Ist.LLSC.storedata)
+            markUsedExpr(st->Ist.LLSC.storedata, used);
+         break;
+      case Ist_Exit:
+         markUsedExpr(st->Ist.Exit.guard, used);
+         break;
+      case Ist_AbiHint:
+         markUsedExpr(st->Ist.AbiHint.base, used);
+         markUsedExpr(st->Ist.AbiHint.nia, used);
+         break;
+      default:
+         break;
+   }
+}
+
+/* dead[] covers the shadow area: dead[i] is set when shadow byte i is
+   written later in the superblock before anything can read it. */
+static void setShadowDead ( MCEnv* mce, UChar* dead, Int off, Int size,
+                            UChar val )
+{
+   Int base = mce->layout->total_sizeB;
+   Int i;
+   for (i = off; i < off + size; i++)
+      if (i >= base && i < 2 * base)
+         dead[i - base] = val;
+}
+
+static Bool isShadowDead ( MCEnv* mce, UChar* dead, Int off, Int size )
+{
+   Int base = mce->layout->total_sizeB;
+   Int i;
+   for (i = off; i < off + size; i++)
+      if (!dead[i - base])
+         return False;
+   return True;
+}
+
+static void shadowOptBackward ( MCEnv* mce )
+{
+   IRSB*  sb   = mce->sb;
+   Int    size = mce->layout->total_sizeB;
+   UChar* used = VG_(calloc)("tnt.shadowOptBackward.1",
+                             sb->tyenv->types_used, sizeof(UChar));
+   UChar* dead = VG_(calloc)("tnt.shadowOptBackward.2", size, sizeof(UChar));
+   Int    i;
+
+   markUsedExpr(sb->next, used);
+
+   for (i = sb->stmts_used - 1; i >= 0; i--) {
+      IRStmt* st = sb->stmts[i];
+      switch (st->tag) {
+         case Ist_WrTmp: {
+            IRTemp  t = st->Ist.WrTmp.tmp;
+            IRExpr* e = st->Ist.WrTmp.data;
+            if (isShadowTmp(mce, t) && !used[t] && e->tag != Iex_Load) {
+               n_shadow_tmps_rm++;
+               sb->stmts[i] = IRStmt_NoOp();
+               continue;
+            }
+            if (e->tag == Iex_Get)
+               setShadowDead(mce, dead, e->Iex.Get.offset,
+                             sizeofIRType(e->Iex.Get.ty), 0);
+            else if (e->tag == Iex_GetI)
+               setShadowDead(mce, dead, e->Iex.GetI.descr->base,
+                             e->Iex.GetI.descr->nElems
+                                * sizeofIRType(e->Iex.GetI.descr->elemTy), 0);
+            else if (e->tag == Iex_Load)
+               VG_(memset)(dead, 0, size);
+            break;
+         }
+         case Ist_Put: {
+            Int off = st->Ist.Put.offset;
+            Int sz  = sizeofIRType(typeOfIRExpr(sb->tyenv, st->Ist.Put.data));
+            if (!isShadowOffset(mce, off)) break;
+            if (isShadowDead(mce, dead, off, sz)) {
+               n_shadow_puts_rm++;
+               sb->stmts[i] = IRStmt_NoOp();
+               continue;
+            }
+            setShadowDead(mce, dead, off, sz, 1);
+            break;
+         }
+         case Ist_PutI:
+         case Ist_IMark:
+         case Ist_NoOp:
+            break;
+         default:
+            /* Exits, memory accesses and helper calls may all let the
+               guest state be observed. */
+            VG_(memset)(dead, 0, size);
+            break;
+      }
+      markUsedStmt(st, used);
+   }
+
+   VG_(free)(dead);
+   VG_(free)(used);
+}
+
+static void optimiseShadowSB ( MCEnv* mce )
+{
+   IRAtom** repl = VG_(calloc)("tnt.optimiseShadowSB.1",
+                               mce->sb->tyenv->types_used, sizeof(IRAtom*));
+   shadowOptForward(mce, repl);
+   VG_(free)(repl);
+   shadowOptBackward(mce);
+}
+#endif // _SECRETGRIND_
+
+#if _SECRETGRIND_
+/*------------------------------------------------------------*/
+/*--- Instrumentation statistics (--instr-stats)           ---*/
+/*------------------------------------------------------------*/
+
+/* What TNT_(instrument) produced, printed by tnt_fini.  The helpers
+   are counted by the name given to their dirty call, so the LOADV/
+   STOREV helpers show up next to the h32_/h64_ ones. */
+
+typedef
+   struct {
+      const HChar* name;
+      ULong        n;
+   }
+   HelperCount;
+
+typedef
+   struct {
+      HChar* name;      // object, or "???"
+      ULong  nSBs;
+      ULong  nStmtsIn;
+      ULong  nStmtsOut;
+      ULong  nShadow;
+      ULong  nHelpers;
+   }
+   ObjStats;
+
+static ObjStats instr_totals;
+static XArray*  instr_helpers = NULL;  /* of HelperCount */
+static XArray*  instr_objs    = NULL;  /* of ObjStats */
+
+static void countHelperKind ( const HChar* name )
+{
+   HelperCount hc;
+   Word i;
+
+   if (!instr_helpers)
+      instr_helpers = VG_(newXA)( VG_(malloc), "tnt.instr_helpers.1",
+                                  VG_(free), sizeof(HelperCount) );
+   for (i = 0; i < VG_(sizeXA)( instr_helpers ); i++) {
+      HelperCount* p = VG_(indexXA)( instr_helpers, i );
+      if (p->name == name || VG_(strcmp)( p->name, name ) == 0) {
+         p->n++;
+         return;
+      }
+   }
+   hc.name = name;
+   hc.n    = 1;
+   VG_(addToXA)( instr_helpers, &hc );
+}
+
+static ObjStats* findObjStats ( Addr a )
+{
+   HChar    name[MAX_PATH];
+   ObjStats os;
+   Word     i;
+
+   if (!VG_(get_objname)( a, name, sizeof(name) ))
+      VG_(strcpy)( name, "???" );
+   if (!instr_objs)
+      instr_objs = VG_(newXA)( VG_(malloc), "tnt.instr_objs.1",
+                               VG_(free), sizeof(ObjStats) );
+   for (i = 0; i < VG_(sizeXA)( instr_objs ); i++) {
+      ObjStats* p = VG_(indexXA)( instr_objs, i );
+      if (VG_(strcmp)( p->name, name ) == 0)
+         return p;
+   }
+   VG_(memset)( &os, 0, sizeof(os) );
+   os.name = VG_(strdup)( "tnt.instr_objs.2", name );
+   VG_(addToXA)( instr_objs, &os );
+   return VG_(indexXA)( instr_objs, VG_(sizeXA)( instr_objs ) - 1 );
+}
+
+/* Account for the superblock just built from sb_in */
+static void countInstrStats ( MCEnv* mce, IRSB* sb_in, VexGuestExtents* vge )
+{
+   IRSB* sb = mce->sb;
+   ULong nOut = 0, nShadow = 0, nHelpers = 0;
+   Int   i;
+
+   for (i = 0; i < sb->stmts_used; i++) {
+      IRStmt* st = sb->stmts[i];
+      switch (st->tag) {
+         case Ist_NoOp:
+            continue;
+         case Ist_Dirty:
+            nHelpers++;
+            countHelperKind( st->Ist.Dirty.details->cee->name );
+            break;
+         case Ist_WrTmp:
+            if (isShadowTmp( mce, st->Ist.WrTmp.tmp ))
+               nShadow++;
+            break;
+         case Ist_Put:
+            if (isShadowOffset( mce, st->Ist.Put.offset ))
+               nShadow++;
+            break;
+         case Ist_PutI:
+            if (isShadowOffset( mce, st->Ist.PutI.details->descr->base ))
+               nShadow++;
+            break;
+         default:
+            break;
+      }
+      nOut++;
+   }
+
+   instr_totals.nSBs++;
+   instr_totals.nStmtsIn  += sb_in->stmts_used;
+   instr_totals.nStmtsOut += nOut;
+   instr_totals.nShadow   += nShadow;
+   instr_totals.nHelpers  += nHelpers;
+
+   if (TNT_(clo_instr_stats) == 2) {
+      ObjStats* os = findObjStats( (Addr)vge->base[0] );
+      os->nSBs++;
+      os->nStmtsIn  += sb_in->stmts_used;
+      os->nStmtsOut += nOut;
+      os->nShadow   += nShadow;
+      os->nHelpers  += nHelpers;
+   }
+}
+
+static Int cmpHelperCount ( const void* a, const void* b )
+{
+   const HelperCount* h1 = a;
+   const HelperCount* h2 = b;
+   return h1->n < h2->n ? 1 : h1->n > h2->n ? -1 : 0;
+}
+
+void TNT_(print_instr_stats) ( void )
+{
+   SizeT live, peak;
+   ULong total, made, freed;
+   Word  i;
+
+   if (!TNT_(clo_instr_stats))
+      return;
+
+   getCloneArenaStats( &live, &peak, &total, &made, &freed );
+
+   VG_(printf)("\n==%u== [INSTRUMENTATION STATS]\n---------------------------------------------------\n", VG_(getpid)());
+   VG_(printf)("superblocks translated: %llu\n", instr_totals.nSBs);
+   VG_(printf)("IR stmts in: %llu, out: %llu (%llu shadow, %llu helper calls)\n",
+               instr_totals.nStmtsIn, instr_totals.nStmtsOut,
+               instr_totals.nShadow, instr_totals.nHelpers);
+   VG_(printf)("clones: %llu bytes total, %lu peak\n", total, peak);
+
+   if (instr_helpers) {
+      VG_(ssort)( VG_(indexXA)( instr_helpers, 0 ), VG_(sizeXA)( instr_helpers ),
+                  sizeof(HelperCount), cmpHelperCount );
+      VG_(printf)("helper calls emitted, by kind (buffered ones included):\n");
+      for (i = 0; i < VG_(sizeXA)( instr_helpers ); i++) {
+         HelperCount* p = VG_(indexXA)( instr_helpers, i );
+         VG_(printf)("   %10llu %s\n", p->n, p->name);
+      }
+   }
+
+   if (instr_objs) {
+      VG_(printf)("per object (superblocks, stmts in, stmts out, shadow, helpers):\n");
+      for (i = 0; i < VG_(sizeXA)( instr_objs ); i++) {
+         ObjStats* p = VG_(indexXA)( instr_objs, i );
+         VG_(printf)("   %8llu %10llu %10llu %10llu %10llu %s\n",
+                     p->nSBs, p->nStmtsIn, p->nStmtsOut, p->nShadow,
+                     p->nHelpers, p->name);
+      }
+   }
+}
+
+void TNT_(instr_stats_release) ( void )
+{
+   Word i;
+
+   if (instr_objs) {
+      for (i = 0; i < VG_(sizeXA)( instr_objs ); i++)
+         VG_(free)( ((ObjStats*)VG_(indexXA)( instr_objs, i ))->name );
+      VG_(deleteXA)( instr_objs );
+      instr_objs = NULL;
+   }
+   if (instr_helpers) {
+      VG_(deleteXA)( instr_helpers );
+      instr_helpers = NULL;
+   }
+}
+#endif // _SECRETGRIND_
+
 IRSB* TNT_(instrument)( VgCallbackClosure* closure,
                         IRSB* sb_in,
                         VexGuestLayout* layout, 
@@ -7135,6 +8697,13 @@ IRSB* TNT_(instrument)( VgCallbackClosure* closure,
    tl_assert(sizeof(UInt)   == 4);
    tl_assert(sizeof(Int)    == 4);
 
+#if _SECRETGRIND_
+   // See TNT_(end_lazy_instrument)() in tnt_main.c
+   if ( TNT_(instr_lazy_pending) )
+      return instrument_lazy( sb_in );
+   if ( TNT_(models_match_obj)( vge ) )
+      return instrument_model( sb_in, vge );
+#endif
 
    // Print Register Contents
    // VEXThreadState struct reproduced from VEX/pub/libvex_guest_x86.h
@@ -7208,6 +8777,22 @@ typedef
    mce.layout         = layout;
    mce.hWordTy        = hWordTy;
    mce.bogusLiterals  = False;
+#if _SECRETGRIND_
+   // outside --instrument-objs/--instrument-fns, only propagate the shadow state
+   mce.emitHelpers    = !TNT_(instr_summary_only) && TNT_(instr_filter_match)( vge );
+   mce.guardHelpers   = TNT_(instr_guard_helpers);
+   // superblocks that have not read enough taint yet only propagate the shadow state
+   mce.tierNode       = False;
+   mce.tierAddr       = closure->nraddr;
+   mce.tierBase       = vge->base[0];
+   mce.tierTaint      = NULL;
+   if ( mce.emitHelpers && mce.guardHelpers && TNT_(clo_tier_threshold) ) {
+      mce.tierNode    = TNT_(tier_node)( closure->nraddr, vge );
+      mce.emitHelpers = !mce.tierNode;
+   }
+   mce.bufferHelpers  = mce.emitHelpers && TNT_(clo_event_buffer);
+   mce.nEvents        = 0;
+#endif
 
    /* Do expensive interpretation for Iop_Add32 and Iop_Add64 on
       Darwin.  10.7 is mostly built with LLVM, which uses these for
@@ -7223,6 +8808,14 @@ typedef
    mce.useLLVMworkarounds = True;
 #  endif
 
+   mce.fastPrecision = False;
+#if _SECRETGRIND_
+   if ( TNT_(clo_fast_precision) ) {
+      mce.fastPrecision      = True;
+      mce.useLLVMworkarounds = False;
+   }
+#endif
+
    mce.tmpMap = VG_(newXA)( VG_(malloc), "mc.TNT_(instrument).1", VG_(free),
                             sizeof(TempMapEnt));
 
@@ -7235,6 +8828,9 @@ typedef
    }
    tl_assert( VG_(sizeXA)( mce.tmpMap ) == sb_in->tyenv->types_used );
 
+   /* The helpers index ti[]/tv[] with the original tmps */
+   TNT_(tmp_table_reserve)( sb_in->tyenv->types_used );
+
    /* Make a preliminary inspection of the statements, to see if there
       are any dodgy-looking literals.  If there are, we generate
       extra-detailed (hence extra-expensive) instrumentation in
@@ -7256,7 +8852,7 @@ typedef
       tl_assert(st);
       tl_assert(isFlatIRStmt(st));
 
-      if (!bogus) {
+      if (!bogus && !mce.fastPrecision) {
          bogus = checkForBogusLiterals(st);
          if (0 && bogus) {
             VG_(printf)("bogus: ");
@@ -7268,6 +8864,13 @@ typedef
 
    mce.bogusLiterals = bogus;
 
+#if _SECRETGRIND_
+   mce.untaintedTmps  = NULL;
+   mce.nUntaintedTmps = 0;
+   if ( TNT_(clo_static_untainted) )
+      findUntaintedTmps( &mce, sb_in );
+#endif
+
    /* Copy verbatim any IR preamble preceding the first IMark */
 
    tl_assert(mce.sb == sb_out);
@@ -7346,6 +8949,10 @@ typedef
       VG_(printf)("\n");
    }
 
+   /* Everything cloned from here on lives in this translation's arena,
+      released by tnt_discard_superblock_info in tnt_main.c */
+   beginCloneArena( closure->nraddr, vge->base[0] );
+
    for (/*use existing i*/; i < sb_in->stmts_used; i++) {
       st = sb_in->stmts[i];
       first_stmt = sb_out->stmts_used;
@@ -7360,7 +8967,12 @@ typedef
 	  
       /* Emulate shadow operations for each stmt ... */
       // Taintgrind: clone the IRStmt. Defined in copy.c
+#if _SECRETGRIND_
+      // The clone is only read by the per-statement helpers
+      IRStmt *clone = mce.emitHelpers ? deepMallocIRStmt(st) : NULL;
+#else
       IRStmt *clone = deepMallocIRStmt(st);
+#endif
   
       switch (st->tag) {
 
@@ -7369,6 +8981,12 @@ typedef
                              clone,
                              st->Ist.WrTmp.tmp,
                              st->Ist.WrTmp.data );
+#if _SECRETGRIND_
+            if ( st->Ist.WrTmp.data->tag == Iex_Get ||
+                 st->Ist.WrTmp.data->tag == Iex_GetI ||
+                 st->Ist.WrTmp.data->tag == Iex_Load )
+               tierNoteRead( &mce, mkexpr(st->Ist.WrTmp.tmp) );
+#endif
 //            assign( 'V', &mce, findShadowTmpV(&mce, st->Ist.WrTmp.tmp),
 //                               expr2vbits( &mce, st->Ist.WrTmp.data) );
             break;
@@ -7400,16 +9018,31 @@ typedef
 
          case Ist_LoadG:
             do_shadow_LoadG( &mce, st->Ist.LoadG.details );
+#if _SECRETGRIND_
+            tierNoteRead( &mce, mkexpr(st->Ist.LoadG.details->dst) );
+#endif
             break;
 
          case Ist_Exit: // Conditional jumps, if(t<guard>) goto {Boring} <addr>:I32
+#if _SECRETGRIND_
+            if ( !mce.emitHelpers ) break;
+#endif
             di2 = create_dirty_EXIT( &mce, clone, st->Ist.Exit.guard, 
                                      st->Ist.Exit.jk, st->Ist.Exit.dst );
+#if _SECRETGRIND_
+            if ( di2 ) refresh_expr_bookkeeping( &mce, st->Ist.Exit.guard );
+#endif
             complainIfTainted( &mce, st->Ist.Exit.guard, di2 );
             break;
 
          case Ist_IMark:
 #if _SECRETGRIND_
+            mce.curIMark = st->Ist.IMark.addr;
+            // the GET helpers no longer run on every execution, so the end-of-main() check moves here
+            if ( (!mce.emitHelpers || mce.guardHelpers) && imark_needs_main_summary( st->Ist.IMark.addr ) )
+               complainIfTainted( &mce, NULL, create_dirty_main_summary( &mce ) );
+            // hxx_imark_t() only records the instruction for --mnemonics
+            if ( !mce.emitHelpers || !TNT_(clo_mnemonics) ) break;
 		    di2 = create_dirty_IMark( &mce, clone );
             complainIfTainted( &mce, NULL, di2 ); // second arg not longer used anyway
 #endif            
@@ -7433,6 +9066,11 @@ typedef
 
          case Ist_CAS:
             do_shadow_CAS( &mce, st->Ist.CAS.details );
+#if _SECRETGRIND_
+            tierNoteRead( &mce, mkexpr(st->Ist.CAS.details->oldLo) );
+            if (st->Ist.CAS.details->oldHi != IRTemp_INVALID)
+               tierNoteRead( &mce, mkexpr(st->Ist.CAS.details->oldHi) );
+#endif
             /* Note, do_shadow_CAS copies the CAS itself to the output
                block, because it needs to add instrumentation both
                before and after it.  Hence skip the copy below.  Also
@@ -7447,6 +9085,11 @@ typedef
                             st->Ist.LLSC.result,
                             st->Ist.LLSC.addr,
                             st->Ist.LLSC.storedata );
+#if _SECRETGRIND_
+            // load-linked
+            if (st->Ist.LLSC.storedata == NULL)
+               tierNoteRead( &mce, mkexpr(st->Ist.LLSC.result) );
+#endif
             break;
 
          default:
@@ -7462,6 +9105,13 @@ typedef
          above. */
       /* Taintgrind: Similarly, we execute the WrTmp's and Dirty's first,
                  so that we can print out the resulting values post-execution */
+#if _SECRETGRIND_
+      /* report what happened so far in the superblock before leaving it */
+      if (st->tag == Ist_Exit) {
+         flushEvents( &mce, st->Ist.Exit.guard );
+         tierReport( &mce, st->Ist.Exit.guard );
+      }
+#endif
       if (st->tag != Ist_CAS &&
           st->tag != Ist_WrTmp &&
           st->tag != Ist_Dirty )
@@ -7476,8 +9126,27 @@ typedef
       VG_(printf)("\n\n");
    }
 
+#if _SECRETGRIND_
+   if ( mce.emitHelpers ) {
+#endif
    di2 = create_dirty_NEXT( &mce, sb_in->next );
+#if _SECRETGRIND_
+   if ( di2 ) refresh_expr_bookkeeping( &mce, sb_in->next );
+#endif
    if ( di2 ) complainIfTainted( &mce, sb_in->next, di2 );
+#if _SECRETGRIND_
+   }
+   flushEvents( &mce, NULL );
+   tierReport( &mce, NULL );
+   if ( TNT_(clo_shadow_opt) )
+      optimiseShadowSB( &mce );
+   if ( TNT_(clo_instr_stats) )
+      countInstrStats( &mce, sb_in, vge );
+   if ( mce.untaintedTmps )
+      VG_(free)( mce.untaintedTmps );
+#endif
+
+   endCloneArena();
 
    if (0 && verboze) {
    //if (1) {
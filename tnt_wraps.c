@@ -97,6 +97,390 @@
 	return r;
 }*/
 
+// =========================================
+// 				 libc models
+// =========================================
+// Propagating taint instruction by instruction through libc's vectorized
+// routines is slow. Instead, the tool does the whole operation natively and
+// applies its effect on the shadow memory in one go (see TNT_(model_*) in tnt_main.c).
+// A request returns 0 when the models are disabled (--libc-models=no, --trace,
+// --summary-verbose) or the range is not client memory; we then call the original.
+// Calls that the compiler inlined or made inside libc itself are not modelled.
+#if _SECRETGRIND_
+#define TNT_MODEL(req, a1, a2, a3) \
+	VALGRIND_DO_CLIENT_REQUEST_EXPR(0, req, a1, a2, a3, 0, 0)
+
+W_LIBC_FUNC(void*, memcpy, void *dst, const void *src, size_t n) {
+	void *    r;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	if ( TNT_MODEL(VG_USERREQ__TAINTGRIND_MODEL_MEMMOVE, dst, src, n) ) {
+		return dst;
+	}
+	CALL_FN_W_WWW(r, fn, dst, src, n);
+	return r;
+}
+
+W_LIBC_FUNC(void*, memmove, void *dst, const void *src, size_t n) {
+	void *    r;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	if ( TNT_MODEL(VG_USERREQ__TAINTGRIND_MODEL_MEMMOVE, dst, src, n) ) {
+		return dst;
+	}
+	CALL_FN_W_WWW(r, fn, dst, src, n);
+	return r;
+}
+
+// c is passed by address so the tool can read its shadow
+W_LIBC_FUNC(void*, memset, void *s, int c, size_t n) {
+	void *    r;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	if ( TNT_MODEL(VG_USERREQ__TAINTGRIND_MODEL_MEMSET, s, &c, n) ) {
+		return s;
+	}
+	CALL_FN_W_WWW(r, fn, s, c, n);
+	return r;
+}
+
+W_LIBC_FUNC(char*, strcpy, char *dst, const char *src) {
+	char *    r;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	if ( TNT_MODEL(VG_USERREQ__TAINTGRIND_MODEL_STRCPY, dst, src, 0) ) {
+		return dst;
+	}
+	CALL_FN_W_WW(r, fn, dst, src);
+	return r;
+}
+
+// the tool writes the length into r, and taints it if any byte it depends on is tainted
+W_LIBC_FUNC(size_t, strlen, const char *s) {
+	size_t    r;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	if ( TNT_MODEL(VG_USERREQ__TAINTGRIND_MODEL_STRLEN, s, &r, 0) ) {
+		return r;
+	}
+	CALL_FN_W_W(r, fn, s);
+	return r;
+}
+
+// =========================================
+// 				 crypto models
+// =========================================
+// Taint summaries for common crypto entry points, enabled by --models=<file>
+// (see tnt_models.c). On entry, a wrapper hands the regions its result depends
+// on to the tool. If the function is enabled, it then runs the original --
+// without taint propagation when its object is listed in the file -- and the
+// tool taints each output region iff one of the inputs was tainted. The clean
+// regions, eg the return value, are untainted.
+// The structures below mirror the layout of mbedtls 2.x and OpenSSL.
+
+#define W_MBEDCRYPTO_FUNC(ret_ty, f, args...) W_FUNC(libmbedcryptoZdsoZa/*libmbedcrypto.so**/,ret_ty,f,args)
+#define W_LIBCRYPTO_FUNC(ret_ty, f, args...) W_FUNC(libcryptoZdsoZa/*libcrypto.so**/,ret_ty,f,args)
+
+typedef struct { int s; size_t n; unsigned long *p; } sg_mbedtls_mpi;			// limbs: mbedtls_mpi_uint
+typedef struct { int nr; uint32_t *rk; uint32_t buf[68]; } sg_mbedtls_aes_context;
+typedef struct { unsigned long *d; int top; int dmax; int neg; int flags; } sg_bignum;	// limbs: BN_ULONG
+typedef struct { unsigned int rd_key[4*(14+1)]; int rounds; } sg_aes_key;
+
+#define SG_N(a)			(sizeof(a)/sizeof((a)[0]))
+#define SG_R(a,l)		{ (const void*)(a), (unsigned long)(l) }
+#define SG_MPI(X)		SG_R( (X) ? (X)->p : 0, (X) ? (X)->n * sizeof(unsigned long) : 0 )
+#define SG_BN(X)		SG_R( (X)->d, (X)->top * sizeof(unsigned long) )
+#define MODEL_ENTER(name, ins) \
+	VALGRIND_DO_CLIENT_REQUEST_EXPR(0, VG_USERREQ__TAINTGRIND_MODEL_ENTER, name, ins, SG_N(ins), 0, 0)
+#define MODEL_EXIT(outs, nouts, clean, nclean) \
+	VALGRIND_DO_CLIENT_REQUEST_STMT(VG_USERREQ__TAINTGRIND_MODEL_EXIT, outs, nouts, clean, nclean, 0)
+
+// --- mbedtls bignums
+
+W_MBEDCRYPTO_FUNC(int, mbedtls_mpi_mul_mpi, sg_mbedtls_mpi *X, const sg_mbedtls_mpi *A, const sg_mbedtls_mpi *B) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_MPI(A), SG_MPI(B) };
+	modelled = MODEL_ENTER("mbedtls_mpi_mul_mpi", ins);
+	CALL_FN_W_WWW(r, fn, X, A, B);
+	if ( modelled ) {
+		SG_region outs[] = { SG_MPI(X) };
+		SG_region clean[] = { SG_R(X, sizeof(*X)), SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_MBEDCRYPTO_FUNC(int, mbedtls_mpi_mod_mpi, sg_mbedtls_mpi *R, const sg_mbedtls_mpi *A, const sg_mbedtls_mpi *B) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_MPI(A), SG_MPI(B) };
+	modelled = MODEL_ENTER("mbedtls_mpi_mod_mpi", ins);
+	CALL_FN_W_WWW(r, fn, R, A, B);
+	if ( modelled ) {
+		SG_region outs[] = { SG_MPI(R) };
+		SG_region clean[] = { SG_R(R, sizeof(*R)), SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+// _RR caches R^2 mod N across calls, and may be NULL
+W_MBEDCRYPTO_FUNC(int, mbedtls_mpi_exp_mod, sg_mbedtls_mpi *X, const sg_mbedtls_mpi *A, const sg_mbedtls_mpi *E, const sg_mbedtls_mpi *N, sg_mbedtls_mpi *_RR) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_MPI(A), SG_MPI(E), SG_MPI(N), SG_MPI(_RR) };
+	modelled = MODEL_ENTER("mbedtls_mpi_exp_mod", ins);
+	CALL_FN_W_5W(r, fn, X, A, E, N, _RR);
+	if ( modelled ) {
+		SG_region outs[] = { SG_MPI(X), SG_MPI(_RR) };
+		SG_region clean[] = { SG_R(X, sizeof(*X)), SG_R(_RR, _RR ? sizeof(*_RR) : 0), SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+// --- mbedtls AES
+
+W_MBEDCRYPTO_FUNC(int, mbedtls_aes_setkey_enc, sg_mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(key, keybits/8) };
+	modelled = MODEL_ENTER("mbedtls_aes_setkey_enc", ins);
+	CALL_FN_W_WWW(r, fn, ctx, key, keybits);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(ctx, sizeof(*ctx)) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_MBEDCRYPTO_FUNC(int, mbedtls_aes_setkey_dec, sg_mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(key, keybits/8) };
+	modelled = MODEL_ENTER("mbedtls_aes_setkey_dec", ins);
+	CALL_FN_W_WWW(r, fn, ctx, key, keybits);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(ctx, sizeof(*ctx)) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_MBEDCRYPTO_FUNC(int, mbedtls_aes_crypt_ecb, sg_mbedtls_aes_context *ctx, int mode, const unsigned char *input, unsigned char *output) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(ctx, sizeof(*ctx)), SG_R(input, 16) };
+	modelled = MODEL_ENTER("mbedtls_aes_crypt_ecb", ins);
+	CALL_FN_W_WWWW(r, fn, ctx, mode, input, output);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(output, 16) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+// --- mbedtls SHA
+
+W_MBEDCRYPTO_FUNC(int, mbedtls_sha256_ret, const unsigned char *input, size_t ilen, unsigned char *output, int is224) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(input, ilen) };
+	modelled = MODEL_ENTER("mbedtls_sha256_ret", ins);
+	CALL_FN_W_WWWW(r, fn, input, ilen, output, is224);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(output, is224 ? 28 : 32) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_MBEDCRYPTO_FUNC(int, mbedtls_sha512_ret, const unsigned char *input, size_t ilen, unsigned char *output, int is384) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(input, ilen) };
+	modelled = MODEL_ENTER("mbedtls_sha512_ret", ins);
+	CALL_FN_W_WWWW(r, fn, input, ilen, output, is384);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(output, is384 ? 48 : 64) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+// --- OpenSSL bignums
+
+W_LIBCRYPTO_FUNC(int, BN_mul, sg_bignum *r_, const sg_bignum *a, const sg_bignum *b, void *ctx) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_BN(a), SG_BN(b) };
+	modelled = MODEL_ENTER("BN_mul", ins);
+	CALL_FN_W_WWWW(r, fn, r_, a, b, ctx);
+	if ( modelled ) {
+		SG_region outs[] = { SG_BN(r_) };
+		SG_region clean[] = { SG_R(r_, sizeof(*r_)), SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_LIBCRYPTO_FUNC(int, BN_mod_exp, sg_bignum *r_, const sg_bignum *a, const sg_bignum *p, const sg_bignum *m, void *ctx) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_BN(a), SG_BN(p), SG_BN(m) };
+	modelled = MODEL_ENTER("BN_mod_exp", ins);
+	CALL_FN_W_5W(r, fn, r_, a, p, m, ctx);
+	if ( modelled ) {
+		SG_region outs[] = { SG_BN(r_) };
+		SG_region clean[] = { SG_R(r_, sizeof(*r_)), SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_LIBCRYPTO_FUNC(int, BN_mod_exp_mont, sg_bignum *r_, const sg_bignum *a, const sg_bignum *p, const sg_bignum *m, void *ctx, void *in_mont) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_BN(a), SG_BN(p), SG_BN(m) };
+	modelled = MODEL_ENTER("BN_mod_exp_mont", ins);
+	CALL_FN_W_6W(r, fn, r_, a, p, m, ctx, in_mont);
+	if ( modelled ) {
+		SG_region outs[] = { SG_BN(r_) };
+		SG_region clean[] = { SG_R(r_, sizeof(*r_)), SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+// --- OpenSSL AES
+
+W_LIBCRYPTO_FUNC(int, AES_set_encrypt_key, const unsigned char *userKey, const int bits, sg_aes_key *key) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(userKey, bits > 0 ? bits/8 : 0) };
+	modelled = MODEL_ENTER("AES_set_encrypt_key", ins);
+	CALL_FN_W_WWW(r, fn, userKey, bits, key);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(key, sizeof(*key)) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_LIBCRYPTO_FUNC(int, AES_set_decrypt_key, const unsigned char *userKey, const int bits, sg_aes_key *key) {
+	int    r, modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(userKey, bits > 0 ? bits/8 : 0) };
+	modelled = MODEL_ENTER("AES_set_decrypt_key", ins);
+	CALL_FN_W_WWW(r, fn, userKey, bits, key);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(key, sizeof(*key)) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_LIBCRYPTO_FUNC(void, AES_encrypt, const unsigned char *in, unsigned char *out, const sg_aes_key *key) {
+	int    modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(in, 16), SG_R(key, sizeof(*key)) };
+	modelled = MODEL_ENTER("AES_encrypt", ins);
+	CALL_FN_v_WWW(fn, in, out, key);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(out, 16) };
+		MODEL_EXIT(outs, SG_N(outs), 0, 0);
+	}
+}
+
+W_LIBCRYPTO_FUNC(void, AES_decrypt, const unsigned char *in, unsigned char *out, const sg_aes_key *key) {
+	int    modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(in, 16), SG_R(key, sizeof(*key)) };
+	modelled = MODEL_ENTER("AES_decrypt", ins);
+	CALL_FN_v_WWW(fn, in, out, key);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(out, 16) };
+		MODEL_EXIT(outs, SG_N(outs), 0, 0);
+	}
+}
+
+// --- OpenSSL SHA and HMAC: md may be NULL, in which case a static buffer is returned
+
+W_LIBCRYPTO_FUNC(unsigned char*, SHA256, const unsigned char *d, size_t n, unsigned char *md) {
+	unsigned char *r;
+	int    modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(d, n) };
+	modelled = MODEL_ENTER("SHA256", ins);
+	CALL_FN_W_WWW(r, fn, d, n, md);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(r, 32) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+W_LIBCRYPTO_FUNC(unsigned char*, SHA512, const unsigned char *d, size_t n, unsigned char *md) {
+	unsigned char *r;
+	int    modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(d, n) };
+	modelled = MODEL_ENTER("SHA512", ins);
+	CALL_FN_W_WWW(r, fn, d, n, md);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(r, 64) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+
+// md_len tells us the size of the output, so always pass one
+W_LIBCRYPTO_FUNC(unsigned char*, HMAC, const void *evp_md, const void *key, int key_len, const unsigned char *d, size_t n, unsigned char *md, unsigned int *md_len) {
+	unsigned char *r;
+	unsigned int len = 0;
+	int    modelled;
+	OrigFn fn;
+	VALGRIND_GET_ORIG_FN(fn);
+	SG_region ins[] = { SG_R(key, key_len > 0 ? key_len : 0), SG_R(d, n) };
+	modelled = MODEL_ENTER("HMAC", ins);
+	if ( modelled && !md_len ) { md_len = &len; }
+	CALL_FN_W_7W(r, fn, evp_md, key, key_len, d, n, md, md_len);
+	if ( modelled ) {
+		SG_region outs[] = { SG_R(r, r ? *md_len : 0) };
+		SG_region clean[] = { SG_R(&r, sizeof(r)), SG_R(md_len, sizeof(*md_len)) };
+		MODEL_EXIT(outs, SG_N(outs), clean, SG_N(clean));
+	}
+	return r;
+}
+#endif // _SECRETGRIND_
+
 // Note: when strlen uses SIMD instructions, the result is tainted
 // Turns out this the wrapper is not reliable because the calls 
 // compilers drop a code "inline".